@@ -0,0 +1,293 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include "profiler.h"
+#include "stb_image.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// One file holding the assets of the scene: shader sources, source and cooked textures and cooked models, each
+// stored under the path it is otherwise read from. The file is mapped into memory when it is opened, so opening it
+// reads only the index and every asset costs the page faults of its own bytes instead of an open and a parse.
+//
+// Layout, little endian:
+//   header  "APAK", version, entry count, size of the index (uint32 each)
+//   index   per entry: offset and size (uint64 each), name length (uint32) and name
+//   blobs   each starting on a BLOB_ALIGNMENT boundary, so vertices and texture levels can be used in place
+class AssetPack
+{
+public:
+    static const uint32_t MAGIC = 0x4b415041; // "APAK"
+    static const uint32_t VERSION = 1;
+    static const size_t BLOB_ALIGNMENT = 64;
+
+    // the bytes of an asset, inside the mapping
+    struct Entry {
+        const unsigned char *data;
+        size_t size;
+    };
+
+    static AssetPack &Get()
+    {
+        static AssetPack pack;
+        return pack;
+    }
+
+    ~AssetPack()
+    {
+        Close();
+    }
+
+    bool Open(const std::string &path)
+    {
+        PROFILE_SCOPE("load.assetPack");
+        Close();
+        int file = open(path.c_str(), O_RDONLY);
+        struct stat fileStat;
+        if (file < 0 || fstat(file, &fileStat) != 0)
+        {
+            if (file >= 0)
+                close(file);
+            std::cout << "ERROR::ASSET_PACK::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        mappingSize = (size_t)fileStat.st_size;
+        void *data = mappingSize ? mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+        // the mapping keeps the file open
+        close(file);
+        if (data == MAP_FAILED)
+        {
+            std::cout << "ERROR::ASSET_PACK::MAPPING_FAILED: " << path << std::endl;
+            return false;
+        }
+        mapping = (const unsigned char *)data;
+
+        uint32_t header[4];
+        if (mappingSize < sizeof(header) || (memcpy(header, mapping, sizeof(header)), header[0] != MAGIC) || header[1] != VERSION ||
+            sizeof(header) + header[3] > mappingSize)
+        {
+            std::cout << "ERROR::ASSET_PACK::INVALID_HEADER: " << path << std::endl;
+            Close();
+            return false;
+        }
+        const unsigned char *index = mapping + sizeof(header), *indexEnd = index + header[3];
+        for (uint32_t i = 0; i < header[2]; i++)
+        {
+            uint64_t offset, size;
+            uint32_t nameLength;
+            if (index + 20 > indexEnd)
+                break;
+            memcpy(&offset, index, 8);
+            memcpy(&size, index + 8, 8);
+            memcpy(&nameLength, index + 16, 4);
+            index += 20;
+            if (index + nameLength > indexEnd || offset + size > mappingSize)
+                break;
+            Entry entry = { mapping + offset, (size_t)size };
+            entries[std::string((const char *)index, nameLength)] = entry;
+            index += nameLength;
+        }
+        if (entries.size() != header[2])
+        {
+            std::cout << "ERROR::ASSET_PACK::INVALID_INDEX: " << path << std::endl;
+            Close();
+            return false;
+        }
+        // the blobs are read once, mostly in order
+        madvise((void *)mapping, mappingSize, MADV_WILLNEED);
+        return true;
+    }
+
+    void Close()
+    {
+        if (mapping)
+            munmap((void *)mapping, mappingSize);
+        mapping = NULL;
+        mappingSize = 0;
+        entries.clear();
+    }
+
+    bool IsOpen() const
+    {
+        return mapping != NULL;
+    }
+
+    // the asset stored under a path, or null if the pack doesn't hold it
+    const Entry *Find(const std::string &name) const
+    {
+        if (!mapping)
+            return NULL;
+        std::map<std::string, Entry>::const_iterator found = entries.find(name);
+        return found == entries.end() ? NULL : &found->second;
+    }
+
+    // whether an asset can be read, from the pack or from its file
+    static bool Exists(const std::string &path)
+    {
+        struct stat fileStat;
+        return Get().Find(path) || stat(path.c_str(), &fileStat) == 0;
+    }
+
+    // the whole of an asset as text, from the pack or from its file
+    static bool ReadText(const std::string &path, std::string &text)
+    {
+        if (const Entry *entry = Get().Find(path))
+        {
+            text.assign((const char *)entry->data, entry->size);
+            return true;
+        }
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file)
+            return false;
+        std::stringstream stream;
+        stream << file.rdbuf();
+        text = stream.str();
+        return true;
+    }
+
+    // stbi_load, decoding the image from the pack when it holds it
+    static unsigned char *LoadImage(const std::string &path, int *width, int *height, int *nrComponents, int desiredComponents)
+    {
+        if (const Entry *entry = Get().Find(path))
+            return stbi_load_from_memory(entry->data, (int)entry->size, width, height, nrComponents, desiredComponents);
+        return stbi_load(path.c_str(), width, height, nrComponents, desiredComponents);
+    }
+
+private:
+    const unsigned char *mapping = NULL;
+    size_t mappingSize = 0;
+    std::map<std::string, Entry> entries;
+};
+
+// Collects files and generated blobs and writes them into a pack. Files are only read while the pack is written,
+// one at a time.
+class AssetPackWriter
+{
+public:
+    // adds a file under its own path, returning false if it can't be read
+    bool AddFile(const std::string &path)
+    {
+        struct stat fileStat;
+        if (stat(path.c_str(), &fileStat) != 0 || !S_ISREG(fileStat.st_mode))
+            return false;
+        if (contains(path))
+            return true;
+        Item item;
+        item.name = path;
+        item.file = path;
+        item.size = (size_t)fileStat.st_size;
+        items.push_back(item);
+        return true;
+    }
+
+    // adds generated data under a name
+    void AddBlob(const std::string &name, const std::vector<unsigned char> &data)
+    {
+        if (contains(name))
+            return;
+        Item item;
+        item.name = name;
+        item.data = data;
+        item.size = data.size();
+        items.push_back(item);
+    }
+
+    size_t Count() const
+    {
+        return items.size();
+    }
+
+    bool Save(const std::string &path, size_t &bytes) const
+    {
+        PROFILE_SCOPE("pack.write");
+        uint32_t indexSize = 0;
+        for (size_t i = 0; i < items.size(); i++)
+            indexSize += 20 + (uint32_t)items[i].name.size();
+        uint32_t header[4] = { AssetPack::MAGIC, AssetPack::VERSION, (uint32_t)items.size(), indexSize };
+
+        // the blobs follow the index, each at the next aligned offset
+        std::vector<uint64_t> offsets(items.size());
+        uint64_t offset = sizeof(header) + indexSize;
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            offset = align(offset);
+            offsets[i] = offset;
+            offset += items[i].size;
+        }
+
+        std::ofstream file(path.c_str(), std::ios::binary);
+        file.write((const char *)header, sizeof(header));
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            uint64_t size = items[i].size;
+            uint32_t nameLength = (uint32_t)items[i].name.size();
+            file.write((const char *)&offsets[i], 8);
+            file.write((const char *)&size, 8);
+            file.write((const char *)&nameLength, 4);
+            file.write(items[i].name.data(), nameLength);
+        }
+        uint64_t position = sizeof(header) + indexSize;
+        std::vector<char> padding(AssetPack::BLOB_ALIGNMENT, 0);
+        for (size_t i = 0; i < items.size() && file; i++)
+        {
+            file.write(&padding[0], (std::streamsize)(offsets[i] - position));
+            if (items[i].file.empty())
+                file.write((const char *)items[i].data.data(), (std::streamsize)items[i].size);
+            else
+            {
+                std::ifstream source(items[i].file.c_str(), std::ios::binary);
+                std::vector<char> contents(items[i].size);
+                if (!contents.empty() && !source.read(&contents[0], (std::streamsize)contents.size()))
+                {
+                    std::cout << "ERROR::ASSET_PACK::FILE_NOT_SUCCESFULLY_READ: " << items[i].file << std::endl;
+                    return false;
+                }
+                file.write(contents.data(), (std::streamsize)contents.size());
+            }
+            position = offsets[i] + items[i].size;
+        }
+        if (!file)
+        {
+            std::cout << "ERROR::ASSET_PACK::FILE_NOT_WRITABLE: " << path << std::endl;
+            return false;
+        }
+        bytes = (size_t)position;
+        return true;
+    }
+
+private:
+    // a file read when the pack is written, or a blob made by the packer
+    struct Item {
+        std::string name;
+        std::string file;
+        std::vector<unsigned char> data;
+        size_t size = 0;
+    };
+
+    std::vector<Item> items;
+
+    bool contains(const std::string &name) const
+    {
+        for (size_t i = 0; i < items.size(); i++)
+            if (items[i].name == name)
+                return true;
+        return false;
+    }
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + AssetPack::BLOB_ALIGNMENT - 1) / AssetPack::BLOB_ALIGNMENT * AssetPack::BLOB_ALIGNMENT;
+    }
+};
+#endif
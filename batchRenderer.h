@@ -0,0 +1,281 @@
+#ifndef BATCH_RENDERER_H
+#define BATCH_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "camera.h"
+#include "scene.h"
+#include "offscreenContext.h"
+#include "stb_image_write.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+
+// one image of a material comparison sheet: a sphere with a material, shading model and view
+struct BatchJob {
+    std::string output;
+    ShadingModel shading = SHADING_COOK_TORRANCE;
+    bool blinn = false;
+    std::string material;
+    // overrides of the material, negative when the material's own value or map is used
+    float shininess = -1.0f;
+    float roughness = -1.0f;
+    float metallic = -1.0f;
+    // sphere rotation around y in degrees
+    float rotation = 0.0f;
+    glm::vec3 position = glm::vec3(0.0f, 0.0f, 3.0f);
+    float yaw = -90.0f;
+    float pitch = 0.0f;
+};
+
+// Renders a list of jobs into image files through a framebuffer object, reusing the scene's compiled programs,
+// sphere mesh and textures for every job. Materials with overridden values are made once and then reused.
+//
+// Jobs file, one job per line, '#' starts a comment:
+//   <output.png> <phong|blinn|cooktorrance> <material> [shininess=<s>] [roughness=<r>] [metallic=<m>]
+//                [rotate=<degrees>] [view=<front|side|top|x,y,z,yaw,pitch>]
+// Any scene material can be used with any shading model: Phong takes the albedo map of a PBR material, and
+// Cook-Torrance gives a Phong material a flat normal, no metalness and a roughness of 0.5.
+class BatchRenderer
+{
+public:
+    BatchRenderer(Scene &scene, Framebuffer &framebuffer) : scene(scene), framebuffer(framebuffer)
+    {
+    }
+
+    static bool LoadJobs(const std::string &path, std::vector<BatchJob> &jobs)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::BATCH::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        std::string line;
+        unsigned int lineNumber = 0;
+        while (std::getline(file, line))
+        {
+            lineNumber++;
+            size_t comment = line.find('#');
+            if (comment != std::string::npos)
+                line = line.substr(0, comment);
+            std::istringstream tokens(line);
+            BatchJob job;
+            std::string shading;
+            if (!(tokens >> job.output))
+                continue;
+            if (!(tokens >> shading >> job.material))
+            {
+                std::cout << "ERROR::BATCH::INCOMPLETE_JOB at line " << lineNumber << std::endl;
+                return false;
+            }
+            if (shading == "phong" || shading == "blinn")
+            {
+                job.shading = SHADING_PHONG;
+                job.blinn = shading == "blinn";
+            }
+            else if (shading == "cooktorrance")
+                job.shading = SHADING_COOK_TORRANCE;
+            else
+            {
+                std::cout << "ERROR::BATCH::UNKNOWN_SHADING_MODEL " << shading << " at line " << lineNumber << std::endl;
+                return false;
+            }
+
+            std::string option;
+            while (tokens >> option)
+            {
+                size_t equals = option.find('=');
+                std::string key = option.substr(0, equals), value = equals == std::string::npos ? "" : option.substr(equals + 1);
+                bool valid = true;
+                if (key == "shininess")
+                    job.shininess = (float)atof(value.c_str());
+                else if (key == "roughness")
+                    job.roughness = (float)atof(value.c_str());
+                else if (key == "metallic")
+                    job.metallic = (float)atof(value.c_str());
+                else if (key == "rotate")
+                    job.rotation = (float)atof(value.c_str());
+                else if (key == "view")
+                    valid = parseView(value, job);
+                else
+                    valid = false;
+                if (!valid)
+                {
+                    std::cout << "ERROR::BATCH::INVALID_OPTION " << option << " at line " << lineNumber << std::endl;
+                    return false;
+                }
+            }
+            jobs.push_back(job);
+        }
+        return true;
+    }
+
+    // draws the job into the framebuffer and writes it out
+    bool Render(const BatchJob &job)
+    {
+        int material = resolveMaterial(job);
+        if (material < 0)
+        {
+            std::cout << "ERROR::BATCH::UNKNOWN_MATERIAL " << job.material << std::endl;
+            return false;
+        }
+
+        Camera camera(job.position, glm::vec3(0.0f, 1.0f, 0.0f), job.yaw, job.pitch);
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)framebuffer.width / (float)framebuffer.height, 0.1f, 100.0f);
+        SceneState state;
+        state.blinn = job.blinn;
+        glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(job.rotation), glm::vec3(0.0f, 1.0f, 0.0f));
+        vector<DrawItem> items(1, scene.Sphere(job.shading, material, model));
+
+        framebuffer.Bind();
+        glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        scene.DrawList(items, camera, state, projection);
+        framebuffer.Resolve();
+
+        int width = framebuffer.width, height = framebuffer.height;
+        pixels.resize((size_t)width * height * 3);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+        // image files start at the top row, the framebuffer at the bottom one
+        if (!stbi_write_png(job.output.c_str(), width, height, 3, &pixels[(size_t)(height - 1) * width * 3], -width * 3))
+        {
+            std::cout << "ERROR::BATCH::FILE_NOT_WRITABLE: " << job.output << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    Scene &scene;
+    Framebuffer &framebuffer;
+    std::vector<unsigned char> pixels;
+    // material index for every combination of material, shading model and overrides made so far
+    std::map<std::string, int> materials;
+    // albedo maps loaded for the other shading model, which samples them with or without sRGB decoding
+    std::map<std::pair<std::string, TextureKind>, GpuTexture> albedos;
+
+    static bool parseView(const std::string &value, BatchJob &job)
+    {
+        if (value == "front")
+        {
+            job.position = glm::vec3(0.0f, 0.0f, 3.0f);
+            job.yaw = -90.0f;
+            job.pitch = 0.0f;
+        }
+        else if (value == "side")
+        {
+            job.position = glm::vec3(3.0f, 0.0f, 0.0f);
+            job.yaw = 180.0f;
+            job.pitch = 0.0f;
+        }
+        else if (value == "top")
+        {
+            job.position = glm::vec3(0.0f, 3.0f, 0.0f);
+            job.yaw = -90.0f;
+            job.pitch = -89.0f;
+        }
+        else
+        {
+            glm::vec3 position;
+            float yaw, pitch;
+            if (sscanf(value.c_str(), "%f,%f,%f,%f,%f", &position.x, &position.y, &position.z, &yaw, &pitch) != 5)
+                return false;
+            job.position = position;
+            job.yaw = yaw;
+            job.pitch = pitch;
+        }
+        return true;
+    }
+
+    int resolveMaterial(const BatchJob &job)
+    {
+        std::ostringstream key;
+        key << job.shading << ' ' << job.material << ' ' << job.shininess << ' ' << job.roughness << ' ' << job.metallic;
+        std::map<std::string, int>::iterator found = materials.find(key.str());
+        if (found != materials.end())
+            return found->second;
+
+        int index = job.shading == SHADING_PHONG ? phongMaterial(job) : pbrMaterial(job);
+        materials[key.str()] = index;
+        return index;
+    }
+
+    GpuTexture albedoTexture(const std::string &path, TextureKind kind)
+    {
+        std::pair<std::string, TextureKind> key(path, kind);
+        if (!albedos.count(key))
+            albedos[key] = GpuTexture(loadTexture(path.c_str(), kind));
+        return albedos[key];
+    }
+
+    int phongMaterial(const BatchJob &job)
+    {
+        int own = scene.FindMaterial(SHADING_PHONG, job.material);
+        if (own >= 0 && job.shininess < 0.0f)
+            return own;
+
+        PhongMaterial material;
+        if (own >= 0)
+            material = scene.phongMaterials[own];
+        else
+        {
+            int pbr = scene.FindMaterial(SHADING_COOK_TORRANCE, job.material);
+            if (pbr < 0)
+                return -1;
+            // the coefficients of the concrete sphere
+            material.name = job.material;
+            material.albedoPath = scene.pbrMaterials[pbr].paths[PBR_ALBEDO];
+            material.albedo = albedoTexture(material.albedoPath, TEXTURE_COLOR_RAW);
+            material.shininess = 32.0f;
+            material.diffuse = glm::vec3(0.8f);
+            material.specular = glm::vec3(0.3f);
+        }
+        if (job.shininess >= 0.0f)
+            material.shininess = job.shininess;
+        scene.phongMaterials.push_back(material);
+        return (int)scene.phongMaterials.size() - 1;
+    }
+
+    int pbrMaterial(const BatchJob &job)
+    {
+        int own = scene.FindMaterial(SHADING_COOK_TORRANCE, job.material);
+        if (own >= 0 && job.roughness < 0.0f && job.metallic < 0.0f)
+            return own;
+
+        PbrMaterial material;
+        if (own >= 0)
+            material = scene.pbrMaterials[own];
+        else
+        {
+            int phong = scene.FindMaterial(SHADING_PHONG, job.material);
+            if (phong < 0)
+                return -1;
+            material.name = job.material;
+            material.paths[PBR_ALBEDO] = scene.phongMaterials[phong].albedoPath;
+            material.albedo = albedoTexture(material.paths[PBR_ALBEDO], TEXTURE_COLOR);
+            material.normal = scene.ConstantTexture(glm::vec3(0.5f, 0.5f, 1.0f));
+            material.metallic = scene.ConstantTexture(glm::vec3(0.0f));
+            material.roughness = scene.ConstantTexture(glm::vec3(0.5f));
+            material.ao = scene.ConstantTexture(glm::vec3(1.0f));
+        }
+        if (job.roughness >= 0.0f)
+            material.roughness = scene.ConstantTexture(glm::vec3(job.roughness));
+        if (job.metallic >= 0.0f)
+            material.metallic = scene.ConstantTexture(glm::vec3(job.metallic));
+        if (scene.packedOrm)
+            material.orm = scene.PackedOrmTexture(material, job.roughness, job.metallic);
+        scene.pbrMaterials.push_back(material);
+        return (int)scene.pbrMaterials.size() - 1;
+    }
+};
+#endif
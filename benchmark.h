@@ -0,0 +1,152 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+// summary statistics of a series of samples, in the unit the samples were recorded in
+struct SampleStats {
+    double mean = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+};
+
+// Collects per-frame measurements of a benchmark run and writes them out as JSON for regression tracking
+class BenchmarkResults
+{
+public:
+    std::string scene;
+    int width = 0;
+    int height = 0;
+    std::string renderer;
+    std::vector<double> cpuFrameMs;
+    std::vector<double> gpuFrameMs;
+    std::vector<double> wallFrameMs;
+    std::vector<unsigned int> drawCalls;
+    std::vector<unsigned long long> triangles;
+
+    void AddFrame(double cpuMs, double wallMs, unsigned int frameDrawCalls, unsigned long long frameTriangles)
+    {
+        cpuFrameMs.push_back(cpuMs);
+        wallFrameMs.push_back(wallMs);
+        drawCalls.push_back(frameDrawCalls);
+        triangles.push_back(frameTriangles);
+    }
+
+    // GPU times arrive a few frames late from the timer queries so they are added separately
+    void AddGpuFrame(double gpuMs)
+    {
+        gpuFrameMs.push_back(gpuMs);
+    }
+
+    static SampleStats Summarize(std::vector<double> samples)
+    {
+        SampleStats stats;
+        if (samples.empty())
+            return stats;
+        std::sort(samples.begin(), samples.end());
+        double sum = 0.0;
+        for (unsigned int i = 0; i < samples.size(); i++)
+            sum += samples[i];
+        stats.mean = sum / samples.size();
+        stats.min = samples.front();
+        stats.max = samples.back();
+        stats.p50 = percentile(samples, 0.50);
+        stats.p95 = percentile(samples, 0.95);
+        stats.p99 = percentile(samples, 0.99);
+        return stats;
+    }
+
+    std::string ToJson() const
+    {
+        std::ostringstream json;
+        json.precision(6);
+        json << "{\n";
+        json << "  \"scene\": \"" << escape(scene) << "\",\n";
+        json << "  \"renderer\": \"" << escape(renderer) << "\",\n";
+        json << "  \"width\": " << width << ",\n";
+        json << "  \"height\": " << height << ",\n";
+        json << "  \"frames\": " << cpuFrameMs.size() << ",\n";
+        json << "  \"cpu_ms\": " << statsJson(Summarize(cpuFrameMs)) << ",\n";
+        json << "  \"gpu_ms\": " << statsJson(Summarize(gpuFrameMs)) << ",\n";
+        json << "  \"wall_ms\": " << statsJson(Summarize(wallFrameMs)) << ",\n";
+        json << "  \"draw_calls_per_frame\": " << mean(drawCalls) << ",\n";
+        json << "  \"triangles_per_frame\": " << mean(triangles);
+        for (unsigned int i = 0; i < sections.size(); i++)
+            json << ",\n  \"" << sections[i].first << "\": " << sections[i].second;
+        json << "\n}\n";
+        return json.str();
+    }
+
+    // adds a named, already serialized JSON value to the report
+    void AddSection(const std::string &name, const std::string &json)
+    {
+        sections.push_back(std::make_pair(name, json));
+    }
+
+    bool Save(const std::string &path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::BENCHMARK::FILE_NOT_WRITABLE: " << path << std::endl;
+            return false;
+        }
+        file << ToJson();
+        return true;
+    }
+
+private:
+    std::vector<std::pair<std::string, std::string> > sections;
+
+    // nearest-rank percentile of sorted samples
+    static double percentile(const std::vector<double> &sorted, double p)
+    {
+        size_t rank = (size_t)(p * sorted.size() + 0.5);
+        if (rank < 1)
+            rank = 1;
+        if (rank > sorted.size())
+            rank = sorted.size();
+        return sorted[rank - 1];
+    }
+
+    template <typename T>
+    static double mean(const std::vector<T> &values)
+    {
+        if (values.empty())
+            return 0.0;
+        double sum = 0.0;
+        for (unsigned int i = 0; i < values.size(); i++)
+            sum += (double)values[i];
+        return sum / values.size();
+    }
+
+    static std::string statsJson(const SampleStats &stats)
+    {
+        std::ostringstream json;
+        json.precision(6);
+        json << "{ \"mean\": " << stats.mean << ", \"min\": " << stats.min << ", \"max\": " << stats.max
+             << ", \"p50\": " << stats.p50 << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99 << " }";
+        return json.str();
+    }
+
+    static std::string escape(const std::string &text)
+    {
+        std::string out;
+        for (unsigned int i = 0; i < text.size(); i++)
+        {
+            if (text[i] == '"' || text[i] == '\\')
+                out += '\\';
+            out += text[i];
+        }
+        return out;
+    }
+};
+#endif
@@ -0,0 +1,50 @@
+// The Cook-Torrance BRDF terms, shared by the shaders that shade with it
+
+// define PI
+const float PI = 3.14159265359;
+
+// Normal Distribution GGX - Trowbridge-Reitz GGX
+float NormalDistributionGGX(vec3 N, vec3 H, float roughness) {
+    // define a to be the roughness squared and square it again for the numerator of the NDF
+    float a = roughness*roughness;
+    float a2 = a*a;
+    // get the dot of the halfvector and the normal (passed in) and square them (part of denominator)
+    float NH = max(dot(N, H), 0.0);
+    float NH2 = NH*NH;
+    // multiply N dot H squared by alpha squared -1 and add 1 to it 
+    float denom = (NH2 * (a2 - 1.0) + 1.0);
+    // multiply by PI and square the denominator to get final denominator
+    denom = PI * denom * denom; 
+
+    return a2/denom;
+}
+
+// Geometry Schlick GGX
+float GeometrySchlickGGX(float NV, float roughness) {
+    // since direct lighting is being used, k is a+1 squared then divided by 8
+    float r = (roughness + 1.0);
+    float k = (r*r) / 8.0;
+    // the numerator is N dot V and the denominator is N dot V times 1-k + k
+    float numerator= NV;
+    float denominator = NV * (1.0 - k) + k;
+
+    return numerator / denominator;
+}
+
+// Geometry Smith - use the result of Geometry Schlick GGX to take geometry obstruction and shadowing into account
+float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness) {
+    // get the dot product of N with V and N with L again
+    float NdotV = max(dot(N, V), 0.0);
+    float NdotL = max(dot(N, L), 0.0);
+    // call the SchlickGGX for NdotV and for NdotL and multiply their results 
+    float ggx2 = GeometrySchlickGGX(NdotV, roughness);
+    float ggx1 = GeometrySchlickGGX(NdotL, roughness);
+
+    return ggx1 * ggx2;
+}
+
+// Fresnel Schlick - describes ratio of reflection over refraction
+vec3 fresnelSchlick(float cosTheta, vec3 F0) {
+    // fresnel-schlick approximation formula where F0 is set to constant value of 0.04
+    return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
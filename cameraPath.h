@@ -0,0 +1,154 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+// Keys that change the scene, stored as a bit mask per frame so a recording can drive the exact same updates on replay
+enum Input_Key {
+    INPUT_CAMERA_UP      = 1 << 0,
+    INPUT_CAMERA_DOWN    = 1 << 1,
+    INPUT_CAMERA_LEFT    = 1 << 2,
+    INPUT_CAMERA_RIGHT   = 1 << 3,
+    INPUT_CAMERA_FORWARD = 1 << 4,
+    INPUT_CAMERA_BACK    = 1 << 5,
+    INPUT_ROTATE_GOLD    = 1 << 6,
+    INPUT_ROTATE_BRICK   = 1 << 7,
+    INPUT_ROTATE_PHONG   = 1 << 8,
+    INPUT_ROTATE_PHONG2  = 1 << 9,
+    INPUT_TOGGLE_BLINN   = 1 << 10
+};
+
+// Default fixed timestep used when playing a path back (60 frames per second)
+const float PATH_TIMESTEP = 1.0f / 60.0f;
+
+// camera pose, field of view and key state for a single frame
+struct CameraFrame {
+    glm::vec3 Position;
+    float Yaw;
+    float Pitch;
+    float Zoom;
+    unsigned int Keys;
+};
+
+// A per-frame sequence of camera poses and key states. Recorded from live input or generated as a spline flythrough,
+// then replayed with a fixed timestep so that every run renders the identical frame sequence.
+class CameraPath
+{
+public:
+    std::vector<CameraFrame> Frames;
+    float Timestep;
+
+    CameraPath(float timestep = PATH_TIMESTEP) : Timestep(timestep)
+    {
+    }
+
+    // appends the camera pose after this frame's input has been applied
+    void Record(const Camera &camera, unsigned int keys)
+    {
+        CameraFrame frame;
+        frame.Position = camera.Position;
+        frame.Yaw = camera.Yaw;
+        frame.Pitch = camera.Pitch;
+        frame.Zoom = camera.Zoom;
+        frame.Keys = keys;
+        Frames.push_back(frame);
+    }
+
+    // writes the path as plain text: a header line followed by one line per frame. Version 1 files, from before
+    // the zoom was recorded, are still read, with the default zoom.
+    bool Save(const std::string &path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::CAMERA_PATH::FILE_NOT_WRITABLE: " << path << std::endl;
+            return false;
+        }
+        file.precision(9);
+        file << "camerapath 2 " << Timestep << " " << Frames.size() << "\n";
+        for (unsigned int i = 0; i < Frames.size(); i++)
+        {
+            const CameraFrame &f = Frames[i];
+            file << f.Position.x << " " << f.Position.y << " " << f.Position.z << " "
+                 << f.Yaw << " " << f.Pitch << " " << f.Zoom << " " << f.Keys << "\n";
+        }
+        return true;
+    }
+
+    bool Load(const std::string &path)
+    {
+        std::ifstream file(path);
+        std::string magic;
+        int version = 0;
+        size_t count = 0;
+        if (!file || !(file >> magic >> version >> Timestep >> count) || magic != "camerapath" || version < 1 || version > 2)
+        {
+            std::cout << "ERROR::CAMERA_PATH::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        Frames.clear();
+        Frames.reserve(count);
+        CameraFrame f;
+        f.Zoom = ZOOM;
+        while (file >> f.Position.x >> f.Position.y >> f.Position.z >> f.Yaw >> f.Pitch && (version < 2 || file >> f.Zoom) && file >> f.Keys)
+            Frames.push_back(f);
+        if (Frames.size() != count)
+            std::cout << "WARNING::CAMERA_PATH:: expected " << count << " frames, read " << Frames.size() << std::endl;
+        return !Frames.empty();
+    }
+
+    // builds a closed Catmull-Rom flythrough of the room that always looks at the row of spheres and chairs
+    static CameraPath Flythrough(unsigned int frameCount = 1200, float timestep = PATH_TIMESTEP)
+    {
+        const glm::vec3 points[] = {
+            glm::vec3( 0.0f, 3.0f,  5.0f),
+            glm::vec3( 6.5f, 2.0f,  4.0f),
+            glm::vec3( 7.0f, 1.0f, -3.0f),
+            glm::vec3( 2.0f, 4.0f, -6.0f),
+            glm::vec3(-4.0f, 1.5f, -5.0f),
+            glm::vec3(-8.0f, 2.5f,  1.0f),
+            glm::vec3(-5.0f, 6.0f,  7.0f)
+        };
+        const glm::vec3 target(-1.5f, 0.5f, -2.0f);
+        const int count = sizeof(points) / sizeof(points[0]);
+
+        CameraPath path(timestep);
+        path.Frames.reserve(frameCount);
+        for (unsigned int i = 0; i < frameCount; i++)
+        {
+            float t = (float)i / (float)frameCount * count;
+            int segment = (int)t;
+            float u = t - segment;
+            glm::vec3 position = catmullRom(points[(segment + count - 1) % count], points[segment % count],
+                                            points[(segment + 1) % count], points[(segment + 2) % count], u);
+
+            glm::vec3 front = glm::normalize(target - position);
+            CameraFrame frame;
+            frame.Position = position;
+            frame.Yaw = glm::degrees(std::atan2(front.z, front.x));
+            frame.Pitch = glm::degrees(std::asin(front.y));
+            frame.Zoom = ZOOM;
+            frame.Keys = 0;
+            path.Frames.push_back(frame);
+        }
+        return path;
+    }
+
+private:
+    static glm::vec3 catmullRom(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec3 &p3, float u)
+    {
+        float u2 = u * u;
+        float u3 = u2 * u;
+        return 0.5f * ((2.0f * p1) + (p2 - p0) * u + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * u2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * u3);
+    }
+};
+#endif
@@ -7,96 +7,66 @@ in vec3 Normal;
 
 // texture maps needed for PBR
 uniform sampler2D albedoMap;
+#ifdef NORMAL_MAP
 uniform sampler2D normalMap;
+#endif
+#ifdef PACKED_ORM
+// AO, roughness and metallic in red, green and blue, read with one fetch
+uniform sampler2D ormMap;
+#else
 uniform sampler2D metallicMap;
 uniform sampler2D roughnessMap;
 uniform sampler2D aoMap;
+#endif
+
+// how many of the lights the scene has, defined by the variant being compiled
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 4
+#endif
+// the arrays keep one element without lights, as GLSL has no empty arrays
+#if LIGHT_COUNT > 0
+#define LIGHT_ARRAY_SIZE LIGHT_COUNT
+#else
+#define LIGHT_ARRAY_SIZE 1
+#endif
 
 // light positions and colours -- passed in from main
-uniform vec3 lightPositions[4];
-uniform vec3 lightColors[4];
+uniform vec3 lightPositions[LIGHT_ARRAY_SIZE];
+uniform vec3 lightColors[LIGHT_ARRAY_SIZE];
 
 // camera position for calulcations
 uniform vec3 camPos;
 
-// define PI
-const float PI = 3.14159265359;
+#include "brdf.glsl"
 
-// Function to calculate the normals from a normal map using tangents
-vec3 getNormalFromMap() {
-    // get the tangent normals
-    vec3 tangentNormal = texture(normalMap, TexCoords).xyz * 2.0 - 1.0;
-
-    // calculate derivatives for fragment positions and texcoords
-    vec3 Q1  = dFdx(WorldPos);
-    vec3 Q2  = dFdy(WorldPos);
-    vec2 st1 = dFdx(TexCoords);
-    vec2 st2 = dFdy(TexCoords);
-
-    // get normal, tangent and the negative of their cross to produce TBN
-    vec3 N   = normalize(Normal);
-    vec3 T  = normalize(Q1*st2.t - Q2*st1.t);
-    vec3 B  = -normalize(cross(N, T));
-    mat3 TBN = mat3(T, B, N);
-    // multiply TBN by tangent Normal and normalize it to do normal mapping
-    return normalize(TBN * tangentNormal);
-}
-
-// Normal Distribution GGX - Trowbridge-Reitz GGX
-float NormalDistributionGGX(vec3 N, vec3 H, float roughness) {
-    // define a to be the roughness squared and square it again for the numerator of the NDF
-    float a = roughness*roughness;
-    float a2 = a*a;
-    // get the dot of the halfvector and the normal (passed in) and square them (part of denominator)
-    float NH = max(dot(N, H), 0.0);
-    float NH2 = NH*NH;
-    // multiply N dot H squared by alpha squared -1 and add 1 to it 
-    float denom = (NH2 * (a2 - 1.0) + 1.0);
-    // multiply by PI and square the denominator to get final denominator
-    denom = PI * denom * denom; 
-
-    return a2/denom;
-}
-
-// Geometry Schlick GGX
-float GeometrySchlickGGX(float NV, float roughness) {
-    // since direct lighting is being used, k is a+1 squared then divided by 8
-    float r = (roughness + 1.0);
-    float k = (r*r) / 8.0;
-    // the numerator is N dot V and the denominator is N dot V times 1-k + k
-    float numerator= NV;
-    float denominator = NV * (1.0 - k) + k;
+#ifdef NORMAL_MAP
+#include "normalMapping.glsl"
 
-    return numerator / denominator;
-}
-
-// Geometry Smith - use the result of Geometry Schlick GGX to take geometry obstruction and shadowing into account
-float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness) {
-    // get the dot product of N with V and N with L again
-    float NdotV = max(dot(N, V), 0.0);
-    float NdotL = max(dot(N, L), 0.0);
-    // call the SchlickGGX for NdotV and for NdotL and multiply their results 
-    float ggx2 = GeometrySchlickGGX(NdotV, roughness);
-    float ggx1 = GeometrySchlickGGX(NdotL, roughness);
-
-    return ggx1 * ggx2;
-}
-
-// Fresnel Schlick - describes ratio of reflection over refraction
-vec3 fresnelSchlick(float cosTheta, vec3 F0) {
-    // fresnel-schlick approximation formula where F0 is set to constant value of 0.04
-    return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+vec3 getNormalFromMap() {
+    return perturbNormal(unpackNormal(texture(normalMap, TexCoords).xy), Normal, WorldPos, TexCoords);
 }
+#endif
 
 void main() {		
     // define each of the maps being read in 
-    vec3 albedo     = pow(texture(albedoMap, TexCoords).rgb, vec3(2.2));
+    vec3 albedo     = texture(albedoMap, TexCoords).rgb; // sRGB texture, decoded to linear by the sampler
+#ifdef PACKED_ORM
+    vec3 orm        = texture(ormMap, TexCoords).rgb;
+    float ao        = orm.r;
+    float roughness = orm.g;
+    float metallic  = orm.b;
+#else
     float metallic  = texture(metallicMap, TexCoords).r;
     float roughness = texture(roughnessMap, TexCoords).r;
     float ao        = texture(aoMap, TexCoords).r;
+#endif
 
     // calculate the normal from normal map and view vector 
+#ifdef NORMAL_MAP
     vec3 N = getNormalFromMap();
+#else
+    vec3 N = normalize(Normal);
+#endif
     vec3 V = normalize(camPos - WorldPos);
 
     // calculate reflectance -- if dielectric use F0 of 0.04. If metal, use albedo colour
@@ -105,7 +75,7 @@ void main() {
 
     // for each light
     vec3 Lo = vec3(0.0);
-    for(int i = 0; i < 4; ++i) {
+    for(int i = 0; i < LIGHT_COUNT; ++i) {
         // calculate the light and half vectors, the distance and the attenuation
         vec3 L = normalize(lightPositions[i] - WorldPos);
         vec3 H = normalize(V + L);
@@ -0,0 +1,224 @@
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "profiler.h"
+#include "sceneFile.h"
+#include "transformHierarchy.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <sstream>
+#include <limits>
+#include <iostream>
+
+struct Geometry;
+class Model;
+
+// the angles the keys turn, which spinning entities rotate around y by, in degrees
+enum SceneSpin {
+    SPIN_SPHERE,
+    SPIN_BRICK_SPHERE,
+    SPIN_PHONG_SPHERE,
+    SPIN_PHONG_SPHERE2,
+    SPIN_COUNT
+};
+
+// the names scene files give the angles
+const char *const SCENE_SPIN_NAMES[SPIN_COUNT] = {"sphere", "brickSphere", "phongSphere", "phongSphere2"};
+
+// the angle of a name, -1 if there is none
+int FindSpin(const std::string &name)
+{
+    for (int spin = 0; spin < SPIN_COUNT; spin++)
+        if (name == SCENE_SPIN_NAMES[spin])
+            return spin;
+    return -1;
+}
+
+// the six planes of a view-projection matrix, facing inwards
+struct Frustum {
+    glm::vec4 planes[6];
+
+    explicit Frustum(const glm::mat4 &viewProjection)
+    {
+        glm::vec4 rows[4];
+        for (int r = 0; r < 4; r++)
+            rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+        // left, right, bottom, top, near and far
+        for (int axis = 0; axis < 3; axis++)
+        {
+            planes[axis * 2] = rows[3] + rows[axis];
+            planes[axis * 2 + 1] = rows[3] - rows[axis];
+        }
+        for (int p = 0; p < 6; p++)
+            planes[p] = planes[p] * (1.0f / glm::length(glm::vec3(planes[p])));
+    }
+
+    // whether a sphere of center xyz and radius w is at least partly inside
+    bool Intersects(const glm::vec4 &sphere) const
+    {
+        for (int p = 0; p < 6; p++)
+            if (glm::dot(glm::vec3(planes[p]), glm::vec3(sphere)) + planes[p].w < -sphere.w)
+                return false;
+        return true;
+    }
+};
+
+typedef uint32_t Entity;
+
+// The objects of a scene as entities with their components in densely packed arrays, one array per field, so
+// updating, culling and submitting them each walk a few arrays front to back however many entities there are.
+//
+// Every entity is drawn, so the transform, renderable and material components have an element per entity,
+// indexed by it. The transforms are a hierarchy, an entity being placed relative to its parent, and as a parent is
+// created before its children the entities are already in the order the hierarchy needs. Only some entities spin,
+// so the spin component is packed separately with the entity of each of its elements; the per-frame update only
+// visits those, and only the subtrees of the ones whose angle changed get new world transforms and bounds. Lights
+// are entities of their own with only a light component.
+class EntityStore
+{
+public:
+    // transform component: where each entity is relative to its parent and in the world
+    TransformHierarchy transforms;
+
+    // renderable component: the geometry or the model drawn, and the bounding sphere of it as center and radius
+    // in object space and in the world
+    std::vector<const Geometry *> geometries;
+    std::vector<Model *> models;
+    std::vector<glm::vec4> localBounds;
+    std::vector<glm::vec4> worldBounds;
+
+    // material component
+    std::vector<ShadingModel> shadings;
+    std::vector<int> materials;
+
+    // spin component: an entity is turned by its angle after the transform before the spin and before the one
+    // after it, which is only applied when there is one, as of the angle it was last turned to
+    std::vector<Entity> spinEntities;
+    std::vector<int> spinAngles;
+    std::vector<glm::mat4> spinBefore;
+    std::vector<glm::mat4> spinAfter;
+    std::vector<unsigned char> spinHasAfter;
+    std::vector<float> spinLastAngles;
+
+    // light component
+    std::vector<glm::vec3> lightPositions;
+    std::vector<glm::vec3> lightColors;
+
+    size_t Count() const
+    {
+        return transforms.Count();
+    }
+
+    // an entity placed by the transform relative to its parent, an entity created before or -1 for none. Its
+    // world transform and bounds are set by the next UpdateTransforms
+    Entity Create(int parent, const Geometry *geometry, Model *model, const glm::vec4 &bounds, ShadingModel shading, int material, const glm::mat4 &transform)
+    {
+        Entity entity = (Entity)transforms.Add(parent, transform);
+        geometries.push_back(geometry);
+        models.push_back(model);
+        localBounds.push_back(bounds);
+        worldBounds.push_back(bounds);
+        shadings.push_back(shading);
+        materials.push_back(material);
+        return entity;
+    }
+
+    // makes an entity spin; its transform becomes the one before the spin
+    void AddSpin(Entity entity, int angle, bool hasAfter, const glm::mat4 &after)
+    {
+        spinEntities.push_back(entity);
+        spinAngles.push_back(angle);
+        spinBefore.push_back(transforms.localTransforms[entity]);
+        spinAfter.push_back(after);
+        spinHasAfter.push_back(hasAfter);
+        spinLastAngles.push_back(std::numeric_limits<float>::quiet_NaN());
+    }
+
+    void AddLight(const glm::vec3 &position, const glm::vec3 &color)
+    {
+        lightPositions.push_back(position);
+        lightColors.push_back(color);
+    }
+
+    // turns the spinning entities whose angle changed, and updates the world transforms and bounds of what moved.
+    // The rotation of each angle is built once, and applied to every entity the way glm::rotate applies it, so the
+    // result is the same as rotating each one
+    void UpdateTransforms(const float angles[SPIN_COUNT])
+    {
+        PROFILE_SCOPE("entities.transforms");
+        glm::mat4 rotations[SPIN_COUNT];
+        for (int spin = 0; spin < SPIN_COUNT; spin++)
+            rotations[spin] = glm::rotate(glm::mat4(1.0f), glm::radians(angles[spin]), glm::vec3(0.0f, 1.0f, 0.0f));
+        for (size_t i = 0; i < spinEntities.size(); i++)
+        {
+            float angle = angles[spinAngles[i]];
+            if (angle == spinLastAngles[i])
+                continue;
+            spinLastAngles[i] = angle;
+            const glm::mat4 &before = spinBefore[i], &rotation = rotations[spinAngles[i]];
+            glm::mat4 local;
+            for (int column = 0; column < 3; column++)
+                local[column] = before[0] * rotation[column][0] + before[1] * rotation[column][1] + before[2] * rotation[column][2];
+            local[3] = before[3];
+            if (spinHasAfter[i])
+                local = local * spinAfter[i];
+            transforms.SetLocal(spinEntities[i], local);
+        }
+        transforms.Update();
+        const std::vector<int> &moved = transforms.Changed();
+        for (size_t i = 0; i < moved.size(); i++)
+            worldBounds[moved[i]] = transformBounds(transforms.worldTransforms[moved[i]], localBounds[moved[i]]);
+    }
+
+    // the entities whose bounds intersect the frustum, in entity order
+    void Cull(const Frustum &frustum, std::vector<Entity> &visible)
+    {
+        PROFILE_SCOPE("entities.cull");
+        visible.clear();
+        for (size_t i = 0; i < worldBounds.size(); i++)
+            if (frustum.Intersects(worldBounds[i]))
+                visible.push_back((Entity)i);
+        lastVisible = visible.size();
+    }
+
+    // every entity, in entity order
+    void All(std::vector<Entity> &entities) const
+    {
+        entities.resize(Count());
+        for (size_t i = 0; i < entities.size(); i++)
+            entities[i] = (Entity)i;
+    }
+
+    // the entities, spinning entities and lights, and how many entities the last culling kept
+    std::string StatsJson() const
+    {
+        std::ostringstream json;
+        json << "{\"entities\": " << Count() << ", \"spinning\": " << spinEntities.size() << ", \"lights\": " << lightPositions.size()
+             << ", \"visible\": " << lastVisible << "}";
+        return json.str();
+    }
+
+    void PrintStats() const
+    {
+        std::cout << "Entities: " << Count() << ", " << spinEntities.size() << " spinning, " << lightPositions.size() << " lights, "
+                  << lastVisible << " visible" << std::endl;
+    }
+
+private:
+    size_t lastVisible = 0;
+
+    // a bounding sphere moved into the world, its radius grown by the largest scale of the transform
+    static glm::vec4 transformBounds(const glm::mat4 &transform, const glm::vec4 &bounds)
+    {
+        glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(bounds), 1.0f));
+        float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+        return glm::vec4(center, bounds.w * scale);
+    }
+};
+#endif
@@ -0,0 +1,267 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include "profiler.h"
+#include "stb_image_write.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+// Records frames from the bound read framebuffer. glReadPixels writes into one of a ring of pixel buffer objects and
+// returns immediately; the PBO is mapped only when its slot comes round again, by which time the GPU has finished
+// the copy. Mapped frames are copied into a fixed pool of frame buffers and encoded by worker threads. When all
+// buffers of the pool are waiting to be encoded, Capture blocks until a worker frees one, so slow encoding slows
+// the frame rate down instead of losing frames.
+//
+// An output ending in ".raw" is written as one file of headerless RGB24 frames, top row first, e.g. for
+// ffmpeg -f rawvideo -pix_fmt rgb24 -s <width>x<height>. Any other output is a prefix for numbered PNG files.
+class FrameCapture
+{
+public:
+    static const unsigned int PBO_COUNT = 3;
+
+    // frames handed to the encoders, and the ones that had to wait for a free buffer
+    unsigned int frames = 0;
+    unsigned int stalls = 0;
+    double stallMs = 0.0;
+    double encodeMs = 0.0;
+    unsigned int threadCount = 0;
+
+    bool Active() const
+    {
+        return active;
+    }
+
+    // the pool holds queueDepth frames, by default two per encoder thread
+    bool Start(const std::string &output, int width, int height, unsigned int threads = 0, unsigned int queueDepth = 0)
+    {
+        this->output = output;
+        this->width = width;
+        this->height = height;
+        frameSize = (size_t)width * height * 3;
+        raw = output.size() > 4 && output.compare(output.size() - 4, 4, ".raw") == 0;
+        if (raw)
+        {
+            rawFile = fopen(output.c_str(), "wb");
+            if (!rawFile)
+            {
+                std::cout << "ERROR::CAPTURE::FILE_NOT_WRITABLE: " << output << std::endl;
+                return false;
+            }
+        }
+
+        glGenBuffers(PBO_COUNT, pbos);
+        for (unsigned int i = 0; i < PBO_COUNT; i++)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, frameSize, NULL, GL_STREAM_READ);
+            fences[i] = 0;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        nextSlot = 0;
+        readFrames = 0;
+
+        threadCount = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+        if (queueDepth == 0)
+            queueDepth = threadCount * 2;
+        pool.resize(queueDepth);
+        for (unsigned int i = 0; i < queueDepth; i++)
+        {
+            pool[i].pixels.resize(frameSize);
+            freeFrames.push_back(&pool[i]);
+        }
+        stopping = false;
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.push_back(std::thread(&FrameCapture::encodeWorker, this));
+        frames = stalls = 0;
+        stallMs = encodeMs = 0.0;
+        active = true;
+        return true;
+    }
+
+    // queues a read of the bound read framebuffer and hands the frame read PBO_COUNT frames ago to the encoders
+    void Capture()
+    {
+        if (!active)
+            return;
+        PROFILE_SCOPE("capture");
+        if (fences[nextSlot])
+            collect(nextSlot);
+
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[nextSlot]);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        fences[nextSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slotFrames[nextSlot] = readFrames++;
+        nextSlot = (nextSlot + 1) % PBO_COUNT;
+    }
+
+    // collects the reads still in flight, waits for every frame to be encoded and releases the GL objects
+    void Finish()
+    {
+        if (!active)
+            return;
+        for (unsigned int i = 0; i < PBO_COUNT; i++)
+        {
+            unsigned int slot = (nextSlot + i) % PBO_COUNT;
+            if (fences[slot])
+                collect(slot);
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        queued.notify_all();
+        for (unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+        glDeleteBuffers(PBO_COUNT, pbos);
+        if (rawFile)
+            fclose(rawFile);
+        rawFile = NULL;
+        freeFrames.clear();
+        pool.clear();
+        active = false;
+
+        std::cout << "Captured " << frames << " frames to " << output << " on " << threadCount << " encoder threads, "
+                  << encodeMs / std::max(1u, frames) << " ms per frame to encode, " << stalls << " frames waited "
+                  << stallMs << " ms for the encoders" << std::endl;
+    }
+
+private:
+    struct Frame {
+        unsigned int index;
+        std::vector<unsigned char> pixels;
+    };
+
+    bool active = false;
+    std::string output;
+    bool raw = false;
+    FILE *rawFile = NULL;
+    int width = 0;
+    int height = 0;
+    size_t frameSize = 0;
+
+    unsigned int pbos[PBO_COUNT];
+    GLsync fences[PBO_COUNT];
+    unsigned int slotFrames[PBO_COUNT];
+    unsigned int nextSlot = 0;
+    unsigned int readFrames = 0;
+
+    // frames are either free or queued for encoding, or owned by whoever took them off those lists
+    std::vector<Frame> pool;
+    std::vector<Frame *> freeFrames;
+    std::deque<Frame *> queue;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable queued;
+    std::condition_variable freed;
+    bool stopping = false;
+    std::mutex rawMutex;
+
+    void collect(unsigned int slot)
+    {
+        // the read was issued PBO_COUNT frames ago, so this normally returns at once
+        while (glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            ;
+        glDeleteSync(fences[slot]);
+        fences[slot] = 0;
+
+        Frame *frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (freeFrames.empty())
+            {
+                std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+                freed.wait(lock, [this] { return !freeFrames.empty(); });
+                stallMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+                stalls++;
+            }
+            frame = freeFrames.back();
+            freeFrames.pop_back();
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+        void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameSize, GL_MAP_READ_BIT);
+        if (data)
+        {
+            memcpy(&frame->pixels[0], data, frameSize);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        else
+            std::cout << "ERROR::CAPTURE::MAP_FAILED for frame " << slotFrames[slot] << std::endl;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        frame->index = slotFrames[slot];
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queue.push_back(frame);
+        }
+        queued.notify_one();
+        frames++;
+    }
+
+    void encodeWorker()
+    {
+        while (true)
+        {
+            Frame *frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                queued.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                frame = queue.front();
+                queue.pop_front();
+            }
+
+            std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+            {
+                PROFILE_SCOPE("capture.encode");
+                encode(*frame);
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                encodeMs += ms;
+                freeFrames.push_back(frame);
+            }
+            freed.notify_one();
+        }
+    }
+
+    // GL reads rows bottom first, so both formats are written back to front
+    void encode(const Frame &frame)
+    {
+        size_t stride = (size_t)width * 3;
+        const unsigned char *top = &frame.pixels[(size_t)(height - 1) * stride];
+        if (raw)
+        {
+            // frames can finish out of order, so each one is written at its own offset
+            std::lock_guard<std::mutex> lock(rawMutex);
+            fseek(rawFile, (long)(frame.index * frameSize), SEEK_SET);
+            for (int y = 0; y < height; y++)
+                fwrite(top - y * stride, 1, stride, rawFile);
+            return;
+        }
+        char number[16];
+        snprintf(number, sizeof(number), "%05u", frame.index);
+        std::string path = output + number + ".png";
+        if (!stbi_write_png(path.c_str(), width, height, 3, top, -(int)stride))
+            std::cout << "ERROR::CAPTURE::FILE_NOT_WRITABLE: " << path << std::endl;
+    }
+};
+#endif
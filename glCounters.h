@@ -0,0 +1,439 @@
+#ifndef GL_COUNTERS_H
+#define GL_COUNTERS_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <climits>
+#include <sstream>
+#include <iostream>
+
+// GL entry points that are counted
+enum GlCall {
+    GL_CALL_BIND_TEXTURE,
+    GL_CALL_ACTIVE_TEXTURE,
+    GL_CALL_USE_PROGRAM,
+    GL_CALL_UNIFORM,
+    GL_CALL_GET_UNIFORM_LOCATION,
+    GL_CALL_BIND_VERTEX_ARRAY,
+    GL_CALL_BIND_BUFFER,
+    GL_CALL_DRAW,
+    GL_CALL_COUNT
+};
+
+static const char *GL_CALL_NAMES[GL_CALL_COUNT] = {
+    "glBindTexture",
+    "glActiveTexture",
+    "glUseProgram",
+    "glUniform*",
+    "glGetUniformLocation",
+    "glBindVertexArray",
+    "glBindBuffer",
+    "glDraw*"
+};
+
+// Optional instrumented GL layer. Install() swaps the glad function pointers of the state changing and draw calls
+// for hooks that count every call and shadow the bound state, so a call that sets state to what it already was is
+// flagged as redundant before being forwarded to the driver. The deletes are hooked too, without being counted, so
+// the shadow of an object is dropped before GL hands its name out again. Uninstall() restores the original pointers.
+class GlCallCounter
+{
+public:
+    static GlCallCounter &Get()
+    {
+        static GlCallCounter counter;
+        return counter;
+    }
+
+    bool installed = false;
+
+    void Install()
+    {
+        if (installed)
+            return;
+        original.bindTexture = glad_glBindTexture;            glad_glBindTexture = hookBindTexture;
+        original.activeTexture = glad_glActiveTexture;        glad_glActiveTexture = hookActiveTexture;
+        original.useProgram = glad_glUseProgram;              glad_glUseProgram = hookUseProgram;
+        original.uniform1i = glad_glUniform1i;                glad_glUniform1i = hookUniform1i;
+        original.uniform1f = glad_glUniform1f;                glad_glUniform1f = hookUniform1f;
+        original.uniform2f = glad_glUniform2f;                glad_glUniform2f = hookUniform2f;
+        original.uniform3f = glad_glUniform3f;                glad_glUniform3f = hookUniform3f;
+        original.uniform4f = glad_glUniform4f;                glad_glUniform4f = hookUniform4f;
+        original.uniform2fv = glad_glUniform2fv;              glad_glUniform2fv = hookUniform2fv;
+        original.uniform3fv = glad_glUniform3fv;              glad_glUniform3fv = hookUniform3fv;
+        original.uniform4fv = glad_glUniform4fv;              glad_glUniform4fv = hookUniform4fv;
+        original.uniformMatrix2fv = glad_glUniformMatrix2fv;  glad_glUniformMatrix2fv = hookUniformMatrix2fv;
+        original.uniformMatrix3fv = glad_glUniformMatrix3fv;  glad_glUniformMatrix3fv = hookUniformMatrix3fv;
+        original.uniformMatrix4fv = glad_glUniformMatrix4fv;  glad_glUniformMatrix4fv = hookUniformMatrix4fv;
+        original.getUniformLocation = glad_glGetUniformLocation; glad_glGetUniformLocation = hookGetUniformLocation;
+        original.bindVertexArray = glad_glBindVertexArray;    glad_glBindVertexArray = hookBindVertexArray;
+        original.bindBuffer = glad_glBindBuffer;              glad_glBindBuffer = hookBindBuffer;
+        original.drawArrays = glad_glDrawArrays;              glad_glDrawArrays = hookDrawArrays;
+        original.drawElements = glad_glDrawElements;          glad_glDrawElements = hookDrawElements;
+        original.deleteTextures = glad_glDeleteTextures;      glad_glDeleteTextures = hookDeleteTextures;
+        original.deleteProgram = glad_glDeleteProgram;        glad_glDeleteProgram = hookDeleteProgram;
+        original.deleteBuffers = glad_glDeleteBuffers;        glad_glDeleteBuffers = hookDeleteBuffers;
+        original.deleteVertexArrays = glad_glDeleteVertexArrays; glad_glDeleteVertexArrays = hookDeleteVertexArrays;
+
+        // start from what the context actually has bound
+        GLint value = 0;
+        original.getIntegerv = glad_glGetIntegerv;
+        original.getIntegerv(GL_ACTIVE_TEXTURE, &value);
+        activeUnit = value - GL_TEXTURE0;
+        original.getIntegerv(GL_CURRENT_PROGRAM, &value);
+        program = value;
+        original.getIntegerv(GL_VERTEX_ARRAY_BINDING, &value);
+        vertexArray = value;
+        boundTextures.clear();
+        boundBuffers.clear();
+        uniformValues.clear();
+        installed = true;
+    }
+
+    void Uninstall()
+    {
+        if (!installed)
+            return;
+        glad_glBindTexture = original.bindTexture;
+        glad_glActiveTexture = original.activeTexture;
+        glad_glUseProgram = original.useProgram;
+        glad_glUniform1i = original.uniform1i;
+        glad_glUniform1f = original.uniform1f;
+        glad_glUniform2f = original.uniform2f;
+        glad_glUniform3f = original.uniform3f;
+        glad_glUniform4f = original.uniform4f;
+        glad_glUniform2fv = original.uniform2fv;
+        glad_glUniform3fv = original.uniform3fv;
+        glad_glUniform4fv = original.uniform4fv;
+        glad_glUniformMatrix2fv = original.uniformMatrix2fv;
+        glad_glUniformMatrix3fv = original.uniformMatrix3fv;
+        glad_glUniformMatrix4fv = original.uniformMatrix4fv;
+        glad_glGetUniformLocation = original.getUniformLocation;
+        glad_glBindVertexArray = original.bindVertexArray;
+        glad_glBindBuffer = original.bindBuffer;
+        glad_glDrawArrays = original.drawArrays;
+        glad_glDrawElements = original.drawElements;
+        glad_glDeleteTextures = original.deleteTextures;
+        glad_glDeleteProgram = original.deleteProgram;
+        glad_glDeleteBuffers = original.deleteBuffers;
+        glad_glDeleteVertexArrays = original.deleteVertexArrays;
+        installed = false;
+    }
+
+    void BeginFrame()
+    {
+        memset(frameCalls, 0, sizeof(frameCalls));
+        memset(frameRedundant, 0, sizeof(frameRedundant));
+    }
+
+    void EndFrame()
+    {
+        for (unsigned int i = 0; i < GL_CALL_COUNT; i++)
+        {
+            totalCalls[i] += frameCalls[i];
+            totalRedundant[i] += frameRedundant[i];
+        }
+        frames++;
+    }
+
+    // drops everything counted so far, e.g. after warm-up frames
+    void Reset()
+    {
+        memset(totalCalls, 0, sizeof(totalCalls));
+        memset(totalRedundant, 0, sizeof(totalRedundant));
+        frames = 0;
+    }
+
+    unsigned int FrameCalls(GlCall call) const
+    {
+        return frameCalls[call];
+    }
+
+    void PrintStats() const
+    {
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(1);
+        out << "---- GL calls per frame (redundant) ----\n";
+        for (unsigned int i = 0; i < GL_CALL_COUNT; i++)
+            out << "  " << GL_CALL_NAMES[i] << ": " << average(totalCalls[i]) << " (" << average(totalRedundant[i]) << ")\n";
+        std::cout << out.str();
+    }
+
+    // per-frame averages of every counted call and its redundant share, for the benchmark report
+    std::string StatsJson() const
+    {
+        std::ostringstream json;
+        json.precision(6);
+        json << "{";
+        double calls = 0.0, redundant = 0.0;
+        for (unsigned int i = 0; i < GL_CALL_COUNT; i++)
+        {
+            json << "\n    \"" << GL_CALL_NAMES[i] << "\": { \"calls\": " << average(totalCalls[i]) << ", \"redundant\": " << average(totalRedundant[i]) << " },";
+            calls += average(totalCalls[i]);
+            redundant += average(totalRedundant[i]);
+        }
+        json << "\n    \"total\": { \"calls\": " << calls << ", \"redundant\": " << redundant << " }\n  }";
+        return json.str();
+    }
+
+private:
+    struct {
+        PFNGLBINDTEXTUREPROC bindTexture;
+        PFNGLACTIVETEXTUREPROC activeTexture;
+        PFNGLUSEPROGRAMPROC useProgram;
+        PFNGLUNIFORM1IPROC uniform1i;
+        PFNGLUNIFORM1FPROC uniform1f;
+        PFNGLUNIFORM2FPROC uniform2f;
+        PFNGLUNIFORM3FPROC uniform3f;
+        PFNGLUNIFORM4FPROC uniform4f;
+        PFNGLUNIFORM2FVPROC uniform2fv;
+        PFNGLUNIFORM3FVPROC uniform3fv;
+        PFNGLUNIFORM4FVPROC uniform4fv;
+        PFNGLUNIFORMMATRIX2FVPROC uniformMatrix2fv;
+        PFNGLUNIFORMMATRIX3FVPROC uniformMatrix3fv;
+        PFNGLUNIFORMMATRIX4FVPROC uniformMatrix4fv;
+        PFNGLGETUNIFORMLOCATIONPROC getUniformLocation;
+        PFNGLBINDVERTEXARRAYPROC bindVertexArray;
+        PFNGLBINDBUFFERPROC bindBuffer;
+        PFNGLDRAWARRAYSPROC drawArrays;
+        PFNGLDRAWELEMENTSPROC drawElements;
+        PFNGLDELETETEXTURESPROC deleteTextures;
+        PFNGLDELETEPROGRAMPROC deleteProgram;
+        PFNGLDELETEBUFFERSPROC deleteBuffers;
+        PFNGLDELETEVERTEXARRAYSPROC deleteVertexArrays;
+        PFNGLGETINTEGERVPROC getIntegerv;
+    } original;
+
+    unsigned int frameCalls[GL_CALL_COUNT] = {};
+    unsigned int frameRedundant[GL_CALL_COUNT] = {};
+    unsigned long long totalCalls[GL_CALL_COUNT] = {};
+    unsigned long long totalRedundant[GL_CALL_COUNT] = {};
+    unsigned int frames = 0;
+
+    // shadowed state
+    int activeUnit = 0;
+    GLuint program = 0;
+    GLuint vertexArray = 0;
+    std::map<std::pair<int, GLenum>, GLuint> boundTextures;
+    std::map<GLenum, GLuint> boundBuffers;
+    std::map<std::pair<GLuint, GLint>, std::vector<unsigned char> > uniformValues;
+
+    double average(unsigned long long total) const
+    {
+        return frames ? (double)total / frames : 0.0;
+    }
+
+    void count(GlCall call, bool redundant)
+    {
+        frameCalls[call]++;
+        if (redundant)
+            frameRedundant[call]++;
+    }
+
+    // remembers the value last set at a location of the current program and reports whether it is unchanged
+    bool sameUniform(GLint location, const void *data, size_t size)
+    {
+        if (location < 0)
+            return false;
+        // an array upload with a count of 0 sets nothing, and keeps the value shadowed before it
+        if (size == 0)
+            return true;
+        std::vector<unsigned char> &value = uniformValues[std::make_pair(program, location)];
+        bool same = value.size() == size && memcmp(value.data(), data, size) == 0;
+        value.assign((const unsigned char *)data, (const unsigned char *)data + size);
+        return same;
+    }
+
+    static void APIENTRY hookBindTexture(GLenum target, GLuint texture)
+    {
+        GlCallCounter &c = Get();
+        GLuint &bound = c.boundTextures[std::make_pair(c.activeUnit, target)];
+        c.count(GL_CALL_BIND_TEXTURE, bound == texture);
+        bound = texture;
+        c.original.bindTexture(target, texture);
+    }
+
+    static void APIENTRY hookActiveTexture(GLenum texture)
+    {
+        GlCallCounter &c = Get();
+        c.count(GL_CALL_ACTIVE_TEXTURE, c.activeUnit == (int)(texture - GL_TEXTURE0));
+        c.activeUnit = texture - GL_TEXTURE0;
+        c.original.activeTexture(texture);
+    }
+
+    static void APIENTRY hookUseProgram(GLuint id)
+    {
+        GlCallCounter &c = Get();
+        c.count(GL_CALL_USE_PROGRAM, c.program == id);
+        c.program = id;
+        c.original.useProgram(id);
+    }
+
+    static void APIENTRY hookUniform1i(GLint location, GLint v0)
+    {
+        GlCallCounter &c = Get();
+        c.count(GL_CALL_UNIFORM, c.sameUniform(location, &v0, sizeof(v0)));
+        c.original.uniform1i(location, v0);
+    }
+
+    static void APIENTRY hookUniform1f(GLint location, GLfloat v0)
+    {
+        GlCallCounter &c = Get();
+        c.count(GL_CALL_UNIFORM, c.sameUniform(location, &v0, sizeof(v0)));
+        c.original.uniform1f(location, v0);
+    }
+
+    static void APIENTRY hookUniform2f(GLint location, GLfloat v0, GLfloat v1)
+    {
+        GlCallCounter &c = Get();
+        GLfloat v[2] = { v0, v1 };
+        c.count(GL_CALL_UNIFORM, c.sameUniform(location, v, sizeof(v)));
+        c.original.uniform2f(location, v0, v1);
+    }
+
+    static void APIENTRY hookUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+    {
+        GlCallCounter &c = Get();
+        GLfloat v[3] = { v0, v1, v2 };
+        c.count(GL_CALL_UNIFORM, c.sameUniform(location, v, sizeof(v)));
+        c.original.uniform3f(location, v0, v1, v2);
+    }
+
+    static void APIENTRY hookUniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
+    {
+        GlCallCounter &c = Get();
+        GLfloat v[4] = { v0, v1, v2, v3 };
+        c.count(GL_CALL_UNIFORM, c.sameUniform(location, v, sizeof(v)));
+        c.original.uniform4f(location, v0, v1, v2, v3);
+    }
+
+    static void APIENTRY hookUniform2fv(GLint location, GLsizei count, const GLfloat *value)
+    {
+        GlCallCounter &c = Get();
+        c.count(GL_CALL_UNIFORM, c.sameUniform(location, value, count * 2 * sizeof(GLfloat)));
+        c.original.uniform2fv(location, count, value);
+    }
+
+    static void APIENTRY hookUniform3fv(GLint location, GLsizei count, const GLfloat *value)
+    {
+        GlCallCounter &c = Get();
+        c.count(GL_CALL_UNIFORM, c.sameUniform(location, value, count * 3 * sizeof(GLfloat)));
+        c.original.uniform3fv(location, count, value);
+    }
+
+    static void APIENTRY hookUniform4fv(GLint location, GLsizei count, const GLfloat *value)
+    {
+        GlCallCounter &c = Get();
+        c.count(GL_CALL_UNIFORM, c.sameUniform(location, value, count * 4 * sizeof(GLfloat)));
+        c.original.uniform4fv(location, count, value);
+    }
+
+    static void APIENTRY hookUniformMatrix2fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+    {
+        GlCallCounter &c = Get();
+        c.count(GL_CALL_UNIFORM, c.sameUniform(location, value, count * 4 * sizeof(GLfloat)));
+        c.original.uniformMatrix2fv(location, count, transpose, value);
+    }
+
+    static void APIENTRY hookUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+    {
+        GlCallCounter &c = Get();
+        c.count(GL_CALL_UNIFORM, c.sameUniform(location, value, count * 9 * sizeof(GLfloat)));
+        c.original.uniformMatrix3fv(location, count, transpose, value);
+    }
+
+    static void APIENTRY hookUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+    {
+        GlCallCounter &c = Get();
+        c.count(GL_CALL_UNIFORM, c.sameUniform(location, value, count * 16 * sizeof(GLfloat)));
+        c.original.uniformMatrix4fv(location, count, transpose, value);
+    }
+
+    static GLint APIENTRY hookGetUniformLocation(GLuint id, const GLchar *name)
+    {
+        GlCallCounter &c = Get();
+        c.count(GL_CALL_GET_UNIFORM_LOCATION, false);
+        return c.original.getUniformLocation(id, name);
+    }
+
+    static void APIENTRY hookBindVertexArray(GLuint array)
+    {
+        GlCallCounter &c = Get();
+        c.count(GL_CALL_BIND_VERTEX_ARRAY, c.vertexArray == array);
+        c.vertexArray = array;
+        // the element array binding is part of the vertex array state
+        c.boundBuffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+        c.original.bindVertexArray(array);
+    }
+
+    static void APIENTRY hookBindBuffer(GLenum target, GLuint buffer)
+    {
+        GlCallCounter &c = Get();
+        std::map<GLenum, GLuint>::iterator bound = c.boundBuffers.find(target);
+        c.count(GL_CALL_BIND_BUFFER, bound != c.boundBuffers.end() && bound->second == buffer);
+        c.boundBuffers[target] = buffer;
+        c.original.bindBuffer(target, buffer);
+    }
+
+    static void APIENTRY hookDrawArrays(GLenum mode, GLint first, GLsizei count)
+    {
+        GlCallCounter &c = Get();
+        c.count(GL_CALL_DRAW, false);
+        c.original.drawArrays(mode, first, count);
+    }
+
+    static void APIENTRY hookDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices)
+    {
+        GlCallCounter &c = Get();
+        c.count(GL_CALL_DRAW, false);
+        c.original.drawElements(mode, count, type, indices);
+    }
+
+    // a deleted texture, buffer or vertex array is unbound wherever it was bound, as GL does
+    static void APIENTRY hookDeleteTextures(GLsizei n, const GLuint *textures)
+    {
+        GlCallCounter &c = Get();
+        for (GLsizei i = 0; i < n; i++)
+            for (std::map<std::pair<int, GLenum>, GLuint>::iterator bound = c.boundTextures.begin(); bound != c.boundTextures.end(); ++bound)
+                if (textures[i] && bound->second == textures[i])
+                    bound->second = 0;
+        c.original.deleteTextures(n, textures);
+    }
+
+    // the uniforms set on a deleted program are forgotten; a program in use stays current until another is used
+    static void APIENTRY hookDeleteProgram(GLuint id)
+    {
+        GlCallCounter &c = Get();
+        std::map<std::pair<GLuint, GLint>, std::vector<unsigned char> >::iterator value = c.uniformValues.lower_bound(std::make_pair(id, (GLint)INT_MIN));
+        while (value != c.uniformValues.end() && value->first.first == id)
+            value = c.uniformValues.erase(value);
+        c.original.deleteProgram(id);
+    }
+
+    static void APIENTRY hookDeleteBuffers(GLsizei n, const GLuint *buffers)
+    {
+        GlCallCounter &c = Get();
+        for (GLsizei i = 0; i < n; i++)
+            for (std::map<GLenum, GLuint>::iterator bound = c.boundBuffers.begin(); bound != c.boundBuffers.end(); ++bound)
+                if (buffers[i] && bound->second == buffers[i])
+                    bound->second = 0;
+        c.original.deleteBuffers(n, buffers);
+    }
+
+    static void APIENTRY hookDeleteVertexArrays(GLsizei n, const GLuint *arrays)
+    {
+        GlCallCounter &c = Get();
+        for (GLsizei i = 0; i < n; i++)
+            if (arrays[i] && c.vertexArray == arrays[i])
+            {
+                c.vertexArray = 0;
+                c.boundBuffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+            }
+        c.original.deleteVertexArrays(n, arrays);
+    }
+};
+#endif
@@ -0,0 +1,375 @@
+#ifndef GPU_RESOURCES_H
+#define GPU_RESOURCES_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <utility>
+
+enum GpuResourceType {
+    GPU_BUFFER,
+    GPU_VERTEX_ARRAY,
+    GPU_TEXTURE,
+    GPU_PROGRAM,
+    GPU_FRAMEBUFFER,
+    GPU_RENDERBUFFER,
+    GPU_RESOURCE_TYPE_COUNT
+};
+
+const char *const GPU_RESOURCE_TYPE_NAMES[GPU_RESOURCE_TYPE_COUNT] = {
+    "buffers", "vertex_arrays", "textures", "programs", "framebuffers", "renderbuffers"
+};
+
+// a slot of the resource table and the generation it was issued in; a handle whose resource has been released
+// no longer matches its slot's generation, so it resolves to no object instead of to the slot's next resource
+struct GpuHandle {
+    uint32_t index = 0;
+    uint32_t generation = 0;
+};
+
+// Owns every GL object the renderer creates. Code that creates an object adds it with its size and a label, and
+// whatever keeps using it holds a GpuRef, which counts references: the object is deleted when the last reference
+// goes. The delete is deferred by FRAMES_IN_FLIGHT frames, so ids copied into draw lists and materials stay valid
+// until the frames recorded with them are done, and nothing is deleted in the middle of a frame.
+//
+// Objects added and never referenced, or still referenced when the program exits, are reported as leaks. Only the
+// thread owning the GL context uses the table.
+class GpuResources
+{
+public:
+    static const unsigned int FRAMES_IN_FLIGHT = 3;
+
+    static GpuResources &Get()
+    {
+        static GpuResources resources;
+        return resources;
+    }
+
+    ~GpuResources()
+    {
+        // the context is gone by now, so this only reports
+        ReportLeaks();
+    }
+
+    // the storage of an uncompressed 8-bit image, a full mip chain adding a third
+    static size_t ImageBytes(int width, int height, int components, bool mipmaps = true)
+    {
+        size_t bytes = (size_t)width * height * components;
+        return mipmaps ? bytes * 4 / 3 : bytes;
+    }
+
+    // starts tracking an object without any reference to it yet
+    void Add(GpuResourceType type, GLuint name, size_t bytes, const std::string &label)
+    {
+        if (!name)
+            return;
+        uint32_t index;
+        if (!freeSlots.empty())
+        {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            index = (uint32_t)slots.size();
+            slots.push_back(Slot());
+        }
+        Slot &slot = slots[index];
+        slot.type = type;
+        slot.name = name;
+        slot.refs = 0;
+        slot.bytes = bytes;
+        slot.label = label;
+        slot.live = true;
+        byName[key(type, name)] = index;
+    }
+
+    // a new reference to a tracked object, or a null handle if the object isn't tracked
+    GpuHandle Acquire(GpuResourceType type, GLuint name)
+    {
+        GpuHandle handle;
+        std::map<uint64_t, uint32_t>::iterator found = byName.find(key(type, name));
+        if (found == byName.end())
+            return handle;
+        handle.index = found->second;
+        handle.generation = slots[found->second].generation;
+        slots[found->second].refs++;
+        return handle;
+    }
+
+    void AddRef(GpuHandle handle)
+    {
+        if (Slot *slot = resolve(handle))
+            slot->refs++;
+    }
+
+    // drops a reference, queueing the object for deletion when it was the last one
+    void Release(GpuHandle handle)
+    {
+        Slot *slot = resolve(handle);
+        if (!slot || --slot->refs > 0)
+            return;
+        PendingDelete pending = { slot->type, slot->name, frame };
+        pendingDeletes.push_back(pending);
+        byName.erase(key(slot->type, slot->name));
+        slot->live = false;
+        slot->generation++;
+        slot->label.clear();
+        freeSlots.push_back(handle.index);
+    }
+
+    // the GL name behind a handle, 0 once its object has been released
+    GLuint Name(GpuResourceType type, GpuHandle handle) const
+    {
+        const Slot *slot = resolve(handle);
+        return slot && slot->type == type ? slot->name : 0;
+    }
+
+    // for objects whose storage changes, like streamed textures
+    void SetBytes(GpuHandle handle, size_t bytes)
+    {
+        if (Slot *slot = resolve(handle))
+            slot->bytes = bytes;
+    }
+
+    // deletes the objects released FRAMES_IN_FLIGHT frames ago, called once per frame
+    void EndFrame()
+    {
+        frame++;
+        size_t kept = 0;
+        for (size_t i = 0; i < pendingDeletes.size(); i++)
+        {
+            if (pendingDeletes[i].frame + FRAMES_IN_FLIGHT <= frame)
+                deleteObject(pendingDeletes[i]);
+            else
+                pendingDeletes[kept++] = pendingDeletes[i];
+        }
+        pendingDeletes.resize(kept);
+    }
+
+    // deletes every released object now, once the GPU is idle
+    void Flush()
+    {
+        for (size_t i = 0; i < pendingDeletes.size(); i++)
+            deleteObject(pendingDeletes[i]);
+        pendingDeletes.clear();
+    }
+
+    // live objects and their bytes per type, and the deletes still waiting for their frames
+    std::string StatsJson() const
+    {
+        size_t counts[GPU_RESOURCE_TYPE_COUNT], bytes[GPU_RESOURCE_TYPE_COUNT];
+        totals(counts, bytes);
+        std::ostringstream json;
+        json << "{";
+        for (int t = 0; t < GPU_RESOURCE_TYPE_COUNT; t++)
+            json << "\"" << GPU_RESOURCE_TYPE_NAMES[t] << "\": {\"count\": " << counts[t] << ", \"bytes\": " << bytes[t] << "}, ";
+        json << "\"pending_deletes\": " << pendingDeletes.size() << ", \"deleted\": " << deleted << "}";
+        return json.str();
+    }
+
+    void PrintStats() const
+    {
+        size_t counts[GPU_RESOURCE_TYPE_COUNT], bytes[GPU_RESOURCE_TYPE_COUNT];
+        totals(counts, bytes);
+        std::cout << "GPU resources:";
+        for (int t = 0; t < GPU_RESOURCE_TYPE_COUNT; t++)
+            if (counts[t])
+                std::cout << " " << counts[t] << " " << GPU_RESOURCE_TYPE_NAMES[t] << " " << bytes[t] / (1024.0 * 1024.0) << " MB,";
+        std::cout << " " << pendingDeletes.size() << " waiting to be deleted" << std::endl;
+    }
+
+    // prints the objects still alive, returning how many there are
+    size_t ReportLeaks() const
+    {
+        size_t leaks = 0;
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            const Slot &slot = slots[i];
+            if (!slot.live)
+                continue;
+            if (leaks++ < MAX_REPORTED_LEAKS)
+                std::cout << "ERROR::GPU_RESOURCES::LEAKED: " << GPU_RESOURCE_TYPE_NAMES[slot.type] << " " << slot.name << " ("
+                          << (slot.label.empty() ? "unlabelled" : slot.label) << ", " << slot.bytes << " bytes, " << slot.refs << " references)" << std::endl;
+        }
+        if (leaks > MAX_REPORTED_LEAKS)
+            std::cout << "ERROR::GPU_RESOURCES::LEAKED: " << leaks - MAX_REPORTED_LEAKS << " more" << std::endl;
+        return leaks;
+    }
+
+private:
+    static const size_t MAX_REPORTED_LEAKS = 20;
+
+    struct Slot {
+        GpuResourceType type = GPU_BUFFER;
+        GLuint name = 0;
+        uint32_t generation = 1;
+        uint32_t refs = 0;
+        size_t bytes = 0;
+        std::string label;
+        bool live = false;
+    };
+
+    struct PendingDelete {
+        GpuResourceType type;
+        GLuint name;
+        uint64_t frame;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    std::map<uint64_t, uint32_t> byName;
+    std::vector<PendingDelete> pendingDeletes;
+    uint64_t frame = 0;
+    uint64_t deleted = 0;
+
+    GpuResources()
+    {
+    }
+
+    static uint64_t key(GpuResourceType type, GLuint name)
+    {
+        return ((uint64_t)type << 32) | name;
+    }
+
+    Slot *resolve(GpuHandle handle)
+    {
+        if (handle.generation == 0 || handle.index >= slots.size() || slots[handle.index].generation != handle.generation)
+            return NULL;
+        return &slots[handle.index];
+    }
+
+    const Slot *resolve(GpuHandle handle) const
+    {
+        return const_cast<GpuResources *>(this)->resolve(handle);
+    }
+
+    void totals(size_t *counts, size_t *bytes) const
+    {
+        for (int t = 0; t < GPU_RESOURCE_TYPE_COUNT; t++)
+            counts[t] = bytes[t] = 0;
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            if (!slots[i].live)
+                continue;
+            counts[slots[i].type]++;
+            bytes[slots[i].type] += slots[i].bytes;
+        }
+    }
+
+    void deleteObject(const PendingDelete &pending)
+    {
+        switch (pending.type)
+        {
+        case GPU_BUFFER:
+            glDeleteBuffers(1, &pending.name);
+            break;
+        case GPU_VERTEX_ARRAY:
+            glDeleteVertexArrays(1, &pending.name);
+            break;
+        case GPU_TEXTURE:
+            glDeleteTextures(1, &pending.name);
+            break;
+        case GPU_PROGRAM:
+            glDeleteProgram(pending.name);
+            break;
+        case GPU_FRAMEBUFFER:
+            glDeleteFramebuffers(1, &pending.name);
+            break;
+        case GPU_RENDERBUFFER:
+            glDeleteRenderbuffers(1, &pending.name);
+            break;
+        default:
+            break;
+        }
+        deleted++;
+    }
+};
+
+// A counted reference to a tracked GL object of one type, so a texture can't be passed where a buffer is expected.
+// Copies share the object, which is released when the last of them goes. References of a scene loaded without
+// OpenGL are all empty and never touch the table.
+template <GpuResourceType TYPE>
+class GpuRef
+{
+public:
+    GpuRef()
+    {
+    }
+
+    // a reference to an object added before; 0 or an untracked name give an empty reference
+    explicit GpuRef(GLuint name)
+    {
+        if (name)
+            handle = GpuResources::Get().Acquire(TYPE, name);
+    }
+
+    // adds a new object and takes the first reference to it
+    static GpuRef Track(GLuint name, size_t bytes, const std::string &label)
+    {
+        if (name)
+            GpuResources::Get().Add(TYPE, name, bytes, label);
+        return GpuRef(name);
+    }
+
+    GpuRef(const GpuRef &other) : handle(other.handle)
+    {
+        if (handle.generation)
+            GpuResources::Get().AddRef(handle);
+    }
+
+    GpuRef(GpuRef &&other) noexcept : handle(other.handle)
+    {
+        other.handle = GpuHandle();
+    }
+
+    GpuRef &operator=(GpuRef other) noexcept
+    {
+        std::swap(handle, other.handle);
+        return *this;
+    }
+
+    ~GpuRef()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        if (handle.generation)
+            GpuResources::Get().Release(handle);
+        handle = GpuHandle();
+    }
+
+    GLuint Name() const
+    {
+        return handle.generation ? GpuResources::Get().Name(TYPE, handle) : 0;
+    }
+
+    void SetBytes(size_t bytes)
+    {
+        if (handle.generation)
+            GpuResources::Get().SetBytes(handle, bytes);
+    }
+
+    explicit operator bool() const
+    {
+        return Name() != 0;
+    }
+
+private:
+    GpuHandle handle;
+};
+
+typedef GpuRef<GPU_BUFFER> GpuBuffer;
+typedef GpuRef<GPU_VERTEX_ARRAY> GpuVertexArray;
+typedef GpuRef<GPU_TEXTURE> GpuTexture;
+typedef GpuRef<GPU_PROGRAM> GpuProgram;
+typedef GpuRef<GPU_FRAMEBUFFER> GpuFramebuffer;
+typedef GpuRef<GPU_RENDERBUFFER> GpuRenderbuffer;
+#endif
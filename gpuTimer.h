@@ -0,0 +1,262 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include "profiler.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <climits>
+
+// GPU time of one pass, averaged over the frames that have been resolved
+struct GpuPassStat {
+    std::string name;
+    double avgMs;
+    double maxMs;
+    double lastMs;
+};
+
+// Measures GPU time per render pass with GL_TIMESTAMP queries. Each frame writes its timestamps into its own slot
+// of a ring several frames deep and results are read back once the driver reports them available, so the CPU only
+// waits if the GPU falls a whole ring behind. Timestamps rather than GL_TIME_ELAPSED let passes nest inside a frame.
+class GpuTimer
+{
+public:
+    static const unsigned int FRAMES_IN_FLIGHT = 4;
+    static const unsigned int MAX_PASSES = 16;
+
+    bool enabled = false;
+
+    static GpuTimer &Get()
+    {
+        static GpuTimer timer;
+        return timer;
+    }
+
+    void Init()
+    {
+        for (unsigned int f = 0; f < FRAMES_IN_FLIGHT; f++)
+        {
+            glGenQueries(MAX_PASSES * 2, frames[f].queries);
+            frames[f].passCount = 0;
+            frames[f].pending = false;
+        }
+        enabled = true;
+    }
+
+    void Destroy()
+    {
+        if (!enabled)
+            return;
+        for (unsigned int f = 0; f < FRAMES_IN_FLIGHT; f++)
+            glDeleteQueries(MAX_PASSES * 2, frames[f].queries);
+        enabled = false;
+    }
+
+    // starts a new frame, collecting the results of the frame that last used this slot if they are ready
+    void BeginFrame()
+    {
+        if (!enabled)
+            return;
+        current = (current + 1) % FRAMES_IN_FLIGHT;
+        FrameQueries &frame = frames[current];
+        if (frame.pending)
+        {
+            // the ring is full: this frame's queries are needed again, so the old results have to be waited for
+            collect(frame, true);
+        }
+        frame.passCount = 0;
+        frame.lastEnd = 0;
+        frame.open.clear();
+        frame.pending = true;
+    }
+
+    void BeginPass(const char *name)
+    {
+        if (!enabled)
+            return;
+        FrameQueries &frame = frames[current];
+        if (frame.passCount >= MAX_PASSES)
+        {
+            // a dropped pass still opens a level, so its EndPass closes nothing
+            frame.open.push_back(UINT_MAX);
+            return;
+        }
+        unsigned int index = frame.passCount++;
+        frame.names[index] = name;
+        glQueryCounter(frame.queries[index * 2], GL_TIMESTAMP);
+        frame.open.push_back(index);
+    }
+
+    void EndPass()
+    {
+        if (!enabled)
+            return;
+        FrameQueries &frame = frames[current];
+        if (frame.open.empty())
+            return;
+        unsigned int index = frame.open.back();
+        frame.open.pop_back();
+        if (index == UINT_MAX)
+            return;
+        glQueryCounter(frame.queries[index * 2 + 1], GL_TIMESTAMP);
+        frame.lastEnd = index * 2 + 1;
+    }
+
+    // polls every frame in flight without blocking, oldest first
+    void Resolve()
+    {
+        if (!enabled)
+            return;
+        for (unsigned int i = 1; i < FRAMES_IN_FLIGHT; i++)
+        {
+            FrameQueries &frame = frames[(current + i) % FRAMES_IN_FLIGHT];
+            if (frame.pending)
+                collect(frame, false);
+        }
+    }
+
+    // waits for every outstanding query, used at the end of a benchmark
+    void Flush()
+    {
+        if (!enabled)
+            return;
+        for (unsigned int i = 1; i <= FRAMES_IN_FLIGHT; i++)
+        {
+            FrameQueries &frame = frames[(current + i) % FRAMES_IN_FLIGHT];
+            if (frame.pending)
+                collect(frame, true);
+        }
+    }
+
+    // time of every resolved frame of the named pass, in order, for percentile statistics
+    const std::vector<double> &History(const std::string &name)
+    {
+        return passes[name].history;
+    }
+
+    std::vector<GpuPassStat> Stats()
+    {
+        std::vector<GpuPassStat> stats;
+        for (std::map<std::string, PassTimes>::iterator it = passes.begin(); it != passes.end(); ++it)
+        {
+            const PassTimes &times = it->second;
+            if (times.history.empty())
+                continue;
+            GpuPassStat stat;
+            stat.name = it->first;
+            stat.avgMs = times.total / times.history.size();
+            stat.maxMs = *std::max_element(times.history.begin(), times.history.end());
+            stat.lastMs = times.history.back();
+            stats.push_back(stat);
+        }
+        std::sort(stats.begin(), stats.end(), [](const GpuPassStat &a, const GpuPassStat &b) { return a.avgMs > b.avgMs; });
+        return stats;
+    }
+
+    void PrintStats()
+    {
+        std::vector<GpuPassStat> stats = Stats();
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(3);
+        out << "---- GPU passes ----\n";
+        for (unsigned int i = 0; i < stats.size(); i++)
+            out << "  " << stats[i].name << ": " << stats[i].avgMs << " ms (max " << stats[i].maxMs << " ms, last " << stats[i].lastMs << " ms)\n";
+        std::cout << out.str();
+    }
+
+    std::string StatsJson()
+    {
+        std::vector<GpuPassStat> stats = Stats();
+        std::ostringstream json;
+        json.precision(6);
+        json << "[";
+        for (unsigned int i = 0; i < stats.size(); i++)
+        {
+            json << (i ? ",\n    " : "\n    ");
+            json << "{ \"name\": \"" << stats[i].name << "\", \"avg_ms\": " << stats[i].avgMs << ", \"max_ms\": " << stats[i].maxMs << " }";
+        }
+        json << (stats.empty() ? "]" : "\n  ]");
+        return json.str();
+    }
+
+    // drops the collected history, e.g. after warm-up frames
+    void Reset()
+    {
+        passes.clear();
+    }
+
+private:
+    struct FrameQueries {
+        unsigned int queries[MAX_PASSES * 2];
+        const char *names[MAX_PASSES];
+        unsigned int passCount;
+        unsigned int lastEnd;
+        std::vector<unsigned int> open;
+        bool pending;
+    };
+
+    struct PassTimes {
+        std::vector<double> history;
+        double total = 0.0;
+    };
+
+    FrameQueries frames[FRAMES_IN_FLIGHT];
+    unsigned int current = 0;
+    std::map<std::string, PassTimes> passes;
+
+    void collect(FrameQueries &frame, bool wait)
+    {
+        if (frame.passCount == 0)
+        {
+            frame.pending = false;
+            return;
+        }
+        // the last timestamp written is the last to become available
+        if (!wait)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(frame.queries[frame.lastEnd], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return;
+        }
+        for (unsigned int i = 0; i < frame.passCount; i++)
+        {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(frame.queries[i * 2], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(frame.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+            double ms = end > begin ? (end - begin) / 1.0e6 : 0.0;
+            PassTimes &times = passes[frame.names[i]];
+            times.history.push_back(ms);
+            times.total += ms;
+        }
+        frame.pending = false;
+    }
+};
+
+// Times the enclosing scope on the CPU profiler and as a GPU pass under the same name
+class RenderPassScope
+{
+public:
+    RenderPassScope(const char *name) : cpuScope(name)
+    {
+        GpuTimer::Get().BeginPass(name);
+    }
+
+    ~RenderPassScope()
+    {
+        GpuTimer::Get().EndPass();
+    }
+
+private:
+    ProfileScope cpuScope;
+};
+
+#define RENDER_PASS(name) RenderPassScope PROFILE_CONCAT(renderPass, __LINE__)(name)
+#endif
@@ -0,0 +1,429 @@
+#ifndef IMAGE_DIFF_H
+#define IMAGE_DIFF_H
+
+#include "profiler.h"
+#include "jobSystem.h"
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+// differences between a test image and a reference; RMSE is on the 0-255 scale, FLIP error is in [0, 1]
+struct ImageDiffResult {
+    int width = 0;
+    int height = 0;
+    double rmse = 0.0;
+    double psnr = 0.0;
+    double meanFlip = 0.0;
+    double maxFlip = 0.0;
+};
+
+// Compares 8-bit sRGB images with RMSE, PSNR and a perceptual error following the LDR version of NVIDIA's FLIP:
+// both images are filtered with the contrast sensitivity of the eye for the viewing distance (pixels per degree),
+// compared in a Hunt-adjusted L*a*b* space, and the colour error is amplified where edges or points differ.
+// The filters are separable and every pass runs over 64x64 tiles on worker threads.
+class ImageDiff
+{
+public:
+    static const int TILE_SIZE = 64;
+
+    // a 0.7 m wide 4K monitor seen from 0.7 m, the default of FLIP
+    float pixelsPerDegree = 67.0f;
+    unsigned int threadCount;
+    // per-pixel FLIP error of the last comparison, top row first
+    std::vector<float> errorMap;
+
+    ImageDiff(unsigned int threads = 0)
+    {
+        threadCount = threads ? threads : JobSystem::Get().ThreadCount();
+    }
+
+    // test and reference are RGB, in the same row order
+    ImageDiffResult Compare(const unsigned char *test, const unsigned char *reference, int width, int height)
+    {
+        PROFILE_SCOPE("diff.compare");
+        ImageDiffResult result;
+        result.width = width;
+        result.height = height;
+        this->width = width;
+        this->height = height;
+        tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+        size_t pixels = (size_t)width * height;
+        size_t tiles = (size_t)tilesX * ((height + TILE_SIZE - 1) / TILE_SIZE);
+        std::vector<double> squaredErrors(tiles), flipErrors(tiles), flipMax(tiles);
+        errorMap.resize(pixels);
+        buildFilters();
+
+        images[0].Resize(pixels);
+        images[1].Resize(pixels);
+        forEachTile([&](unsigned int tile, int x0, int y0, int x1, int y1) {
+            double sum = 0.0;
+            for (int y = y0; y < y1; y++)
+                for (int x = x0; x < x1; x++)
+                {
+                    size_t i = (size_t)y * width + x;
+                    for (int c = 0; c < 3; c++)
+                    {
+                        double d = (double)test[i * 3 + c] - reference[i * 3 + c];
+                        sum += d * d;
+                    }
+                    images[0].Convert(i, &test[i * 3]);
+                    images[1].Convert(i, &reference[i * 3]);
+                }
+            squaredErrors[tile] = sum;
+        });
+        forEachTile([&](unsigned int, int x0, int y0, int x1, int y1) {
+            for (int n = 0; n < 2; n++)
+                filterRows(images[n], x0, y0, x1, y1);
+        });
+        forEachTile([&](unsigned int tile, int x0, int y0, int x1, int y1) {
+            double sum = 0.0, maximum = 0.0;
+            for (int y = y0; y < y1; y++)
+                for (int x = x0; x < x1; x++)
+                {
+                    float error = flip(x, y);
+                    errorMap[(size_t)y * width + x] = error;
+                    sum += error;
+                    maximum = std::max(maximum, (double)error);
+                }
+            flipErrors[tile] = sum;
+            flipMax[tile] = maximum;
+        });
+
+        double squared = 0.0, flipSum = 0.0;
+        for (size_t t = 0; t < tiles; t++)
+        {
+            squared += squaredErrors[t];
+            flipSum += flipErrors[t];
+            result.maxFlip = std::max(result.maxFlip, flipMax[t]);
+        }
+        result.rmse = std::sqrt(squared / (pixels * 3.0));
+        result.psnr = result.rmse > 0.0 ? 20.0 * std::log10(255.0 / result.rmse) : INFINITY;
+        result.meanFlip = flipSum / pixels;
+        return result;
+    }
+
+    bool CompareFiles(const std::string &testPath, const std::string &referencePath, ImageDiffResult &result)
+    {
+        int width, height, testChannels, referenceWidth, referenceHeight, referenceChannels;
+        unsigned char *test = stbi_load(testPath.c_str(), &width, &height, &testChannels, 3);
+        if (!test)
+        {
+            std::cout << "ERROR::IMAGE_DIFF::FILE_NOT_SUCCESFULLY_READ: " << testPath << std::endl;
+            return false;
+        }
+        unsigned char *reference = stbi_load(referencePath.c_str(), &referenceWidth, &referenceHeight, &referenceChannels, 3);
+        if (!reference)
+        {
+            std::cout << "ERROR::IMAGE_DIFF::FILE_NOT_SUCCESFULLY_READ: " << referencePath << std::endl;
+            stbi_image_free(test);
+            return false;
+        }
+        bool sameSize = width == referenceWidth && height == referenceHeight;
+        if (sameSize)
+            result = Compare(test, reference, width, height);
+        else
+            std::cout << "ERROR::IMAGE_DIFF::SIZE_MISMATCH: " << width << "x" << height << " against " << referenceWidth << "x"
+                      << referenceHeight << std::endl;
+        stbi_image_free(test);
+        stbi_image_free(reference);
+        return sameSize;
+    }
+
+    // writes the error map of the last comparison with a black-red-yellow-white ramp
+    bool SaveErrorMap(const std::string &path) const
+    {
+        std::vector<unsigned char> heat(errorMap.size() * 3);
+        for (size_t i = 0; i < errorMap.size(); i++)
+        {
+            float e = std::min(std::max(errorMap[i], 0.0f), 1.0f) * 3.0f;
+            heat[i * 3 + 0] = (unsigned char)(std::min(e, 1.0f) * 255.0f);
+            heat[i * 3 + 1] = (unsigned char)(std::min(std::max(e - 1.0f, 0.0f), 1.0f) * 255.0f);
+            heat[i * 3 + 2] = (unsigned char)(std::max(e - 2.0f, 0.0f) * 255.0f);
+        }
+        if (!stbi_write_png(path.c_str(), width, height, 3, heat.empty() ? NULL : &heat[0], width * 3))
+        {
+            std::cout << "ERROR::IMAGE_DIFF::FILE_NOT_WRITABLE: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct Vec3 {
+        float x, y, z;
+    };
+
+    // planes of one image: YCxCz for the colour filters, normalized luminance for the feature filters, and the
+    // results of filtering them along rows
+    struct Planes {
+        std::vector<float> ycc[3];
+        std::vector<float> gray;
+        // colour filter rows: Y, Cx, and the narrow and wide gaussians of Cz
+        std::vector<float> colorRows[4];
+        // feature filter rows: gaussian, first and second derivative
+        std::vector<float> featureRows[3];
+
+        void Resize(size_t pixels)
+        {
+            for (int c = 0; c < 3; c++)
+                ycc[c].resize(pixels);
+            gray.resize(pixels);
+            for (int c = 0; c < 4; c++)
+                colorRows[c].resize(pixels);
+            for (int c = 0; c < 3; c++)
+                featureRows[c].resize(pixels);
+        }
+
+        void Convert(size_t i, const unsigned char *rgb)
+        {
+            Vec3 linear = {toLinear(rgb[0]), toLinear(rgb[1]), toLinear(rgb[2])};
+            Vec3 xyz = linearToXyz(linear);
+            Vec3 y = xyzToYcxcz(xyz);
+            ycc[0][i] = y.x;
+            ycc[1][i] = y.y;
+            ycc[2][i] = y.z;
+            gray[i] = (y.x + 16.0f) / 116.0f;
+        }
+    };
+
+    int width = 0;
+    int height = 0;
+    int tilesX = 0;
+    Planes images[2];
+    // 1D kernels, centred on their middle element
+    std::vector<float> colorKernels[4];
+    float czWeights[2];
+    std::vector<float> gaussian, firstDerivative, secondDerivative;
+    float maxColorError = 1.0f;
+
+    template <typename F> void forEachTile(F pass)
+    {
+        unsigned int tiles = (unsigned int)(tilesX * ((height + TILE_SIZE - 1) / TILE_SIZE));
+        std::atomic<unsigned int> nextTile(0);
+        auto worker = [&]() {
+            for (unsigned int tile = nextTile++; tile < tiles; tile = nextTile++)
+            {
+                int x0 = (tile % tilesX) * TILE_SIZE, y0 = (tile / tilesX) * TILE_SIZE;
+                pass(tile, x0, y0, std::min(x0 + TILE_SIZE, width), std::min(y0 + TILE_SIZE, height));
+            }
+        };
+        JobSystem::Get().RunParallel(std::min(threadCount, tiles), worker);
+    }
+
+    static float toLinear(unsigned char value)
+    {
+        float v = value / 255.0f;
+        return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+    }
+
+    static Vec3 linearToXyz(Vec3 c)
+    {
+        Vec3 r = {0.4124f * c.x + 0.3576f * c.y + 0.1805f * c.z, 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z,
+                      0.0193f * c.x + 0.1192f * c.y + 0.9505f * c.z};
+        return r;
+    }
+
+    static Vec3 xyzToLinear(Vec3 c)
+    {
+        Vec3 r = {3.2406f * c.x - 1.5372f * c.y - 0.4986f * c.z, -0.9689f * c.x + 1.8758f * c.y + 0.0415f * c.z,
+                      0.0557f * c.x - 0.2040f * c.y + 1.0570f * c.z};
+        return r;
+    }
+
+    // D65 white of the linear RGB to XYZ matrix above
+    static Vec3 white()
+    {
+        Vec3 w = {0.9505f, 1.0f, 1.0890f};
+        return w;
+    }
+
+    static Vec3 xyzToYcxcz(Vec3 c)
+    {
+        Vec3 w = white();
+        float y = c.y / w.y;
+        Vec3 r = {116.0f * y - 16.0f, 500.0f * (c.x / w.x - y), 200.0f * (y - c.z / w.z)};
+        return r;
+    }
+
+    static Vec3 ycxczToXyz(Vec3 c)
+    {
+        Vec3 w = white();
+        float y = (c.x + 16.0f) / 116.0f;
+        Vec3 r = {(c.y / 500.0f + y) * w.x, y * w.y, (y - c.z / 200.0f) * w.z};
+        return r;
+    }
+
+    static float labCurve(float t)
+    {
+        const float delta = 6.0f / 29.0f;
+        return t > delta * delta * delta ? std::cbrt(t) : t / (3.0f * delta * delta) + 4.0f / 29.0f;
+    }
+
+    // L*a*b* with a and b scaled by lightness (Hunt effect)
+    static Vec3 huntLab(Vec3 xyz)
+    {
+        Vec3 w = white();
+        float fx = labCurve(xyz.x / w.x), fy = labCurve(xyz.y / w.y), fz = labCurve(xyz.z / w.z);
+        float l = 116.0f * fy - 16.0f;
+        Vec3 r = {l, 0.01f * l * 500.0f * (fx - fy), 0.01f * l * 200.0f * (fy - fz)};
+        return r;
+    }
+
+    static float hyab(Vec3 a, Vec3 b)
+    {
+        float da = a.y - b.y, db = a.z - b.z;
+        return std::fabs(a.x - b.x) + std::sqrt(da * da + db * db);
+    }
+
+    // sampled gaussian exp(-pi^2 x^2 / b) in degrees, three standard deviations wide
+    std::vector<float> csfKernel(float b) const
+    {
+        float sigma = std::sqrt(b / (2.0f * (float)M_PI * (float)M_PI)) * pixelsPerDegree;
+        int radius = std::max(1, (int)std::ceil(3.0f * sigma));
+        std::vector<float> kernel(radius * 2 + 1);
+        for (int x = -radius; x <= radius; x++)
+            kernel[x + radius] = std::exp(-0.5f * x * x / (sigma * sigma));
+        return kernel;
+    }
+
+    static float sum(const std::vector<float> &kernel)
+    {
+        float total = 0.0f;
+        for (size_t i = 0; i < kernel.size(); i++)
+            total += kernel[i];
+        return total;
+    }
+
+    static void normalize(std::vector<float> &kernel)
+    {
+        float total = sum(kernel);
+        for (size_t i = 0; i < kernel.size(); i++)
+            kernel[i] /= total;
+    }
+
+    // scales the positive and the negative weights to sum to 1 and -1
+    static void normalizeSigned(std::vector<float> &kernel)
+    {
+        float positive = 0.0f, negative = 0.0f;
+        for (size_t i = 0; i < kernel.size(); i++)
+            (kernel[i] > 0.0f ? positive : negative) += kernel[i];
+        for (size_t i = 0; i < kernel.size(); i++)
+            kernel[i] /= kernel[i] > 0.0f ? positive : -negative;
+    }
+
+    void buildFilters()
+    {
+        // contrast sensitivity: one gaussian for Y and Cx, the weighted sum of two for Cz
+        const float b[4] = {0.0047f, 0.0053f, 0.04f, 0.025f};
+        const float a[4] = {1.0f, 1.0f, 34.1f, 13.5f};
+        for (int c = 0; c < 4; c++)
+        {
+            colorKernels[c] = csfKernel(b[c]);
+            if (c >= 2)
+            {
+                // the 2D weight of a gaussian is its amplitude times the square of its 1D sum
+                float s = sum(colorKernels[c]);
+                czWeights[c - 2] = a[c] * std::sqrt((float)M_PI / b[c]) * s * s;
+            }
+            normalize(colorKernels[c]);
+        }
+        float czTotal = czWeights[0] + czWeights[1];
+        czWeights[0] /= czTotal;
+        czWeights[1] /= czTotal;
+
+        // edges and points at the scale of the feature width
+        float sigma = 0.5f * 0.082f * pixelsPerDegree;
+        int radius = (int)std::ceil(3.0f * sigma);
+        gaussian.resize(radius * 2 + 1);
+        firstDerivative.resize(radius * 2 + 1);
+        secondDerivative.resize(radius * 2 + 1);
+        for (int x = -radius; x <= radius; x++)
+        {
+            float g = std::exp(-0.5f * x * x / (sigma * sigma));
+            gaussian[x + radius] = g;
+            firstDerivative[x + radius] = -x * g;
+            secondDerivative[x + radius] = (x * x / (sigma * sigma) - 1.0f) * g;
+        }
+        normalize(gaussian);
+        normalizeSigned(firstDerivative);
+        normalizeSigned(secondDerivative);
+
+        // the largest colour error, between green and blue
+        Vec3 green = {0.0f, 1.0f, 0.0f}, blue = {0.0f, 0.0f, 1.0f};
+        maxColorError = std::pow(hyab(huntLab(linearToXyz(green)), huntLab(linearToXyz(blue))), 0.7f);
+    }
+
+    // clamps to the edge of the image
+    static float convolve(const std::vector<float> &plane, const std::vector<float> &kernel, int x, int y, int width, int height,
+                          bool vertical)
+    {
+        int radius = (int)kernel.size() / 2;
+        float total = 0.0f;
+        for (int k = -radius; k <= radius; k++)
+        {
+            int sx = vertical ? x : std::min(std::max(x + k, 0), width - 1);
+            int sy = vertical ? std::min(std::max(y + k, 0), height - 1) : y;
+            total += kernel[k + radius] * plane[(size_t)sy * width + sx];
+        }
+        return total;
+    }
+
+    void filterRows(Planes &image, int x0, int y0, int x1, int y1)
+    {
+        for (int y = y0; y < y1; y++)
+            for (int x = x0; x < x1; x++)
+            {
+                size_t i = (size_t)y * width + x;
+                image.colorRows[0][i] = convolve(image.ycc[0], colorKernels[0], x, y, width, height, false);
+                image.colorRows[1][i] = convolve(image.ycc[1], colorKernels[1], x, y, width, height, false);
+                image.colorRows[2][i] = convolve(image.ycc[2], colorKernels[2], x, y, width, height, false);
+                image.colorRows[3][i] = convolve(image.ycc[2], colorKernels[3], x, y, width, height, false);
+                image.featureRows[0][i] = convolve(image.gray, gaussian, x, y, width, height, false);
+                image.featureRows[1][i] = convolve(image.gray, firstDerivative, x, y, width, height, false);
+                image.featureRows[2][i] = convolve(image.gray, secondDerivative, x, y, width, height, false);
+            }
+    }
+
+    // finishes the filters along the columns, then combines colour and feature errors
+    float flip(int x, int y) const
+    {
+        Vec3 lab[2];
+        float edge[2], point[2];
+        for (int n = 0; n < 2; n++)
+        {
+            const Planes &image = images[n];
+            Vec3 ycc = {convolve(image.colorRows[0], colorKernels[0], x, y, width, height, true),
+                            convolve(image.colorRows[1], colorKernels[1], x, y, width, height, true),
+                            czWeights[0] * convolve(image.colorRows[2], colorKernels[2], x, y, width, height, true) +
+                                czWeights[1] * convolve(image.colorRows[3], colorKernels[3], x, y, width, height, true)};
+            Vec3 rgb = xyzToLinear(ycxczToXyz(ycc));
+            rgb.x = std::min(std::max(rgb.x, 0.0f), 1.0f);
+            rgb.y = std::min(std::max(rgb.y, 0.0f), 1.0f);
+            rgb.z = std::min(std::max(rgb.z, 0.0f), 1.0f);
+            lab[n] = huntLab(linearToXyz(rgb));
+
+            float edgeX = convolve(image.featureRows[1], gaussian, x, y, width, height, true);
+            float edgeY = convolve(image.featureRows[0], firstDerivative, x, y, width, height, true);
+            float pointX = convolve(image.featureRows[2], gaussian, x, y, width, height, true);
+            float pointY = convolve(image.featureRows[0], secondDerivative, x, y, width, height, true);
+            edge[n] = std::sqrt(edgeX * edgeX + edgeY * edgeY);
+            point[n] = std::sqrt(pointX * pointX + pointY * pointY);
+        }
+
+        // colour error, compressed so that small errors count for more
+        const float cutoff = 0.4f * maxColorError, knee = 0.95f;
+        float color = std::pow(hyab(lab[0], lab[1]), 0.7f);
+        color = color < cutoff ? color * knee / cutoff : knee + (color - cutoff) / (maxColorError - cutoff) * (1.0f - knee);
+
+        float feature = std::pow(std::max(std::fabs(edge[0] - edge[1]), std::fabs(point[0] - point[1])) / std::sqrt(2.0f), 0.5f);
+        return std::pow(color, 1.0f - feature);
+    }
+};
+#endif
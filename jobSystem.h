@@ -0,0 +1,393 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include "profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+struct JobCounter;
+
+// a function to run on any worker, or on the main thread, and the counter it finishes
+struct Job {
+    std::function<void()> run;
+    JobCounter *counter;
+    bool mainThread;
+};
+
+// Counts the unfinished jobs started with it. Wait blocks until it reaches zero, and jobs given to RunAfter are
+// started when it does. A counter can be reused once it has reached zero.
+struct JobCounter {
+    std::atomic<int> pending;
+    std::mutex mutex;
+    std::vector<Job> continuations;
+
+    JobCounter() : pending(0)
+    {
+    }
+
+    bool Done() const
+    {
+        return pending.load(std::memory_order_acquire) == 0;
+    }
+};
+
+// Work-stealing scheduler shared by everything that runs on more than one core. Each worker thread owns a deque:
+// it pushes and pops its own jobs at the back, so nested work stays hot in its cache, and idle workers steal the
+// oldest jobs from the front of the others. Jobs started from other threads are dealt round the workers. A thread
+// waiting for a counter runs queued jobs meanwhile, so jobs can wait for the jobs they start.
+//
+// Jobs that have to run on the main thread, like anything touching the GL context, go to a separate queue that the
+// main thread runs in PumpMainThread, once per frame, or while it waits for a counter.
+//
+// The system is created by the first call to Get, which has to come from the main thread.
+class JobSystem
+{
+public:
+    static JobSystem &Get()
+    {
+        static JobSystem system;
+        return system;
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+        for (size_t i = 0; i < workers.size(); i++)
+            delete workers[i];
+    }
+
+    // the workers and the main thread
+    unsigned int ThreadCount() const
+    {
+        return (unsigned int)workers.size() + 1;
+    }
+
+    bool IsMainThread() const
+    {
+        return std::this_thread::get_id() == mainThread;
+    }
+
+    // starts a job on any worker; the counter, if given, counts it until it has finished
+    void Run(std::function<void()> run, JobCounter *counter = NULL)
+    {
+        Job job = { run, counter, false };
+        start(job);
+    }
+
+    // queues a job for the main thread
+    void RunOnMainThread(std::function<void()> run, JobCounter *counter = NULL)
+    {
+        Job job = { run, counter, true };
+        start(job);
+    }
+
+    // starts a job once every job counted by the dependency has finished, right away if none is left
+    void RunAfter(JobCounter &dependency, std::function<void()> run, JobCounter *counter = NULL, bool mainThread = false)
+    {
+        Job job = { run, counter, mainThread };
+        if (counter)
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::unique_lock<std::mutex> lock(dependency.mutex);
+            if (!dependency.Done())
+            {
+                dependency.continuations.push_back(job);
+                return;
+            }
+        }
+        push(job);
+    }
+
+    // runs queued jobs until every job counted by the counter has finished
+    void Wait(JobCounter &counter)
+    {
+        PROFILE_SCOPE("jobs.wait");
+        bool main = IsMainThread();
+        while (!counter.Done())
+        {
+            if (main && runMainJob())
+                continue;
+            if (!runQueuedJob())
+                std::this_thread::yield();
+        }
+        // the last job may still be releasing the counter
+        std::unique_lock<std::mutex> lock(counter.mutex);
+    }
+
+    // runs the worker function on the given number of threads at once, this one included, and waits for all of
+    // them; the function shares out its work itself, usually through an atomic index
+    void RunParallel(unsigned int jobs, const std::function<void()> &worker)
+    {
+        JobCounter counter;
+        for (unsigned int i = 1; i < jobs; i++)
+            Run(worker, &counter);
+        worker();
+        Wait(counter);
+    }
+
+    // runs the jobs queued for the main thread, called once per frame
+    void PumpMainThread()
+    {
+        PROFILE_SCOPE("jobs.mainThread");
+        while (runMainJob())
+            ;
+    }
+
+    // share of the time since the last reset each worker spent running jobs, and the jobs run and stolen
+    std::string StatsJson() const
+    {
+        double elapsed = elapsedNs();
+        std::ostringstream json;
+        json << "{\"workers\": " << workers.size() << ", \"jobs\": " << totalJobs() << ", \"steals\": " << totalSteals()
+             << ", \"main_thread_jobs\": " << mainJobs.load(std::memory_order_relaxed) << ", \"utilization\": [";
+        for (size_t i = 0; i < workers.size(); i++)
+            json << (i ? ", " : "") << workers[i]->busyNs.load(std::memory_order_relaxed) / elapsed;
+        json << "]}";
+        return json.str();
+    }
+
+    void PrintStats() const
+    {
+        double elapsed = elapsedNs(), busy = 0.0;
+        for (size_t i = 0; i < workers.size(); i++)
+            busy += workers[i]->busyNs.load(std::memory_order_relaxed);
+        std::cout << "Jobs: " << totalJobs() << " on " << workers.size() << " workers, " << totalSteals() << " stolen, "
+                  << mainJobs.load(std::memory_order_relaxed) << " on the main thread, utilization "
+                  << (workers.empty() ? 0.0 : busy / elapsed / workers.size()) * 100.0 << "%" << std::endl;
+    }
+
+    void ResetStats()
+    {
+        for (size_t i = 0; i < workers.size(); i++)
+        {
+            workers[i]->jobs.store(0, std::memory_order_relaxed);
+            workers[i]->steals.store(0, std::memory_order_relaxed);
+            workers[i]->busyNs.store(0, std::memory_order_relaxed);
+        }
+        mainJobs.store(0, std::memory_order_relaxed);
+        statsStart = Profiler::Get().Now();
+    }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Job> queue;
+        std::atomic<uint64_t> jobs;
+        std::atomic<uint64_t> steals;
+        std::atomic<uint64_t> busyNs;
+
+        Worker() : jobs(0), steals(0), busyNs(0)
+        {
+        }
+    };
+
+    std::vector<Worker *> workers;
+    std::vector<std::thread> threads;
+    std::thread::id mainThread;
+
+    std::mutex mainMutex;
+    std::deque<Job> mainQueue;
+    std::atomic<uint64_t> mainJobs;
+
+    // queued jobs of all the workers, for the idle ones to sleep on
+    std::atomic<int> queued;
+    std::atomic<unsigned int> nextWorker;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping;
+    uint64_t statsStart;
+
+    // the index of the worker running on this thread, -1 elsewhere
+    static int &workerIndex()
+    {
+        thread_local int index = -1;
+        return index;
+    }
+
+    JobSystem() : mainThread(std::this_thread::get_id()), mainJobs(0), queued(0), nextWorker(0), stopping(false)
+    {
+        statsStart = Profiler::Get().Now();
+        unsigned int count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned int i = 0; i < count; i++)
+            workers.push_back(new Worker());
+        for (unsigned int i = 0; i < count; i++)
+            threads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+    }
+
+    void start(Job &job)
+    {
+        if (job.counter)
+            job.counter->pending.fetch_add(1, std::memory_order_relaxed);
+        push(job);
+    }
+
+    void push(const Job &job)
+    {
+        if (job.mainThread)
+        {
+            std::unique_lock<std::mutex> lock(mainMutex);
+            mainQueue.push_back(job);
+            return;
+        }
+        int index = workerIndex();
+        Worker &worker = *workers[index >= 0 ? (unsigned int)index : nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size()];
+        {
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            worker.queue.push_back(job);
+        }
+        queued.fetch_add(1, std::memory_order_release);
+        {
+            // taken so a worker can't miss the job between checking for work and going to sleep
+            std::unique_lock<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    // takes the newest job of this thread's worker, or the oldest of another one
+    bool pop(Job &job, bool &stolen)
+    {
+        int own = workerIndex();
+        if (own >= 0)
+        {
+            Worker &worker = *workers[own];
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            if (!worker.queue.empty())
+            {
+                job = worker.queue.back();
+                worker.queue.pop_back();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                stolen = false;
+                return true;
+            }
+        }
+        unsigned int first = own >= 0 ? (unsigned int)own + 1 : nextWorker.load(std::memory_order_relaxed);
+        for (unsigned int i = 0; i < workers.size(); i++)
+        {
+            unsigned int victim = (first + i) % workers.size();
+            if ((int)victim == own)
+                continue;
+            Worker &worker = *workers[victim];
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            if (!worker.queue.empty())
+            {
+                job = worker.queue.front();
+                worker.queue.pop_front();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                stolen = own >= 0;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool runQueuedJob()
+    {
+        Job job;
+        bool stolen;
+        if (!pop(job, stolen))
+            return false;
+        int own = workerIndex();
+        uint64_t start = Profiler::Get().Now();
+        job.run();
+        finish(job.counter);
+        if (own >= 0)
+        {
+            Worker &worker = *workers[own];
+            worker.busyNs.fetch_add(Profiler::Get().Now() - start, std::memory_order_relaxed);
+            worker.jobs.fetch_add(1, std::memory_order_relaxed);
+            if (stolen)
+                worker.steals.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+            mainJobs.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool runMainJob()
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mainMutex);
+            if (mainQueue.empty())
+                return false;
+            job = mainQueue.front();
+            mainQueue.pop_front();
+        }
+        job.run();
+        finish(job.counter);
+        mainJobs.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // counts a job of the counter as finished, and starts the jobs waiting for it when it was the last one. The
+    // counter is only touched under its mutex, which Wait takes before it returns, so a waiter can't destroy it
+    // while this still uses it.
+    void finish(JobCounter *counter)
+    {
+        if (!counter)
+            return;
+        std::vector<Job> continuations;
+        {
+            std::unique_lock<std::mutex> lock(counter->mutex);
+            if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                continuations.swap(counter->continuations);
+        }
+        for (size_t i = 0; i < continuations.size(); i++)
+            push(continuations[i]);
+    }
+
+    void workerLoop(unsigned int index)
+    {
+        workerIndex() = (int)index;
+        Profiler::Get().SetThreadName("job worker " + std::to_string(index + 1));
+        while (true)
+        {
+            if (runQueuedJob())
+                continue;
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+            if (stopping)
+                return;
+        }
+    }
+
+    uint64_t totalJobs() const
+    {
+        uint64_t total = 0;
+        for (size_t i = 0; i < workers.size(); i++)
+            total += workers[i]->jobs.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    uint64_t totalSteals() const
+    {
+        uint64_t total = 0;
+        for (size_t i = 0; i < workers.size(); i++)
+            total += workers[i]->steals.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    double elapsedNs() const
+    {
+        return std::max(1.0, (double)(Profiler::Get().Now() - statsStart));
+    }
+};
+#endif
@@ -7,21 +7,49 @@
 
 #include "shader.h"
 #include "camera.h"
+#include "cameraPath.h"
 #include "model.h"
+#include "scene.h"
+#include "offscreenContext.h"
+#include "benchmark.h"
+#include "profiler.h"
+#include "gpuTimer.h"
+#include "glCounters.h"
+#include "softRasterizer.h"
+#include "pathTracer.h"
+#include "batchRenderer.h"
+#include "frameCapture.h"
+#include "imageDiff.h"
+#include "jobSystem.h"
+#include "gpuResources.h"
+#include "shaderWatcher.h"
 
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
 
 #include "imgui/imgui.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void processInput(GLFWwindow *window);
-unsigned int loadTexture(const char *path);
-void renderSphere();
+unsigned int processInput(GLFWwindow *window);
+void applyInput(unsigned int keys);
+int runWindow(GLFWwindow *window);
+int runBenchmark(unsigned int frames, int width, int height, const std::string &jsonPath);
+int runSoftRasterizer(const std::string &imagePath, int width, int height);
+int runPathTracer(const std::string &imagePath, int width, int height);
+int runBatch(const std::string &jobsPath, int width, int height);
+int runDiff(const std::string &testPath, const std::string &referencePath);
+int runRegression(const std::string &goldenDir, int width, int height);
+int runCook();
+int runPack(const std::string &packPath);
 
 // width and height of screen
 const unsigned int SCR_WIDTH = 1280;
@@ -37,18 +65,269 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-// to rotate the spheres when keys are pressed
-float sphereRotator = 0.0f;
-float brickSphereRotator = 0.0f;
-float phongSphereRotator = 0.0f;
-float phongSphere2Rotator = 0.0f;
-
-// switch from Phong to Blinn-Phong
-bool blinn = false;
+// sphere rotations and the Phong / Blinn-Phong switch
+SceneState sceneState;
 bool blinnPressed = false;
 
-int main()
+// camera path recording and playback
+CameraPath cameraPath;
+bool recordPath = false;
+bool playPath = false;
+std::string recordFile;
+unsigned int playbackFrame = 0;
+double playbackTime = 0.0;
+
+// headless benchmark settings
+bool benchmark = false;
+unsigned int benchFrames = 0;
+int benchWidth = SCR_WIDTH;
+int benchHeight = SCR_HEIGHT;
+std::string benchJson;
+
+// CPU profiler output
+bool printProfile = false;
+std::string traceFile;
+
+// count GL calls and redundant state changes per frame
+bool countGl = false;
+
+// render a single frame on the CPU into this image instead of opening a window
+std::string softImage;
+
+// path traced reference image settings
+std::string traceImage;
+unsigned int traceSamples = 64;
+unsigned int traceBounces = 4;
+
+// material comparison jobs rendered offscreen
+std::string batchJobs;
+
+// image comparison, and the regression check of key views against golden images
+std::string diffTest;
+std::string diffReference;
+std::string diffHeatmap;
+std::string goldenDir;
+double maxMeanFlip = 0.05;
+double minPsnr = 30.0;
+// --update-goldens: --regress writes its views as the golden images instead of comparing them
+bool updateGoldens = false;
+
+// encode the scene's textures into block compressed DDS files instead of rendering
+bool cookTextures = false;
+
+// write the scene's assets into an asset pack instead of rendering, or load them from one
+std::string packOutput;
+std::string assetPackPath;
+
+// frames are recorded to numbered PNGs with this prefix, or to a raw video if it ends in .raw
+std::string captureOutput;
+
+// shader files edited while the window is open are compiled again and swapped in
+bool hotReload = false;
+
+int main(int argc, char **argv)
 {
+    // command line: --record <file>, --replay <file>, --flythrough [frames]
+    //               --bench [frames] [--size <width> <height>] [--json <file>]
+    //               --profile, --trace <file>, --count-gl
+    //               --soft <image> [--size <width> <height>]
+    //               --pathtrace <image> [--spp <samples>] [--bounces <count>] [--size <width> <height>]
+    //               --batch <jobs file> [--size <width> <height>]
+    //               --capture <prefix | file.raw>
+    //               --cook, --uncompressed, --separate-maps
+    //               --stream [--vram-budget <MB>]
+    //               --pack <file>, --assets <file>
+    //               --scene <file>
+    //               --hot-reload
+    //               --diff <test> <reference> [--heatmap <image>]
+    //               --regress <golden dir> [--max-flip <mean error>] [--min-psnr <dB>] [--update-goldens] [--size <width> <height>]
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bench") == 0)
+        {
+            benchmark = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                benchFrames = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc)
+        {
+            benchWidth = atoi(argv[++i]);
+            benchHeight = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            benchJson = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile") == 0)
+        {
+            printProfile = true;
+            Profiler::Get().enabled = true;
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            traceFile = argv[++i];
+            Profiler::Get().enabled = true;
+        }
+        else if (strcmp(argv[i], "--soft") == 0 && i + 1 < argc)
+        {
+            softImage = argv[++i];
+        }
+        else if (strcmp(argv[i], "--pathtrace") == 0 && i + 1 < argc)
+        {
+            traceImage = argv[++i];
+        }
+        else if (strcmp(argv[i], "--spp") == 0 && i + 1 < argc)
+        {
+            traceSamples = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bounces") == 0 && i + 1 < argc)
+        {
+            traceBounces = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            batchJobs = argv[++i];
+        }
+        else if (strcmp(argv[i], "--diff") == 0 && i + 2 < argc)
+        {
+            diffTest = argv[++i];
+            diffReference = argv[++i];
+        }
+        else if (strcmp(argv[i], "--heatmap") == 0 && i + 1 < argc)
+        {
+            diffHeatmap = argv[++i];
+        }
+        else if (strcmp(argv[i], "--regress") == 0 && i + 1 < argc)
+        {
+            goldenDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--max-flip") == 0 && i + 1 < argc)
+        {
+            maxMeanFlip = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--min-psnr") == 0 && i + 1 < argc)
+        {
+            minPsnr = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--update-goldens") == 0)
+        {
+            updateGoldens = true;
+        }
+        else if (strcmp(argv[i], "--cook") == 0)
+        {
+            cookTextures = true;
+        }
+        else if (strcmp(argv[i], "--uncompressed") == 0)
+        {
+            useCookedTextures = false;
+        }
+        else if (strcmp(argv[i], "--separate-maps") == 0)
+        {
+            usePackedOrm = false;
+        }
+        else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc)
+        {
+            packOutput = argv[++i];
+        }
+        else if (strcmp(argv[i], "--assets") == 0 && i + 1 < argc)
+        {
+            assetPackPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+        {
+            sceneFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--hot-reload") == 0)
+        {
+            hotReload = true;
+        }
+        else if (strcmp(argv[i], "--stream") == 0)
+        {
+            useTextureStreaming = true;
+        }
+        else if (strcmp(argv[i], "--vram-budget") == 0 && i + 1 < argc)
+        {
+            useTextureStreaming = true;
+            textureBudgetMB = (size_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+        {
+            captureOutput = argv[++i];
+        }
+        else if (strcmp(argv[i], "--count-gl") == 0)
+        {
+            countGl = true;
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            recordPath = true;
+            recordFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            if (!cameraPath.Load(argv[++i]))
+                return -1;
+            playPath = true;
+        }
+        else if (strcmp(argv[i], "--flythrough") == 0)
+        {
+            unsigned int frames = 1200;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                frames = (unsigned int)atoi(argv[++i]);
+            cameraPath = CameraPath::Flythrough(frames);
+            playPath = true;
+        }
+        else
+        {
+            std::cout << "Unknown argument: " << argv[i] << std::endl;
+            return -1;
+        }
+    }
+    // the workers start before anything can queue a job, and the main thread is the one that creates them
+    JobSystem::Get();
+
+    // the pack is written from the asset files, so they are never read from another pack then
+    if (!packOutput.empty())
+        return runPack(packOutput);
+    if (!assetPackPath.empty() && !AssetPack::Get().Open(assetPackPath))
+        return -1;
+    if (!softImage.empty() || !traceImage.empty())
+    {
+        int result = 0;
+        if (!softImage.empty())
+            result = runSoftRasterizer(softImage, benchWidth, benchHeight);
+        if (result == 0 && !traceImage.empty())
+            result = runPathTracer(traceImage, benchWidth, benchHeight);
+        if (!traceFile.empty())
+            Profiler::Get().WriteChromeTrace(traceFile);
+        return result;
+    }
+    if (cookTextures)
+        return runCook();
+    if (!diffTest.empty())
+        return runDiff(diffTest, diffReference);
+    if (!goldenDir.empty())
+    {
+        int result = runRegression(goldenDir, benchWidth, benchHeight);
+        if (!traceFile.empty())
+            Profiler::Get().WriteChromeTrace(traceFile);
+        return result;
+    }
+    if (!batchJobs.empty())
+    {
+        int result = runBatch(batchJobs, benchWidth, benchHeight);
+        if (!traceFile.empty())
+            Profiler::Get().WriteChromeTrace(traceFile);
+        return result;
+    }
+    if (benchmark)
+    {
+        int result = runBenchmark(benchFrames, benchWidth, benchHeight, benchJson);
+        if (!traceFile.empty())
+            Profiler::Get().WriteChromeTrace(traceFile);
+        return result;
+    }
+
     // glfw: initialize and configure
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -80,519 +359,229 @@ int main()
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
     {
         std::cout << "Failed to initialize GLAD" << std::endl;
+        glfwTerminate();
         return -1;
     }
-    
-
-    // configure global opengl state
-    glEnable(GL_DEPTH_TEST);
-
-    // build and compile shaders for Cook-Torrance and Phong
-    Shader shader("cookTorrance.vs", "cookTorrance.fs");
-    Shader phongShader("phongShader.vs", "phongShader.fs");
 
-    // Load in the chair model
-    Model chairModel("chair/source/stul/stul.obj");
+    // the scene and everything else holding GPU objects is gone when this returns
+    int result = runWindow(window);
 
-    // floor - draw as two triangles and define vertices normals and texcoords
-    float planeVertices[] = {
-        // positions            // normals         // texcoords
-         10.0f, -0.5f,  10.0f,  0.0f, 1.0f, 0.0f,  10.0f,  0.0f,
-        -10.0f, -0.5f,  10.0f,  0.0f, 1.0f, 0.0f,   0.0f,  0.0f,
-        -10.0f, -0.5f, -10.0f,  0.0f, 1.0f, 0.0f,   0.0f, 10.0f,
-
-         10.0f, -0.5f,  10.0f,  0.0f, 1.0f, 0.0f,  10.0f,  0.0f,
-        -10.0f, -0.5f, -10.0f,  0.0f, 1.0f, 0.0f,   0.0f, 10.0f,
-         10.0f, -0.5f, -10.0f,  0.0f, 1.0f, 0.0f,  10.0f, 10.0f
-    };
-    // back wall
-    float plane2Vertices[] = {
-        // positions            // normals         // texcoords
-         10.0f, -0.5f,  -10.0f,  0.0f, 0.0f, 1.0f,  10.0f,  0.0f,
-        -10.0f, -0.5f,  -10.0f,  0.0f, 0.0f, 1.0f,   0.0f,  0.0f,
-        -10.0f, 9.5f, -10.0f,  0.0f, 0.0f, 1.0f,   0.0f, 10.0f,
-
-         10.0f, -0.5f,  -10.0f,  0.0f, 0.0f, 1.0f,  10.0f,  0.0f,
-        -10.0f, 9.5f, -10.0f,  0.0f, 0.0f, 1.0f,   0.0f, 10.0f,
-         10.0f, 9.5f, -10.0f,  0.0f, 0.0f, 1.0f,  10.0f, 10.0f
-    };
-    // left wall
-    float plane3Vertices[] = {
-        // positions            // normals         // texcoords
-        -10.0f, -0.5f, 10.0f,  1.0f, 0.0f, 0.0f,  10.0f,  0.0f,
-        -10.0f, -0.5f, -10.0f,  1.0f, 0.0f, 0.0f,   0.0f,  0.0f,
-        -10.0f, 9.5f, -10.0f,  1.0f, 0.0f, 0.0f,   0.0f, 10.0f,
-
-        -10.0f, -0.5f, 10.0f,  1.0f, 0.0f, 0.0f,  10.0f,  0.0f,
-        -10.0f, 9.5f, -10.0f,  1.0f, 0.0f, 0.0f,   0.0f, 10.0f,
-        -10.0f, 9.5f, 10.0f,  1.0f, 0.0f, 0.0f,  10.0f, 10.0f
-    };
-    // right wall
-    float plane4Vertices[] = {
-        // positions            // normals         // texcoords
-        10.0f, -0.5f, 10.0f,  -1.0f, 0.0f, 0.0f,  10.0f,  0.0f,
-        10.0f, -0.5f, -10.0f,  -1.0f, 0.0f, 0.0f,   0.0f,  0.0f,
-        10.0f, 9.5f, -10.0f,  -1.0f, 0.0f, 0.0f,   0.0f, 10.0f,
-
-        10.0f, -0.5f, 10.0f,  -1.0f, 0.0f, 0.0f,  10.0f,  0.0f,
-        10.0f, 9.5f, -10.0f,  -1.0f, 0.0f, 0.0f,   0.0f, 10.0f,
-        10.0f, 9.5f, 10.0f,  -1.0f, 0.0f, 0.0f,  10.0f, 10.0f
-    };
-    // ceiling
-    float plane5Vertices[] = {
-        // positions            // normals         // texcoords
-         10.0f, 9.5f,  10.0f,  0.0f, -1.0f, 0.0f,  10.0f,  0.0f,
-        -10.0f, 9.5f,  10.0f,  0.0f, -1.0f, 0.0f,   0.0f,  0.0f,
-        -10.0f, 9.5f, -10.0f,  0.0f, -1.0f, 0.0f,   0.0f, 10.0f,
-
-         10.0f, 9.5f,  10.0f,  0.0f, -1.0f, 0.0f,  10.0f,  0.0f,
-        -10.0f, 9.5f, -10.0f,  0.0f, -1.0f, 0.0f,   0.0f, 10.0f,
-         10.0f, 9.5f, -10.0f,  0.0f, -1.0f, 0.0f,  10.0f, 10.0f
-    };
-    // behind me wall
-    float plane6Vertices[] = {
-        // positions            // normals         // texcoords
-         10.0f, -0.5f,  10.0f,  0.0f, 0.0f, -1.0f,  10.0f,  0.0f,
-        -10.0f, -0.5f,  10.0f,  0.0f, 0.0f, -1.0f,   0.0f,  0.0f,
-        -10.0f, 9.5f, 10.0f,  0.0f, 0.0f, -1.0f,   0.0f, 10.0f,
-
-         10.0f, -0.5f,  10.0f,  0.0f, 0.0f, -1.0f,  10.0f,  0.0f,
-        -10.0f, 9.5f, 10.0f,  0.0f, 0.0f, -1.0f,   0.0f, 10.0f,
-         10.0f, 9.5f, 10.0f,  0.0f, 0.0f, -1.0f,  10.0f, 10.0f
-    };
+    // the objects released in the last frames are deleted while their context is still current
+    GpuResources::Get().Flush();
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    glfwTerminate();
+    return result;
+}
 
-    // floor VAO
-    unsigned int planeVAO, planeVBO;
-    glGenVertexArrays(1, &planeVAO);
-    glGenBuffers(1, &planeVBO);
-    glBindVertexArray(planeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), planeVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glBindVertexArray(0);
-
-    // back wall VAO
-    unsigned int plane2VAO, plane2VBO;
-    glGenVertexArrays(1, &plane2VAO);
-    glGenBuffers(1, &plane2VBO);
-    glBindVertexArray(plane2VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, plane2VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(plane2Vertices), plane2Vertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glBindVertexArray(0);
-
-    // left wall VAO
-    unsigned int plane3VAO, plane3VBO;
-    glGenVertexArrays(1, &plane3VAO);
-    glGenBuffers(1, &plane3VBO);
-    glBindVertexArray(plane3VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, plane3VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(plane3Vertices), plane3Vertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glBindVertexArray(0);
-
-    // right wall VAO
-    unsigned int plane4VAO, plane4VBO;
-    glGenVertexArrays(1, &plane4VAO);
-    glGenBuffers(1, &plane4VBO);
-    glBindVertexArray(plane4VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, plane4VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(plane4Vertices), plane4Vertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glBindVertexArray(0);
-
-    // ceiling VAO
-    unsigned int plane5VAO, plane5VBO;
-    glGenVertexArrays(1, &plane5VAO);
-    glGenBuffers(1, &plane5VBO);
-    glBindVertexArray(plane5VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, plane5VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(plane5Vertices), plane5Vertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glBindVertexArray(0);
-
-    // back wall VAO
-    unsigned int plane6VAO, plane6VBO;
-    glGenVertexArrays(1, &plane6VAO);
-    glGenBuffers(1, &plane6VBO);
-    glBindVertexArray(plane6VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, plane6VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(plane6Vertices), plane6Vertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glBindVertexArray(0);
-
-    // use the cook torrance shader and define each of the maps as locations
-    shader.use();
-    shader.setInt("albedoMap", 0);
-    shader.setInt("normalMap", 1);
-    shader.setInt("metallicMap", 2);
-    shader.setInt("roughnessMap", 3);
-    shader.setInt("aoMap", 4);
-
-    // load PBR material textures
-    // celtic gold
-    unsigned int goldAlbedo    = loadTexture("ornate-celtic-gold-bl/ornate-celtic-gold-albedo.png");
-    unsigned int goldNormal    = loadTexture("ornate-celtic-gold-bl/ornate-celtic-gold-normal-ogl.png");
-    unsigned int goldMetallic  = loadTexture("ornate-celtic-gold-bl/ornate-celtic-gold-metallic.png");
-    unsigned int goldRoughness = loadTexture("ornate-celtic-gold-bl/ornate-celtic-gold-roughness.png");
-    unsigned int goldAO        = loadTexture("ornate-celtic-gold-bl/ornate-celtic-gold-ao.png");
-
-    // floor and walls
-    unsigned int floorAlbedo    = loadTexture("hardwood-brown-planks-bl/hardwood-brown-planks-albedo.png");
-    unsigned int floorNormal    = loadTexture("hardwood-brown-planks-bl/hardwood-brown-planks-normal-ogl.png");
-    unsigned int floorMetallic  = loadTexture("hardwood-brown-planks-bl/hardwood-brown-planks-metallic.png");
-    unsigned int floorRoughness = loadTexture("hardwood-brown-planks-bl/hardwood-brown-planks-roughness.png");
-    unsigned int floorAO        = loadTexture("hardwood-brown-planks-bl/hardwood-brown-planks-ao.png");
-
-    // ceiling
-    unsigned int ceilingAlbedo    = loadTexture("sprayed-wall-texture1-bl/sprayed-wall-texture1_albedo.png");
-    unsigned int ceilingNormal    = loadTexture("sprayed-wall-texture1-bl/sprayed-wall-texture1_normal-ogl.png");
-    unsigned int ceilingMetallic  = loadTexture("sprayed-wall-texture1-bl/sprayed-wall-texture1_metallic.png");
-    unsigned int ceilingRoughness = loadTexture("sprayed-wall-texture1-bl/sprayed-wall-texture1_roughness.png");
-    unsigned int ceilingAO        = loadTexture("sprayed-wall-texture1-bl/sprayed-wall-texture1_ao.png");
-
-    // bricks - CookTorrance
-    unsigned int bricksAlbedo    = loadTexture("castle-bricks/castle_brick_wall_29_16_diffuse.jpg");
-    unsigned int bricksNormal    = loadTexture("castle-bricks/castle_brick_wall_29_16_normal.jpg");
-    unsigned int bricksMetallic  = loadTexture("castle-bricks/castle_brick_wall_29_16_metalness.jpg");
-    unsigned int bricksRoughness = loadTexture("castle-bricks/castle_brick_wall_29_16_roughness.jpg");
-    unsigned int bricksAO        = loadTexture("castle-bricks/castle_brick_wall_29_16_ao.jpg");
-
-    // chair 
-    unsigned int chairAlbedo    = loadTexture("chair/source/stul/Albedo.png");
-    unsigned int chairNormal    = loadTexture("chair/source/stul/Normal.png");
-    unsigned int chairMetallic  = loadTexture("hardwood-brown-planks-bl/hardwood-brown-planks-metallic.png");
-    unsigned int chairRoughness = loadTexture("chair/source/stul/Specular.png");
-    unsigned int chairAO        = loadTexture("chair/source/stul/AO.png");
-
-    // change to Phong for the concrete ball and brick ball
-    phongShader.use();
-    phongShader.setInt("brickTexture", 0);
-
-    // bricks
-    unsigned int concretePhongAlbedo = loadTexture("PolishedConcrete01_MR_4K/PolishedConcrete01_4K_BaseColor.png");
-    unsigned int bricksPhongAlbedo = loadTexture("castle-bricks/castle_brick_wall_29_16_diffuse.jpg");
-
-    // light positions and colour (all the same colour
-    glm::vec3 lightPositions[] = {
-        glm::vec3(0.0f, 6.0f, 7.5f),
-        glm::vec3(-7.5f, 6.0f, 0.0f),
-        glm::vec3(7.5f, 6.0f, 0.0f),
-        glm::vec3(0.0f, 6.0f, -7.5f)
-    };
-    glm::vec3 lightColors[] = {
-        glm::vec3(150.0f, 150.0f, 150.0f),
-    };
+// renders the scene into the window until it is closed
+int runWindow(GLFWwindow *window)
+{
+    // a played back path is recorded again from scratch so the output matches what was rendered
+    CameraPath recordedPath(cameraPath.Timestep);
 
-    // set the projection matrix in the CT shader
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    shader.use();
-    shader.setMat4("projection", projection);
+    // configure global opengl state
+    glEnable(GL_DEPTH_TEST);
 
+    // build and compile the shaders, load the chair model and upload the room geometry and PBR materials
+    Scene scene;
+    // the shader files are watched once their variants are compiled
+    ShaderWatcher shaderWatcher;
+    unsigned int watchedShaderSources = 0;
+
+    // GPU pass timing is reported together with the CPU scopes
+    if (printProfile)
+        GpuTimer::Get().Init();
+    if (countGl)
+        GlCallCounter::Get().Install();
+
+    // frames are captured at the framebuffer size the window opened with
+    FrameCapture capture;
+    if (!captureOutput.empty())
+    {
+        int captureWidth, captureHeight;
+        glfwGetFramebufferSize(window, &captureWidth, &captureHeight);
+        if (!capture.Start(captureOutput, captureWidth, captureHeight))
+            return -1;
+    }
 
     // render loop
+    float lastProfilePrint = 0.0f;
     while (!glfwWindowShouldClose(window))
     {
+        GpuTimer::Get().BeginFrame();
+        GlCallCounter::Get().BeginFrame();
         // per-frame time logic
         float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
+        float frameTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        // input
-        processInput(window);
+        {
+            RENDER_PASS("frame");
 
-        // render
-        glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            // input - either live from the keyboard with the measured frame time, or from the path with a fixed timestep
+            unsigned int keys;
+            {
+                PROFILE_SCOPE("input");
+                if (playPath)
+                {
+                    if (playbackFrame > 0)
+                        playbackTime += frameTime;
+                    if (playbackFrame >= cameraPath.Frames.size())
+                        break;
+                    const CameraFrame &frame = cameraPath.Frames[playbackFrame++];
+                    deltaTime = cameraPath.Timestep;
+                    keys = frame.Keys;
+                    applyInput(keys);
+                    camera.SetPose(frame.Position, frame.Yaw, frame.Pitch, frame.Zoom);
+                    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+                        glfwSetWindowShouldClose(window, true);
+                }
+                else
+                {
+                    deltaTime = frameTime;
+                    keys = processInput(window);
+                    applyInput(keys);
+                }
+                if (recordPath)
+                    recordedPath.Record(camera, keys);
+            }
 
+            // the jobs that need the GL context
+            JobSystem::Get().PumpMainThread();
+
+            // shaders edited since the last frame start compiling, and those done are swapped in before drawing
+            if (hotReload)
+            {
+                PROFILE_SCOPE("shaders.reload");
+                std::vector<std::string> changed = shaderWatcher.Poll();
+                if (!changed.empty())
+                    scene.ReloadShaders(changed);
+                scene.UpdateShaders();
+                // variants are compiled as they are first drawn and a reload can change what they include, so the
+                // files are looked up again only when either happened
+                if (scene.ShaderSourcesVersion() != watchedShaderSources)
+                {
+                    watchedShaderSources = scene.ShaderSourcesVersion();
+                    std::vector<std::string> sources = scene.ShaderSources();
+                    for (size_t i = 0; i < sources.size(); i++)
+                        shaderWatcher.Watch(sources[i]);
+                }
+            }
 
-        // render lights for each position
-        for (unsigned int i = 0; i < sizeof(lightPositions) / sizeof(lightPositions[0]); ++i) {
-            shader.setVec3("lightPositions[" + std::to_string(i) + "]", lightPositions[i]);
-            shader.setVec3("lightColors[" + std::to_string(i) + "]", lightColors[0]);
-        }
-        
-        // using CT shader
-        shader.use();
-        // set the view, camPos
-        glm::mat4 view = camera.GetViewMatrix();
-        shader.setMat4("view", view);
-        shader.setVec3("camPos", camera.Position);
-
-        // set the model to the floor
-        glm::mat4 floorModel = glm::mat4(1.0f);
-        shader.setMat4("model", floorModel);
-        
-        // floor
-        glBindVertexArray(planeVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, floorAlbedo);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, floorNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, floorMetallic);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, floorRoughness);
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, floorAO);   
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        // back wall
-        glBindVertexArray(plane2VAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, floorAlbedo);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, floorNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, floorMetallic);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, floorRoughness);
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, floorAO);   
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        // left wall
-        glBindVertexArray(plane3VAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, floorAlbedo);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, floorNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, floorMetallic);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, floorRoughness);
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, floorAO);   
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        // right wall
-        glBindVertexArray(plane4VAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, floorAlbedo);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, floorNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, floorMetallic);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, floorRoughness);
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, floorAO);   
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-         // behind user wall
-        glBindVertexArray(plane6VAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, floorAlbedo);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, floorNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, floorMetallic);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, floorRoughness);
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, floorAO);   
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        // ceiling
-        glBindVertexArray(plane5VAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, ceilingAlbedo);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, ceilingNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, ceilingMetallic);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, ceilingRoughness);
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, ceilingAO);   
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        // next model
-        // apply celtic gold textures
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, goldAlbedo);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, goldNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, goldMetallic);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, goldRoughness);
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, goldAO);
-
-        // draw the celtic gold sphere
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(3.0, 0.5, 0.0));
-        model = glm::rotate(model, glm::radians(sphereRotator), glm::vec3(0.0f, 1.0f, 0.0f));
-        shader.setMat4("model", model);
-        renderSphere();
-
-        // draw a celtic gold chair
-        glm::mat4 goldChair = glm::mat4(1.0f);
-        goldChair = glm::translate(goldChair, glm::vec3(-7.0, -0.5, -8.0));
-        goldChair = glm::scale(goldChair, glm::vec3(0.05, 0.05, 0.05));
-        goldChair = glm::rotate(goldChair, 90.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-        goldChair = glm::translate(goldChair, glm::vec3(0.0, 0.0, 0.0));
-        shader.setMat4("model", goldChair);
-        chairModel.Draw(shader);
-
-        // apply brick textures
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, bricksAlbedo);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, bricksNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, bricksMetallic);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, bricksRoughness);
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, bricksAO); 
-
-        // draw the brick sphere - CT
-        glm::mat4 brickModelCT = glm::mat4(1.0f);
-        brickModelCT = glm::translate(brickModelCT, glm::vec3(0.0, 0.5, 0.0));
-        brickModelCT = glm::rotate(brickModelCT, glm::radians(brickSphereRotator), glm::vec3(0.0f, 1.0f, 0.0f));
-        shader.setMat4("model", brickModelCT);
-        renderSphere();
-
-        // draw a brick chair
-        glm::mat4 brickChair = glm::mat4(1.0f);
-        brickChair = glm::translate(brickChair, glm::vec3(-4.5, -0.5, -8.0));
-        brickChair = glm::scale(brickChair, glm::vec3(0.05, 0.05, 0.05));
-        brickChair = glm::rotate(brickChair, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        brickChair = glm::translate(brickChair, glm::vec3(0.0, 0.0, 0.0));
-        shader.setMat4("model", brickChair);
-        chairModel.Draw(shader);
-
-        // apply chair textures
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, chairAlbedo);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, chairNormal);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, chairMetallic);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, chairRoughness);
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, chairAO); 
-
-        // draw the chair
-        glm::mat4 chairMod = glm::mat4(1.0f);
-        chairMod = glm::translate(chairMod, glm::vec3(-2.0, -0.5, -8.0));
-        chairMod = glm::scale(chairMod, glm::vec3(0.05, 0.05, 0.05));
-        chairMod = glm::rotate(chairMod, glm::radians(70.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        chairMod = glm::translate(chairMod, glm::vec3(0.0, 0.0, 0.0));
-        shader.setMat4("model", chairMod);
-        chairModel.Draw(shader);
-
-        // Start Phong now
-        phongShader.use();
-        phongShader.setMat4("projection", projection);
-        phongShader.setMat4("view", view);
-        phongShader.setVec3("viewPos", camera.Position);
-        // for each light pass it
-        for (unsigned int i = 0; i < sizeof(lightPositions) / sizeof(lightPositions[0]); ++i) {
-            phongShader.setVec3("lightPositions[" + std::to_string(i) + "]", lightPositions[i]);
-        }
-        // pass the boolean for whether to use blinn or BP
-        phongShader.setInt("blinn", blinn);
-
-        // set the texture and draw the concrete
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, concretePhongAlbedo);
-        glm::mat4 concreteModel = glm::mat4(1.0f);
-        concreteModel = glm::translate(concreteModel, glm::vec3(-6.0, 0.5, 0.0));
-        concreteModel = glm::rotate(concreteModel, glm::radians(phongSphere2Rotator), glm::vec3(0.0f, 1.0f, 0.0f));
-        phongShader.setMat4("model", concreteModel);
-        // set shininess, diffuse and specular values for the material
-        phongShader.setFloat("shininess", 32.0f);
-        phongShader.setVec3("materialDiffuse", glm::vec3(0.8f));
-        phongShader.setVec3("materialSpecular", glm::vec3(0.3f));
-        renderSphere();
-
-        // draw a brick sphere with Phong also
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, bricksPhongAlbedo);
-        glm::mat4 bricksPhongModel = glm::mat4(1.0f);
-        bricksPhongModel = glm::translate(bricksPhongModel, glm::vec3(-3.0, 0.5, 0.0));
-        bricksPhongModel = glm::rotate(bricksPhongModel, glm::radians(phongSphereRotator), glm::vec3(0.0f, 1.0f, 0.0f));
-        phongShader.setMat4("model", bricksPhongModel);
-        // set shininess, diffuse and specular values for the material
-        phongShader.setFloat("shininess",4.0f);
-        phongShader.setVec3("materialDiffuse", glm::vec3(0.3f));
-        phongShader.setVec3("materialSpecular", glm::vec3(0.1f));
-        renderSphere();
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        shader.use();
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+            // render, with the projection of this frame's zoom
+            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+            glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            scene.Draw(camera, sceneState, projection);
+            capture.Capture();
+
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+            {
+                PROFILE_SCOPE("present");
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+            }
+        }
+        Profiler::Get().EndFrame();
+        GpuTimer::Get().Resolve();
+        GlCallCounter::Get().EndFrame();
+        GpuResources::Get().EndFrame();
+
+        // rolling per-scope breakdown every two seconds
+        if ((printProfile || countGl) && currentFrame - lastProfilePrint > 2.0f)
+        {
+            if (printProfile)
+            {
+                Profiler::Get().PrintBreakdown();
+                GpuTimer::Get().PrintStats();
+                GpuTimer::Get().Reset();
+                if (scene.streaming)
+                    scene.streamer.PrintStats();
+                scene.entities.PrintStats();
+                scene.cookTorranceShaders.PrintStats();
+                scene.phongShaders.PrintStats();
+                JobSystem::Get().PrintStats();
+                JobSystem::Get().ResetStats();
+                GpuResources::Get().PrintStats();
+            }
+            if (countGl)
+            {
+                GlCallCounter::Get().PrintStats();
+                GlCallCounter::Get().Reset();
+            }
+            lastProfilePrint = currentFrame;
+        }
     }
 
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    glfwTerminate();
+    capture.Finish();
+
+    // report the played back frame times and write out the recording
+    if (playPath && playbackFrame > 1)
+        std::cout << "Played " << playbackFrame << " frames, mean frame time " << playbackTime / (playbackFrame - 1) * 1000.0 << " ms" << std::endl;
+    if (recordPath)
+        recordedPath.Save(recordFile);
+    if (!traceFile.empty())
+        Profiler::Get().WriteChromeTrace(traceFile);
     return 0;
 }
 
-// key presses
-void processInput(GLFWwindow *window) {
+// key presses - returns the scene keys held this frame as an Input_Key mask
+unsigned int processInput(GLFWwindow *window) {
+    unsigned int keys = 0;
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.Position = camera.Position + glm::vec3(0.0f, 0.05f, 0.0f);
+        keys |= INPUT_CAMERA_UP;
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.Position = camera.Position - glm::vec3(0.0f, 0.05f, 0.0f);
+        keys |= INPUT_CAMERA_DOWN;
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
+        keys |= INPUT_CAMERA_LEFT;
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+        keys |= INPUT_CAMERA_RIGHT;
     if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
+        keys |= INPUT_CAMERA_FORWARD;
     if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
+        keys |= INPUT_CAMERA_BACK;
     if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
-        sphereRotator = sphereRotator+1;
+        keys |= INPUT_ROTATE_GOLD;
     if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS)
-        brickSphereRotator = brickSphereRotator+1;
+        keys |= INPUT_ROTATE_BRICK;
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        phongSphereRotator = phongSphereRotator+1;
+        keys |= INPUT_ROTATE_PHONG;
     if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS)
-        phongSphere2Rotator = phongSphere2Rotator+1;
-    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS && !blinnPressed) {
-        blinn = !blinn;
+        keys |= INPUT_ROTATE_PHONG2;
+    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
+        keys |= INPUT_TOGGLE_BLINN;
+    return keys;
+}
+
+// applies a frame's key state to the camera and scene, shared by live input and path playback
+void applyInput(unsigned int keys) {
+    if (keys & INPUT_CAMERA_UP)
+        camera.Position = camera.Position + glm::vec3(0.0f, 0.05f, 0.0f);
+    if (keys & INPUT_CAMERA_DOWN)
+        camera.Position = camera.Position - glm::vec3(0.0f, 0.05f, 0.0f);
+    if (keys & INPUT_CAMERA_LEFT)
+        camera.ProcessKeyboard(LEFT, deltaTime);
+    if (keys & INPUT_CAMERA_RIGHT)
+        camera.ProcessKeyboard(RIGHT, deltaTime);
+    if (keys & INPUT_CAMERA_FORWARD)
+        camera.ProcessKeyboard(FORWARD, deltaTime);
+    if (keys & INPUT_CAMERA_BACK)
+        camera.ProcessKeyboard(BACKWARD, deltaTime);
+    if (keys & INPUT_ROTATE_GOLD)
+        sceneState.spins[SPIN_SPHERE] = sceneState.spins[SPIN_SPHERE]+1;
+    if (keys & INPUT_ROTATE_BRICK)
+        sceneState.spins[SPIN_BRICK_SPHERE] = sceneState.spins[SPIN_BRICK_SPHERE]+1;
+    if (keys & INPUT_ROTATE_PHONG)
+        sceneState.spins[SPIN_PHONG_SPHERE] = sceneState.spins[SPIN_PHONG_SPHERE]+1;
+    if (keys & INPUT_ROTATE_PHONG2)
+        sceneState.spins[SPIN_PHONG_SPHERE2] = sceneState.spins[SPIN_PHONG_SPHERE2]+1;
+    if ((keys & INPUT_TOGGLE_BLINN) && !blinnPressed) {
+        sceneState.blinn = !sceneState.blinn;
         blinnPressed = true;
     }
-    if(glfwGetKey(window, GLFW_KEY_P) == GLFW_RELEASE)
+    if (!(keys & INPUT_TOGGLE_BLINN))
         blinnPressed = false;
 }
 
@@ -605,6 +594,10 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
 
 // glfw: whenever the mouse moves, this callback is called
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn) {
+    // the camera orientation comes from the path while it is playing
+    if (playPath)
+        return;
+
     float xpos = static_cast<float>(xposIn);
     float ypos = static_cast<float>(yposIn);
 
@@ -629,123 +622,437 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
 
-// renders and creates a sphere
-unsigned int sphereVAO = 0;
-unsigned int indexCount;
-void renderSphere() {
-    if (sphereVAO == 0) {
-        glGenVertexArrays(1, &sphereVAO);
-
-        unsigned int vbo, ebo;
-        glGenBuffers(1, &vbo);
-        glGenBuffers(1, &ebo);
-
-        std::vector<glm::vec3> positions;
-        std::vector<glm::vec2> uv;
-        std::vector<glm::vec3> normals;
-        std::vector<unsigned int> indices;
-
-        const unsigned int X_SEGMENTS = 64;
-        const unsigned int Y_SEGMENTS = 64;
-        const float PI = 3.14159265359f;
-        for (unsigned int x = 0; x <= X_SEGMENTS; ++x) {
-            for (unsigned int y = 0; y <= Y_SEGMENTS; ++y) {
-                float xSegment = (float)x / (float)X_SEGMENTS;
-                float ySegment = (float)y / (float)Y_SEGMENTS;
-                float xPos = std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-                float yPos = std::cos(ySegment * PI);
-                float zPos = std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-
-                positions.push_back(glm::vec3(xPos, yPos, zPos));
-                uv.push_back(glm::vec2(xSegment, ySegment));
-                normals.push_back(glm::vec3(xPos, yPos, zPos));
+// renders frames of the camera path into an offscreen framebuffer and reports frame time statistics as JSON
+int runBenchmark(unsigned int frames, int width, int height, const std::string &jsonPath) {
+    // the per-scope breakdown is part of the report
+    Profiler::Get().enabled = true;
+
+    // destroyed last, once the scene and framebuffer have released their objects
+    OffscreenContext context;
+    if (!context.Create())
+        return -1;
+
+    // the window is created with 4x multisampling, so the benchmark renders with the same
+    Framebuffer framebuffer;
+    if (!framebuffer.Create(width, height, 4))
+        return -1;
+
+    glEnable(GL_DEPTH_TEST);
+    Scene scene;
+
+    // without a recorded path the built-in flythrough is used, and the path repeats if more frames are requested
+    if (!playPath)
+        cameraPath = CameraPath::Flythrough(frames > 0 ? frames : 1200);
+    if (frames == 0)
+        frames = (unsigned int)cameraPath.Frames.size();
+    deltaTime = cameraPath.Timestep;
+
+    // GPU frame and pass times come from the timestamp query ring, read back a few frames late
+    const unsigned int WARMUP_FRAMES = 10;
+    GpuTimer &gpuTimer = GpuTimer::Get();
+    gpuTimer.Init();
+
+    // the counting hooks add some CPU time per call, so they are only installed on request
+    GlCallCounter &glCounter = GlCallCounter::Get();
+    if (countGl)
+        glCounter.Install();
+
+    FrameCapture capture;
+    if (!captureOutput.empty() && !capture.Start(captureOutput, width, height))
+        return -1;
+
+    BenchmarkResults results;
+    // the scene file's name without its directory and extension
+    size_t slash = sceneFile.find_last_of('/'), dot = sceneFile.find_last_of('.');
+    size_t stemStart = slash == std::string::npos ? 0 : slash + 1;
+    results.scene = sceneFile.substr(stemStart, dot == std::string::npos || dot < stemStart ? std::string::npos : dot - stemStart);
+    results.width = width;
+    results.height = height;
+    results.renderer = (const char *)glGetString(GL_RENDERER);
+
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point lastStart = Clock::now();
+    for (unsigned int i = 0; i < WARMUP_FRAMES + frames; i++)
+    {
+        if (i == WARMUP_FRAMES)
+        {
+            // drop everything measured while warming up
+            gpuTimer.Flush();
+            gpuTimer.Reset();
+            glCounter.Reset();
+            JobSystem::Get().ResetStats();
+        }
+        Clock::time_point start = Clock::now();
+        gpuTimer.BeginFrame();
+        glCounter.BeginFrame();
+        {
+            RENDER_PASS("frame");
+            const CameraFrame &frame = cameraPath.Frames[i % cameraPath.Frames.size()];
+            applyInput(frame.Keys);
+            camera.SetPose(frame.Position, frame.Yaw, frame.Pitch, frame.Zoom);
+            JobSystem::Get().PumpMainThread();
+
+            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)width / (float)height, 0.1f, 100.0f);
+            framebuffer.Bind();
+            glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            scene.Draw(camera, sceneState, projection);
+            if (capture.Active())
+            {
+                framebuffer.Resolve();
+                capture.Capture();
             }
         }
+        glFlush();
+        Profiler::Get().EndFrame();
+        gpuTimer.Resolve();
+        glCounter.EndFrame();
+        GpuResources::Get().EndFrame();
+
+        Clock::time_point end = Clock::now();
+        if (i >= WARMUP_FRAMES)
+        {
+            double cpuMs = std::chrono::duration<double, std::milli>(end - start).count();
+            double wallMs = std::chrono::duration<double, std::milli>(start - lastStart).count();
+            results.AddFrame(cpuMs, i == WARMUP_FRAMES ? cpuMs : wallMs, scene.stats.drawCalls, scene.stats.triangles);
+        }
+        lastStart = start;
+    }
 
-        bool oddRow = false;
-        for (unsigned int y = 0; y < Y_SEGMENTS; ++y) {
-            // even rows: y == 0, y == 2; and so on
-            if (!oddRow) {
-                for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
-                {
-                    indices.push_back(y * (X_SEGMENTS + 1) + x);
-                    indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-                }
-            }
-            else {
-                for (int x = X_SEGMENTS; x >= 0; --x) {
-                    indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-                    indices.push_back(y * (X_SEGMENTS + 1) + x);
-                }
-            }
-            oddRow = !oddRow;
-        }
-        indexCount = static_cast<unsigned int>(indices.size());
-
-        std::vector<float> data;
-        for (unsigned int i = 0; i < positions.size(); ++i) {
-            data.push_back(positions[i].x);
-            data.push_back(positions[i].y);
-            data.push_back(positions[i].z);
-            if (normals.size() > 0) {
-                data.push_back(normals[i].x);
-                data.push_back(normals[i].y);
-                data.push_back(normals[i].z);
-            }
-            if (uv.size() > 0) {
-                data.push_back(uv[i].x);
-                data.push_back(uv[i].y);
+    // collect the queries still in flight
+    capture.Finish();
+    gpuTimer.Flush();
+    const std::vector<double> &gpuFrames = gpuTimer.History("frame");
+    for (unsigned int i = 0; i < gpuFrames.size(); i++)
+        results.AddGpuFrame(gpuFrames[i]);
+    results.AddSection("cpu_scopes", Profiler::Get().BreakdownJson(frames));
+    results.AddSection("gpu_passes", gpuTimer.StatsJson());
+    if (scene.streaming)
+        results.AddSection("texture_streaming", scene.streamer.StatsJson());
+    results.AddSection("entities", scene.entities.StatsJson());
+    results.AddSection("cook_torrance_variants", scene.cookTorranceShaders.StatsJson());
+    results.AddSection("phong_variants", scene.phongShaders.StatsJson());
+    results.AddSection("job_system", JobSystem::Get().StatsJson());
+    results.AddSection("gpu_resources", GpuResources::Get().StatsJson());
+    gpuTimer.Destroy();
+    if (countGl)
+    {
+        results.AddSection("gl_calls", glCounter.StatsJson());
+        glCounter.Uninstall();
+    }
+
+    std::cout << results.ToJson();
+    if (!jsonPath.empty() && !results.Save(jsonPath))
+        return -1;
+
+    return 0;
+}
+
+// the first frame of the camera path, or the default view, is the one rendered by the CPU renderers
+void applyFirstPathFrame()
+{
+    if (!playPath || cameraPath.Frames.empty() || playbackFrame > 0)
+        return;
+    const CameraFrame &frame = cameraPath.Frames[playbackFrame++];
+    applyInput(frame.Keys);
+    camera.SetPose(frame.Position, frame.Yaw, frame.Pitch, frame.Zoom);
+}
+
+// renders a single frame with the CPU rasterizer, without any GL context
+int runSoftRasterizer(const std::string &imagePath, int width, int height)
+{
+    Scene scene(false);
+    applyFirstPathFrame();
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)width / (float)height, 0.1f, 100.0f);
+
+    SoftRasterizer rasterizer(width, height);
+    rasterizer.Render(scene, camera, sceneState, projection);
+    std::cout << "Software rasterizer: " << width << "x" << height << " in " << rasterizer.stats.ms << " ms on " << rasterizer.threadCount
+              << " threads, " << rasterizer.stats.triangles << " triangles, " << rasterizer.stats.fragments << " fragments" << std::endl;
+    return rasterizer.Save(imagePath) ? 0 : -1;
+}
+
+// renders a single frame with the path tracer as the reference for the rasterized BRDFs
+int runPathTracer(const std::string &imagePath, int width, int height)
+{
+    Scene scene(false);
+    applyFirstPathFrame();
+
+    PathTracer tracer(width, height);
+    tracer.samples = std::max(1u, traceSamples);
+    tracer.maxBounces = traceBounces;
+    tracer.Render(scene, camera, sceneState);
+    std::cout << "Path tracer: " << width << "x" << height << " at " << tracer.samples << " spp in " << tracer.ms / 1000.0 << " s on "
+              << tracer.threadCount << " threads, " << tracer.rays / (tracer.ms * 1000.0) << " Mrays/s" << std::endl;
+    return tracer.Save(imagePath) ? 0 : -1;
+}
+
+// renders every job of the jobs file into its own image, sharing one context, scene and framebuffer
+int runBatch(const std::string &jobsPath, int width, int height)
+{
+    std::vector<BatchJob> jobs;
+    if (!BatchRenderer::LoadJobs(jobsPath, jobs))
+        return -1;
+
+    // destroyed last, once the scene and framebuffer have released their objects
+    OffscreenContext context;
+    if (!context.Create())
+        return -1;
+    Framebuffer framebuffer;
+    if (!framebuffer.Create(width, height, 4))
+        return -1;
+
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point start = Clock::now();
+    glEnable(GL_DEPTH_TEST);
+    Scene scene;
+    BatchRenderer renderer(scene, framebuffer);
+    double setupMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    unsigned int failed = 0;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        Clock::time_point jobStart = Clock::now();
+        if (!renderer.Render(jobs[i]))
+            failed++;
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - jobStart).count();
+        std::cout << jobs[i].output << ": " << ms << " ms" << std::endl;
+    }
+    double totalMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::cout << "Batch: " << jobs.size() - failed << " of " << jobs.size() << " images at " << width << "x" << height << " in " << totalMs
+              << " ms, " << setupMs << " ms of it loading the scene" << std::endl;
+
+    return failed == 0 ? 0 : -1;
+}
+
+void printDiff(const std::string &name, const ImageDiffResult &result)
+{
+    std::cout << name << ": RMSE " << result.rmse << ", PSNR " << result.psnr << " dB, FLIP mean " << result.meanFlip << " max "
+              << result.maxFlip << std::endl;
+}
+
+// compares two image files, optionally writing the FLIP error map
+int runDiff(const std::string &testPath, const std::string &referencePath)
+{
+    ImageDiff diff;
+    ImageDiffResult result;
+    if (!diff.CompareFiles(testPath, referencePath, result))
+        return -1;
+    printDiff(testPath, result);
+    if (!diffHeatmap.empty() && !diff.SaveErrorMap(diffHeatmap))
+        return -1;
+    return 0;
+}
+
+// renders key views of the scene offscreen and compares them with the images of the same name in the golden
+// directory. Views over the error thresholds are written next to them as <view>.fail.png with their FLIP error map
+// as <view>.flip.png, and a missing golden image fails its view. With --update-goldens the views are written as the
+// golden images instead. Returns 1 if any view failed or could not be written.
+int runRegression(const std::string &goldenDir, int width, int height)
+{
+    struct RegressionView {
+        const char *name;
+        // position along the flythrough, from 0 to 1
+        float pathPosition;
+        bool blinn;
+    };
+    const RegressionView views[] = {
+        {"start", 0.0f, false},
+        {"start_blinn", 0.0f, true},
+        {"spheres", 0.25f, false},
+        {"chair", 0.5f, false},
+        {"corner", 0.75f, false},
+    };
+
+    // destroyed last, once the scene and framebuffer have released their objects
+    OffscreenContext context;
+    if (!context.Create())
+        return -1;
+    Framebuffer framebuffer;
+    if (!framebuffer.Create(width, height, 4))
+        return -1;
+    glEnable(GL_DEPTH_TEST);
+    Scene scene;
+    CameraPath path = CameraPath::Flythrough();
+
+    ImageDiff diff;
+    std::vector<unsigned char> pixels((size_t)width * height * 3), image(pixels.size());
+    size_t row = (size_t)width * 3;
+    unsigned int failed = 0;
+    for (const RegressionView &view : views)
+    {
+        const CameraFrame &frame = path.Frames[(size_t)(view.pathPosition * (path.Frames.size() - 1))];
+        Camera viewCamera;
+        viewCamera.SetPose(frame.Position, frame.Yaw, frame.Pitch, frame.Zoom);
+        glm::mat4 projection = glm::perspective(glm::radians(viewCamera.Zoom), (float)width / (float)height, 0.1f, 100.0f);
+        SceneState state;
+        state.blinn = view.blinn;
+
+        framebuffer.Bind();
+        glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        scene.Draw(viewCamera, state, projection);
+        framebuffer.Resolve();
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+        // image files start at the top row
+        for (int y = 0; y < height; y++)
+            std::copy(pixels.begin() + (height - 1 - y) * row, pixels.begin() + (height - y) * row, image.begin() + y * row);
+
+        std::string golden = goldenDir + "/" + view.name;
+        if (updateGoldens)
+        {
+            std::cout << view.name << ": writing " << golden << ".png" << std::endl;
+            if (!stbi_write_png((golden + ".png").c_str(), width, height, 3, &image[0], (int)row))
+            {
+                std::cout << "ERROR::REGRESSION::CANNOT_WRITE: " << golden << ".png" << std::endl;
+                failed++;
             }
+            continue;
+        }
+        int goldenWidth, goldenHeight, goldenChannels;
+        unsigned char *reference = stbi_load((golden + ".png").c_str(), &goldenWidth, &goldenHeight, &goldenChannels, 3);
+        bool pass = false;
+        if (!reference)
+            std::cout << view.name << ": no golden image " << golden << ".png, --update-goldens writes it" << std::endl;
+        else if (goldenWidth != width || goldenHeight != height)
+            std::cout << view.name << ": golden image is " << goldenWidth << "x" << goldenHeight << std::endl;
+        else
+        {
+            ImageDiffResult result = diff.Compare(&image[0], reference, width, height);
+            printDiff(view.name, result);
+            pass = result.meanFlip <= maxMeanFlip && result.psnr >= minPsnr;
+            if (!pass)
+                diff.SaveErrorMap(golden + ".flip.png");
+        }
+        stbi_image_free(reference);
+        if (!pass)
+        {
+            std::cout << "ERROR::REGRESSION::VIEW_FAILED: " << view.name << " (FLIP mean <= " << maxMeanFlip << ", PSNR >= " << minPsnr << " dB)" << std::endl;
+            if (!stbi_write_png((golden + ".fail.png").c_str(), width, height, 3, &image[0], (int)row))
+                std::cout << "ERROR::REGRESSION::CANNOT_WRITE: " << golden << ".fail.png" << std::endl;
+            failed++;
         }
-        glBindVertexArray(sphereVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-        unsigned int stride = (3 + 2 + 3) * sizeof(float);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
     }
+    if (updateGoldens)
+        std::cout << (sizeof(views) / sizeof(views[0]) - failed) << " of " << sizeof(views) / sizeof(views[0]) << " golden images written" << std::endl;
+    else
+        std::cout << (sizeof(views) / sizeof(views[0]) - failed) << " of " << sizeof(views) / sizeof(views[0]) << " views passed" << std::endl;
 
-    glBindVertexArray(sphereVAO);
-    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
+    return failed > 0 ? 1 : 0;
 }
 
-// function to load textures
-unsigned int loadTexture(char const * path) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
+// every texture image the scene loads, each once, with the kind it is cooked as
+std::vector<std::pair<std::string, TextureKind> > sceneTextures(const Scene &scene)
+{
+    std::vector<std::pair<std::string, TextureKind> > textures;
+    for (size_t i = 0; i < scene.pbrMaterials.size(); i++)
+        for (int map = 0; map < PBR_MAP_COUNT; map++)
+            textures.push_back(std::make_pair(scene.pbrMaterials[i].paths[map], PBR_MAP_KINDS[map]));
+    for (size_t i = 0; i < scene.phongMaterials.size(); i++)
+        textures.push_back(std::make_pair(scene.phongMaterials[i].albedoPath, TEXTURE_COLOR_RAW));
+    // the models' own maps, which Model loads through TextureFromFile
+    for (size_t m = 0; m < scene.models.size(); m++)
+    {
+        const Model &model = scene.models[m];
+        for (size_t i = 0; i < model.textures_loaded.size(); i++)
+        {
+            const Texture &texture = model.textures_loaded[i];
+            TextureKind kind = TextureKindFromType(texture.type, model.gammaCorrection);
+            textures.push_back(std::make_pair(model.directory + '/' + texture.path, kind));
+        }
     }
-    else {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+    std::sort(textures.begin(), textures.end());
+    // an image used raw by Phong and as sRGB by Cook-Torrance is cooked to the same files once
+    textures.erase(std::unique(textures.begin(), textures.end(), [](const std::pair<std::string, TextureKind> &a, const std::pair<std::string, TextureKind> &b) {
+        return a.first == b.first;
+    }), textures.end());
+    return textures;
+}
+
+// encodes every texture of the scene's materials into the block format for its kind, and writes the cooked scene file
+int runCook()
+{
+    Scene scene(false);
+    if (!scene.description.SaveCooked(sceneFile))
+        return -1;
+    std::vector<std::pair<std::string, TextureKind> > textures = sceneTextures(scene);
+
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point start = Clock::now();
+    TextureCooker cooker;
+    unsigned int failed = 0;
+    for (size_t i = 0; i < textures.size(); i++)
+        if (!cooker.Cook(textures[i].first, textures[i].second))
+            failed++;
+    // the packed AO, roughness and metallic texture of each material
+    for (size_t i = 0; i < scene.pbrMaterials.size(); i++)
+    {
+        const PbrMaterial &material = scene.pbrMaterials[i];
+        PackedChannel channels[3] = {{material.paths[PBR_AO], 1.0f}, {material.paths[PBR_ROUGHNESS], 0.5f}, {material.paths[PBR_METALLIC], 0.0f}};
+        if (!cooker.CookPacked(material.ormPath, channels))
+            failed++;
     }
+    size_t total = textures.size() + scene.pbrMaterials.size();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << "Cooked " << total - failed << " of " << total << " textures in " << seconds << " s on " << cooker.threadCount
+              << " threads" << std::endl;
+    return failed == 0 ? 0 : -1;
+}
 
-    return textureID;
-}
\ No newline at end of file
+// writes the scene file, the shaders, every texture with its cooked files and the cooked models into one asset pack
+int runPack(const std::string &packPath)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    Clock::time_point start = Clock::now();
+    Scene scene(false);
+    AssetPackWriter writer;
+    std::vector<std::string> files;
+    // the shaders with the files they include
+    const char *shaders[] = {"cookTorrance.vs", "cookTorrance.fs", "phongShader.vs", "phongShader.fs"};
+    for (int i = 0; i < 4; i++)
+    {
+        ShaderSource source;
+        ShaderPreprocessor::Get().Expand(shaders[i], source);
+        for (size_t f = 0; f < source.files.size(); f++)
+            if (std::find(files.begin(), files.end(), source.files[f]) == files.end())
+                files.push_back(source.files[f]);
+    }
+    files.push_back(sceneFile);
+    // the cooked scene file only exists once --cook wrote it
+    if (AssetPack::Exists(sceneFile + ".bin"))
+        files.push_back(sceneFile + ".bin");
+    std::vector<std::pair<std::string, TextureKind> > textures = sceneTextures(scene);
+    // the packed AO, roughness and metallic textures only exist once --cook wrote them
+    for (size_t i = 0; i < scene.pbrMaterials.size(); i++)
+        if (AssetPack::Exists(scene.pbrMaterials[i].ormPath))
+            textures.push_back(std::make_pair(scene.pbrMaterials[i].ormPath, TEXTURE_ORM));
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        files.push_back(textures[i].first);
+        for (int format = 0; format < BLOCK_FORMAT_COUNT; format++)
+            if (TextureCooker::IsCooked(textures[i].first, (BlockFormat)format))
+                files.push_back(TextureCooker::CookedPath(textures[i].first, (BlockFormat)format));
+    }
+
+    unsigned int missing = 0;
+    for (size_t i = 0; i < files.size(); i++)
+        if (!writer.AddFile(files[i]))
+        {
+            std::cout << "ERROR::ASSET_PACK::FILE_NOT_FOUND: " << files[i] << std::endl;
+            missing++;
+        }
+    for (size_t i = 0; i < scene.models.size(); i++)
+        if (!scene.models[i].meshes.empty())
+            writer.AddBlob(scene.models[i].path + ".mesh", scene.models[i].Cook());
+
+    size_t bytes = 0;
+    if (!writer.Save(packPath, bytes))
+        return -1;
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << "Packed " << writer.Count() << " assets into " << packPath << ", " << bytes / (1024.0 * 1024.0) << " MB in " << seconds << " s";
+    if (missing)
+        std::cout << ", " << missing << " missing";
+    std::cout << std::endl;
+    return missing == 0 ? 0 : -1;
+}
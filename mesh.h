@@ -7,9 +7,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "gpuResources.h"
 
 #include <string>
 #include <vector>
+#include <utility>
 using namespace std;
 
 #define MAX_BONE_INFLUENCE 4
@@ -35,25 +37,61 @@ struct Texture {
     unsigned int id;
     string type;
     string path;
+    // shared by every mesh using the texture
+    GpuTexture resource;
 };
 
 class Mesh {
 public:
-    // mesh Data
+    // mesh Data, the vertices and indices are empty once ReleaseCpuData has freed them
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
     unsigned int VAO;
+    // the number of indices drawn, which stays when the CPU copy is released
+    unsigned int indexCount;
+    // the box around the vertices, which also stays
+    glm::vec3 boundsMin, boundsMax;
+
+    // constructor, upload is false when the mesh is only used on the CPU and there is no OpenGL context. The
+    // buffers are moved in, so pass them with std::move when the caller doesn't need them anymore.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool upload = true)
+        : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), VAO(0),
+          indexCount((unsigned int)this->indices.size())
+    {
+        computeBounds(this->vertices.data(), this->vertices.size());
+        // now that we have all the required data, set the vertex buffers and its attribute pointers.
+        if (upload)
+            setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+    }
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // uploads vertices and indices the mesh doesn't keep, like the ones of a cooked model in the asset pack
+    Mesh(const Vertex *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount, vector<Texture> textures)
+        : textures(std::move(textures)), VAO(0), indexCount((unsigned int)indexCount)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        computeBounds(vertices, vertexCount);
+        setupMesh(vertices, vertexCount, indices, indexCount);
+    }
 
-        // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+    // a mesh owns its vertex array and buffers, so it can be moved but not copied
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
+    Mesh(Mesh &&) = default;
+    Mesh &operator=(Mesh &&) = default;
+
+    // frees the CPU copy of the vertices and indices once they are on the GPU; the CPU renderers, Model::Cook and
+    // the texture streamer's bounds need it, so only models drawn with OpenGL alone release it
+    void ReleaseCpuData()
+    {
+        if (!VAO)
+            return;
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
+
+    bool HasCpuData() const
+    {
+        return indices.size() == indexCount;
     }
 
     // render the mesh
@@ -87,7 +125,7 @@ public:
         
         // draw mesh
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
@@ -95,16 +133,31 @@ public:
     }
 
 private:
-    // render data 
-    unsigned int VBO, EBO;
+    // render data, released with the mesh
+    GpuVertexArray vertexArray;
+    GpuBuffer vertexBuffer, indexBuffer;
+
+    void computeBounds(const Vertex *vertices, size_t vertexCount)
+    {
+        boundsMin = boundsMax = vertexCount ? vertices[0].Position : glm::vec3(0.0f);
+        for (size_t i = 1; i < vertexCount; i++)
+        {
+            boundsMin = glm::min(boundsMin, vertices[i].Position);
+            boundsMax = glm::max(boundsMax, vertices[i].Position);
+        }
+    }
 
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const Vertex *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount)
     {
         // create buffers/arrays
+        unsigned int VBO, EBO;
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
+        vertexArray = GpuVertexArray::Track(VAO, 0, "mesh");
+        vertexBuffer = GpuBuffer::Track(VBO, vertexCount * sizeof(Vertex), "mesh vertices");
+        indexBuffer = GpuBuffer::Track(EBO, indexCount * sizeof(unsigned int), "mesh indices");
 
         glBindVertexArray(VAO);
         // load data into vertex buffers
@@ -112,10 +165,10 @@ private:
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices, GL_STATIC_DRAW);  
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -0,0 +1,8 @@
+// the vertex attributes of every mesh and the matrices placing it, shared by the vertex shaders
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
@@ -5,12 +5,18 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
 #include "mesh.h"
 #include "shader.h"
+#include "profiler.h"
+#include "textureCompression.h"
+#include "assetPack.h"
+#include "jobSystem.h"
+#include "transformHierarchy.h"
 #include "stb_image.h"
 
 #include <string>
@@ -19,9 +25,19 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <atomic>
+#include <algorithm>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+unsigned int TextureFromFile(const char *path, const string &directory, TextureKind kind = TEXTURE_COLOR_RAW);
+
+// what a model texture of the given type holds; with gamma correction the diffuse maps are sampled as sRGB
+TextureKind TextureKindFromType(const string &type, bool gamma)
+{
+    if (type == "texture_normal")
+        return TEXTURE_NORMAL;
+    return gamma && type == "texture_diffuse" ? TEXTURE_COLOR : TEXTURE_COLOR_RAW;
+}
 
 class Model 
 {
@@ -29,26 +45,101 @@ public:
     // model data 
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
+    // the node graph of the file with the transform of each node, and the node each mesh hangs from
+    TransformHierarchy nodes;
+    vector<int> meshNodes;
+    // the file the model was loaded from, and its directory
+    string path;
     string directory;
     bool gammaCorrection;
+    // false when the model is loaded for the CPU renderers only, without creating any OpenGL objects
+    bool upload;
+    // false to free the vertices and indices of every mesh as soon as it is uploaded, when only OpenGL draws it
+    bool keepCpuData;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, bool upload = true, bool keepCpuData = true)
+        : path(path), gammaCorrection(gamma), upload(upload), keepCpuData(keepCpuData || !upload)
     {
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    // draws the model, and thus all its meshes, placed by the given model matrix and the transforms of their nodes
+    void Draw(Shader &shader, const glm::mat4 &transform)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if (!flat)
+                shader.setMat4("model", transform * MeshTransform(i));
             meshes[i].Draw(shader);
+        }
+    }
+
+    // where a mesh is in the model's space
+    const glm::mat4 &MeshTransform(unsigned int mesh) const
+    {
+        return nodes.worldTransforms[meshNodes[mesh]];
+    }
+
+    // whether every mesh is in the model's space as it is, so the node transforms can be skipped
+    bool IsFlat() const
+    {
+        return flat;
+    }
+
+    // the meshes and texture paths of the model as the asset pack stores them under <model path>.mesh, so packed
+    // models are loaded without Assimp:
+    //   vertex size, mesh count, then per mesh: vertex, index and texture counts, the type and path of every
+    //   texture (each a length and the characters, padded to four bytes), the vertices and the indices; then the
+    //   node count, the parent and local transform of every node, and the node of every mesh
+    // The model has to keep its CPU data for this.
+    std::vector<unsigned char> Cook() const
+    {
+        std::vector<unsigned char> blob;
+        putWord(blob, sizeof(Vertex));
+        putWord(blob, (uint32_t)meshes.size());
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            const Mesh &mesh = meshes[i];
+            putWord(blob, (uint32_t)mesh.vertices.size());
+            putWord(blob, (uint32_t)mesh.indices.size());
+            putWord(blob, (uint32_t)mesh.textures.size());
+            for (unsigned int t = 0; t < mesh.textures.size(); t++)
+            {
+                putString(blob, mesh.textures[t].type);
+                putString(blob, mesh.textures[t].path);
+            }
+            const unsigned char *vertices = (const unsigned char *)mesh.vertices.data();
+            blob.insert(blob.end(), vertices, vertices + mesh.vertices.size() * sizeof(Vertex));
+            const unsigned char *indices = (const unsigned char *)mesh.indices.data();
+            blob.insert(blob.end(), indices, indices + mesh.indices.size() * sizeof(unsigned int));
+        }
+        putWord(blob, (uint32_t)nodes.Count());
+        for (size_t i = 0; i < nodes.Count(); i++)
+        {
+            putWord(blob, (uint32_t)nodes.parents[i]);
+            const unsigned char *local = (const unsigned char *)glm::value_ptr(nodes.localTransforms[i]);
+            blob.insert(blob.end(), local, local + sizeof(glm::mat4));
+        }
+        for (size_t i = 0; i < meshNodes.size(); i++)
+            putWord(blob, (uint32_t)meshNodes[i]);
+        return blob;
     }
-    
+
 private:
+    // all node transforms are the identity
+    bool flat = true;
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
+        PROFILE_SCOPE("load.model");
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+        const AssetPack::Entry *cooked = AssetPack::Get().Find(path + ".mesh");
+        if (cooked && loadCooked(*cooked, path))
+            return;
+
         // read file via ASSIMP
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -58,92 +149,265 @@ private:
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
+        // collect the meshes of ASSIMP's nodes recursively, then convert them all at once
+        vector<aiMesh *> sceneMeshes;
+        collectMeshes(scene->mRootNode, -1, scene, sceneMeshes);
+        importMeshes(sceneMeshes, scene);
+        updateNodes();
+    }
+
+    void updateNodes()
+    {
+        nodes.Update();
+        flat = nodes.IsIdentity();
+    }
+
+    // reads the meshes written by Cook; the vertices and indices are copied out of the mapping in one go each, or
+    // uploaded straight from it when the model doesn't keep them
+    bool loadCooked(const AssetPack::Entry &cooked, const string &path)
+    {
+        const unsigned char *data = cooked.data, *end = cooked.data + cooked.size;
+        uint32_t vertexSize, meshCount;
+        if (!getWord(data, end, vertexSize) || vertexSize != sizeof(Vertex) || !getWord(data, end, meshCount))
+        {
+            cout << "ERROR::MODEL::INVALID_COOKED_MESH: " << path << endl;
+            return false;
+        }
+        vector<Mesh> cookedMeshes;
+        cookedMeshes.reserve(meshCount);
+        for (uint32_t i = 0; i < meshCount; i++)
+        {
+            uint32_t vertexCount, indexCount, textureCount;
+            if (!getWord(data, end, vertexCount) || !getWord(data, end, indexCount) || !getWord(data, end, textureCount))
+                break;
+            vector<Texture> textures;
+            for (uint32_t t = 0; t < textureCount; t++)
+            {
+                string type, texturePath;
+                if (!getString(data, end, type) || !getString(data, end, texturePath))
+                    break;
+                textures.push_back(loadMaterialTexture(texturePath, type));
+            }
+            size_t vertexBytes = (size_t)vertexCount * sizeof(Vertex), indexBytes = (size_t)indexCount * sizeof(unsigned int);
+            if (textures.size() != textureCount || (size_t)(end - data) < vertexBytes + indexBytes)
+                break;
+            if (keepCpuData)
+            {
+                vector<Vertex> vertices(vertexCount);
+                vector<unsigned int> indices(indexCount);
+                memcpy(vertices.data(), data, vertexBytes);
+                memcpy(indices.data(), data + vertexBytes, indexBytes);
+                cookedMeshes.push_back(Mesh(std::move(vertices), std::move(indices), std::move(textures), upload));
+            }
+            else
+                cookedMeshes.push_back(Mesh((const Vertex *)data, vertexCount, (const unsigned int *)(data + vertexBytes), indexCount, std::move(textures)));
+            data += vertexBytes + indexBytes;
+        }
+        if (cookedMeshes.size() != meshCount)
+        {
+            cout << "ERROR::MODEL::INVALID_COOKED_MESH: " << path << endl;
+            return false;
+        }
+        meshes.swap(cookedMeshes);
+        if (!loadCookedNodes(data, end))
+        {
+            // packs written before models had nodes: every mesh in the model's space
+            nodes = TransformHierarchy();
+            nodes.Add(-1, glm::mat4(1.0f));
+            meshNodes.assign(meshes.size(), 0);
+        }
+        updateNodes();
+        return true;
+    }
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+    bool loadCookedNodes(const unsigned char *data, const unsigned char *end)
+    {
+        uint32_t nodeCount, value;
+        if (!getWord(data, end, nodeCount) || nodeCount == 0)
+            return false;
+        for (uint32_t i = 0; i < nodeCount; i++)
+        {
+            glm::mat4 local;
+            if (!getWord(data, end, value) || (int)value >= (int)i || (size_t)(end - data) < sizeof(glm::mat4))
+                return false;
+            memcpy(glm::value_ptr(local), data, sizeof(glm::mat4));
+            data += sizeof(glm::mat4);
+            nodes.Add((int)value, local);
+        }
+        meshNodes.resize(meshes.size());
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            if (!getWord(data, end, value) || value >= nodeCount)
+                return false;
+            meshNodes[i] = (int)value;
+        }
+        return true;
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    static void putWord(std::vector<unsigned char> &blob, uint32_t word)
     {
-        // process each mesh located at the current node
+        const unsigned char *bytes = (const unsigned char *)&word;
+        blob.insert(blob.end(), bytes, bytes + 4);
+    }
+
+    static void putString(std::vector<unsigned char> &blob, const string &text)
+    {
+        putWord(blob, (uint32_t)text.size());
+        blob.insert(blob.end(), text.begin(), text.end());
+        blob.resize((blob.size() + 3) & ~(size_t)3, 0);
+    }
+
+    static bool getWord(const unsigned char *&data, const unsigned char *end, uint32_t &word)
+    {
+        if (end - data < 4)
+            return false;
+        memcpy(&word, data, 4);
+        data += 4;
+        return true;
+    }
+
+    static bool getString(const unsigned char *&data, const unsigned char *end, string &text)
+    {
+        uint32_t length;
+        if (!getWord(data, end, length) || (size_t)(end - data) < length)
+            return false;
+        text.assign((const char *)data, length);
+        data += (length + 3) & ~3u;
+        return data <= end;
+    }
+
+    // the vertices and faces of one mesh converted by a single job; big meshes are split into several chunks
+    struct ImportChunk {
+        unsigned int mesh;
+        unsigned int firstVertex, endVertex;
+        unsigned int firstFace, endFace;
+        // where the chunk's first index goes in the mesh's indices
+        size_t firstIndex;
+    };
+    static const unsigned int IMPORT_CHUNK_SIZE = 16384;
+
+    // collects the meshes of a node and its children in a recursive fashion, in the order they are drawn
+    void collectMeshes(aiNode *node, int parent, const aiScene *scene, vector<aiMesh *> &sceneMeshes)
+    {
+        // the node object only contains indices to index the actual objects in the scene.
+        // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+        // Nodes are added before their children, so they are in the order the hierarchy needs; assimp's
+        // matrices are row major
+        int index = nodes.Add(parent, glm::transpose(glm::make_mat4(&node->mTransformation.a1)));
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
         {
-            // the node object only contains indices to index the actual objects in the scene. 
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+            meshNodes.push_back(index);
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
+            collectMeshes(node->mChildren[i], index, scene, sceneMeshes);
+    }
+
+    // Sizes the vertex and index buffers of every mesh, converts the chunks of all meshes into them on the job
+    // system, and then loads the textures and creates the meshes on this thread, which owns the GL context.
+    void importMeshes(const vector<aiMesh *> &sceneMeshes, const aiScene *scene)
+    {
+        vector<vector<Vertex> > vertices(sceneMeshes.size());
+        vector<vector<unsigned int> > indices(sceneMeshes.size());
+        vector<ImportChunk> chunks;
         {
-            processNode(node->mChildren[i], scene);
+            PROFILE_SCOPE("load.modelPlan");
+            for(unsigned int m = 0; m < sceneMeshes.size(); m++)
+            {
+                const aiMesh *mesh = sceneMeshes[m];
+                vertices[m].resize(mesh->mNumVertices);
+                // faces are split where the vertices are, so the chunks of a mesh are about the same size
+                unsigned int chunkCount = std::max(1u, (std::max(mesh->mNumVertices, mesh->mNumFaces) + IMPORT_CHUNK_SIZE - 1) / IMPORT_CHUNK_SIZE);
+                size_t indexCount = 0;
+                unsigned int face = 0;
+                for(unsigned int c = 0; c < chunkCount; c++)
+                {
+                    ImportChunk chunk;
+                    chunk.mesh = m;
+                    chunk.firstVertex = (unsigned int)((unsigned long long)mesh->mNumVertices * c / chunkCount);
+                    chunk.endVertex = (unsigned int)((unsigned long long)mesh->mNumVertices * (c + 1) / chunkCount);
+                    chunk.firstFace = face;
+                    chunk.endFace = (unsigned int)((unsigned long long)mesh->mNumFaces * (c + 1) / chunkCount);
+                    chunk.firstIndex = indexCount;
+                    // triangulated faces all have three indices; points and lines are left as they are
+                    if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+                        indexCount += (size_t)(chunk.endFace - chunk.firstFace) * 3;
+                    else
+                        for(unsigned int f = chunk.firstFace; f < chunk.endFace; f++)
+                            indexCount += mesh->mFaces[f].mNumIndices;
+                    face = chunk.endFace;
+                    chunks.push_back(chunk);
+                }
+                indices[m].resize(indexCount);
+            }
+        }
+        {
+            PROFILE_SCOPE("load.modelConvert");
+            std::atomic<unsigned int> next(0);
+            auto worker = [&]() {
+                for(unsigned int i = next++; i < chunks.size(); i = next++)
+                {
+                    const ImportChunk &chunk = chunks[i];
+                    convertVertices(sceneMeshes[chunk.mesh], chunk, &vertices[chunk.mesh][0]);
+                    convertFaces(sceneMeshes[chunk.mesh], chunk, indices[chunk.mesh].data());
+                }
+            };
+            JobSystem::Get().RunParallel(std::min(JobSystem::Get().ThreadCount(), (unsigned int)chunks.size()), worker);
         }
 
+        PROFILE_SCOPE("load.modelUpload");
+        meshes.reserve(meshes.size() + sceneMeshes.size());
+        for(unsigned int m = 0; m < sceneMeshes.size(); m++)
+        {
+            aiMaterial* material = scene->mMaterials[sceneMeshes[m]->mMaterialIndex];
+            // return a mesh object created from the extracted mesh data
+            meshes.push_back(Mesh(std::move(vertices[m]), std::move(indices[m]), loadMeshTextures(material), upload));
+            if (!keepCpuData)
+                meshes.back().ReleaseCpuData();
+        }
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // walks through the chunk's vertices of the mesh
+    static void convertVertices(const aiMesh *mesh, const ImportChunk &chunk, Vertex *vertices)
     {
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
-
-        // walk through each of the mesh's vertices
-        for(unsigned int i = 0; i < mesh->mNumVertices; i++)
+        for(unsigned int i = chunk.firstVertex; i < chunk.endVertex; i++)
         {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
+            // the buffers are sized with value initialized vertices, so what a mesh lacks stays zero
+            Vertex &vertex = vertices[i];
+            // positions; assimp uses its own vector class that doesn't directly convert to glm's vec3 class
+            vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
             // normals
             if (mesh->HasNormals())
-            {
-                vector.x = mesh->mNormals[i].x;
-                vector.y = mesh->mNormals[i].y;
-                vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
-            }
+                vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
             // texture coordinates
             if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
             {
-                glm::vec2 vec;
                 // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
                 // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x; 
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
+                vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
                 // tangent
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
+                vertex.Tangent = glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
                 // bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
+                vertex.Bitangent = glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
             }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-            vertices.push_back(vertex);
         }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+    }
+
+    // walks through the chunk's faces (a face is a mesh its triangle) and retrieves the corresponding vertex indices
+    static void convertFaces(const aiMesh *mesh, const ImportChunk &chunk, unsigned int *indices)
+    {
+        unsigned int *out = indices + chunk.firstIndex;
+        for(unsigned int i = chunk.firstFace; i < chunk.endFace; i++)
         {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
+            const aiFace &face = mesh->mFaces[i];
             for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);        
+                *out++ = face.mIndices[j];
         }
-        // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
+    }
+
+    vector<Texture> loadMeshTextures(aiMaterial *material)
+    {
+        vector<Texture> textures;
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
         // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
         // Same applies to other texture as the following list summarizes:
@@ -163,9 +427,7 @@ private:
         // 4. height maps
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-        
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return textures;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -177,54 +439,67 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(loadMaterialTexture(str.C_Str(), typeName));
         }
         return textures;
     }
+
+    // the texture of a path, loaded unless a mesh loaded it before
+    Texture loadMaterialTexture(const string &path, const string &typeName)
+    {
+        // check if texture was loaded before and if so, return it instead of loading a new texture
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+        {
+            if(textures_loaded[j].path == path)
+                return textures_loaded[j]; // a texture with the same filepath has already been loaded (optimization)
+        }
+        // if texture hasn't been loaded already, load it
+        Texture texture;
+        texture.id = upload ? TextureFromFile(path.c_str(), this->directory, TextureKindFromType(typeName, gammaCorrection)) : 0;
+        texture.resource = GpuTexture(texture.id);
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
+    }
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+// loads the cooked version of the texture when there is one
+unsigned int TextureFromFile(const char *path, const string &directory, TextureKind kind)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
+    unsigned int textureID = useCookedTextures ? loadCookedTexture(filename, kind) : 0;
+    if (textureID)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return textureID;
+    }
     glGenTextures(1, &textureID);
 
     int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+    unsigned char *data = AssetPack::LoadImage(filename, &width, &height, &nrComponents, 0);
+    GpuResources::Get().Add(GPU_TEXTURE, textureID, data ? GpuResources::ImageBytes(width, height, nrComponents) : 0, filename);
     if (data)
     {
-        GLenum format;
+        GLenum format = GL_RGB;
         if (nrComponents == 1)
             format = GL_RED;
         else if (nrComponents == 3)
             format = GL_RGB;
         else if (nrComponents == 4)
             format = GL_RGBA;
+        GLenum internalFormat = format;
+        if (kind == TEXTURE_COLOR && format != GL_RED)
+            internalFormat = format == GL_RGBA ? GL_SRGB8_ALPHA8 : GL_SRGB8;
 
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -0,0 +1,25 @@
+// Normal mapping shared by the fragment shaders, included where NORMAL_MAP is defined
+
+// the tangent space normal of a normal map texel, rebuilding z from x and y since BC5 compressed normal maps
+// only store those two
+vec3 unpackNormal(vec2 texel) {
+    vec2 tangentXY = texel * 2.0 - 1.0;
+    return vec3(tangentXY, sqrt(max(1.0 - dot(tangentXY, tangentXY), 0.0)));
+}
+
+// Function to calculate the normals from a normal map using tangents
+vec3 perturbNormal(vec3 tangentNormal, vec3 normal, vec3 worldPos, vec2 texCoords) {
+    // calculate derivatives for fragment positions and texcoords
+    vec3 Q1  = dFdx(worldPos);
+    vec3 Q2  = dFdy(worldPos);
+    vec2 st1 = dFdx(texCoords);
+    vec2 st2 = dFdy(texCoords);
+
+    // get normal, tangent and the negative of their cross to produce TBN
+    vec3 N   = normalize(normal);
+    vec3 T  = normalize(Q1*st2.t - Q2*st1.t);
+    vec3 B  = -normalize(cross(N, T));
+    mat3 TBN = mat3(T, B, N);
+    // multiply TBN by tangent Normal and normalize it to do normal mapping
+    return normalize(TBN * tangentNormal);
+}
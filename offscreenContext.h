@@ -0,0 +1,204 @@
+#ifndef OFFSCREEN_CONTEXT_H
+#define OFFSCREEN_CONTEXT_H
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "gpuResources.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+// An OpenGL 3.3 core context without a window, created through EGL. Uses the Mesa surfaceless platform when it
+// is available so it also runs on machines with no display or GPU (llvmpipe), and falls back to the default display.
+// It is destroyed with the object, so declared before everything that holds GPU objects it outlives them on every
+// return path.
+class OffscreenContext
+{
+public:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    OffscreenContext()
+    {
+    }
+
+    ~OffscreenContext()
+    {
+        Destroy();
+    }
+
+    OffscreenContext(const OffscreenContext &) = delete;
+    OffscreenContext &operator=(const OffscreenContext &) = delete;
+
+    // creates the context, makes it current and loads the GL function pointers through glad
+    bool Create()
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        {
+            std::cout << "Failed to initialize EGL" << std::endl;
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API))
+        {
+            std::cout << "Failed to bind the OpenGL API in EGL" << std::endl;
+            return false;
+        }
+
+        // the default surface type is window, which the surfaceless platform has no configs for
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_DEPTH_SIZE, 24,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0)
+        {
+            std::cout << "Failed to choose an EGL config" << std::endl;
+            return false;
+        }
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        // no surface is needed since everything is rendered into framebuffer objects
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            std::cout << "Failed to create a surfaceless OpenGL 3.3 context" << std::endl;
+            return false;
+        }
+
+        if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return false;
+        }
+        std::cout << "Offscreen context: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
+        return true;
+    }
+
+    // deletes the released GPU objects still waiting for their frames while the context is current, then destroys it
+    void Destroy()
+    {
+        if (display == EGL_NO_DISPLAY)
+            return;
+        if (context != EGL_NO_CONTEXT)
+            GpuResources::Get().Flush();
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+        display = EGL_NO_DISPLAY;
+        context = EGL_NO_CONTEXT;
+    }
+};
+
+// A framebuffer object with colour and depth renderbuffers, optionally multisampled with a resolve target
+// so that the result can be read back
+class Framebuffer
+{
+public:
+    unsigned int FBO = 0;
+    unsigned int resolveFBO = 0;
+    int width = 0;
+    int height = 0;
+    int samples = 0;
+
+    bool Create(int width, int height, int samples = 0)
+    {
+        this->width = width;
+        this->height = height;
+        this->samples = samples;
+
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glGenRenderbuffers(1, &colorRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+        glGenRenderbuffers(1, &depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+        size_t sampleBytes = (size_t)width * height * 4 * std::max(1, samples);
+        framebuffers.push_back(GpuFramebuffer::Track(FBO, 0, "framebuffer"));
+        renderbuffers.push_back(GpuRenderbuffer::Track(colorRBO, sampleBytes, "framebuffer colour"));
+        renderbuffers.push_back(GpuRenderbuffer::Track(depthRBO, sampleBytes, "framebuffer depth"));
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
+            return false;
+        }
+
+        // multisampled renderbuffers can't be read directly, so they are resolved into a single sampled one first
+        resolveFBO = FBO;
+        if (samples > 0)
+        {
+            glGenFramebuffers(1, &resolveFBO);
+            glBindFramebuffer(GL_FRAMEBUFFER, resolveFBO);
+            glGenRenderbuffers(1, &resolveRBO);
+            glBindRenderbuffer(GL_RENDERBUFFER, resolveRBO);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolveRBO);
+            framebuffers.push_back(GpuFramebuffer::Track(resolveFBO, 0, "resolve framebuffer"));
+            renderbuffers.push_back(GpuRenderbuffer::Track(resolveRBO, (size_t)width * height * 4, "resolve colour"));
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            {
+                std::cout << "ERROR::FRAMEBUFFER:: Resolve framebuffer is not complete!" << std::endl;
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                return false;
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return true;
+    }
+
+    void Bind()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, width, height);
+    }
+
+    // resolves the multisampled colour buffer and leaves the single sampled result bound for reading
+    void Resolve()
+    {
+        if (resolveFBO != FBO)
+        {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFBO);
+            glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, resolveFBO);
+    }
+
+private:
+    unsigned int colorRBO = 0;
+    unsigned int depthRBO = 0;
+    unsigned int resolveRBO = 0;
+    // released with the framebuffer
+    std::vector<GpuFramebuffer> framebuffers;
+    std::vector<GpuRenderbuffer> renderbuffers;
+};
+#endif
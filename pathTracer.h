@@ -0,0 +1,818 @@
+#ifndef PATH_TRACER_H
+#define PATH_TRACER_H
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "scene.h"
+#include "softRasterizer.h"
+#include "profiler.h"
+#include "jobSystem.h"
+#include "stb_image_write.h"
+
+#include <cstdint>
+#include <cfloat>
+#include <climits>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// small and fast generator for the sample sequences, one per pixel (PCG32)
+struct TraceRandom {
+    uint64_t state;
+
+    TraceRandom(uint64_t seed) : state(0)
+    {
+        Next();
+        state += seed;
+        Next();
+    }
+
+    uint32_t Next()
+    {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = (uint32_t)(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+
+    // uniform in [0, 1)
+    float Uniform()
+    {
+        return (Next() >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+// Bounding volume hierarchy over triangles, built top-down with a binned surface area heuristic and then
+// collapsed into a 4-wide tree whose child boxes are stored as SoA so one SSE2 slab test covers all four.
+class TraceBvh
+{
+public:
+    static const unsigned int BINS = 12;
+    static const unsigned int MAX_LEAF_SIZE = 8;
+    // nodes this deep are made leaves whatever their size, so the traversal stack has a known bound
+    static const unsigned int MAX_DEPTH = 40;
+    // a wide node is at most as deep as the binary node it was collapsed from, and visiting one pops it and pushes
+    // at most four children
+    static const unsigned int STACK_SIZE = 3 * MAX_DEPTH + 1;
+    static const int EMPTY = INT_MIN;
+
+    struct Node4 {
+        float minX[4], minY[4], minZ[4];
+        float maxX[4], maxY[4], maxZ[4];
+        // >= 0 an inner node, EMPTY an unused slot, otherwise -(leaf + 1)
+        int child[4];
+    };
+
+    struct Leaf {
+        unsigned int first;
+        unsigned int count;
+    };
+
+    std::vector<Node4> nodes;
+    std::vector<Leaf> leaves;
+    // triangle index of every leaf entry
+    std::vector<unsigned int> order;
+
+    void Build(const std::vector<glm::vec3> &triMin, const std::vector<glm::vec3> &triMax)
+    {
+        nodes.clear();
+        leaves.clear();
+        binary.clear();
+        order.resize(triMin.size());
+        for (unsigned int i = 0; i < order.size(); i++)
+            order[i] = i;
+        centroids.resize(triMin.size());
+        for (unsigned int i = 0; i < triMin.size(); i++)
+            centroids[i] = (triMin[i] + triMax[i]) * 0.5f;
+        boxMin = &triMin;
+        boxMax = &triMax;
+        if (order.empty())
+            return;
+
+        binary.push_back(BinaryNode());
+        split(0, 0, (unsigned int)order.size(), 0);
+        nodes.push_back(Node4());
+        collapse(0, 0);
+    }
+
+private:
+    struct BinaryNode {
+        glm::vec3 min, max;
+        int left = -1, right = -1;
+        unsigned int first = 0, count = 0;
+    };
+
+    std::vector<BinaryNode> binary;
+    std::vector<glm::vec3> centroids;
+    const std::vector<glm::vec3> *boxMin = nullptr;
+    const std::vector<glm::vec3> *boxMax = nullptr;
+
+    static float area(glm::vec3 min, glm::vec3 max)
+    {
+        glm::vec3 d = max - min;
+        return d.x < 0.0f ? 0.0f : 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    void split(int index, unsigned int first, unsigned int count, unsigned int depth)
+    {
+        glm::vec3 min(FLT_MAX), max(-FLT_MAX), cmin(FLT_MAX), cmax(-FLT_MAX);
+        for (unsigned int i = first; i < first + count; i++)
+        {
+            min = glm::min(min, (*boxMin)[order[i]]);
+            max = glm::max(max, (*boxMax)[order[i]]);
+            cmin = glm::min(cmin, centroids[order[i]]);
+            cmax = glm::max(cmax, centroids[order[i]]);
+        }
+        binary[index].min = min;
+        binary[index].max = max;
+        binary[index].first = first;
+        binary[index].count = count;
+        if (count <= 2 || depth == MAX_DEPTH)
+            return;
+
+        // sweep the bins of every axis for the cheapest split
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        unsigned int bestBin = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float extent = cmax[axis] - cmin[axis];
+            if (extent <= 0.0f)
+                continue;
+            unsigned int binCount[BINS] = {};
+            glm::vec3 binMin[BINS], binMax[BINS];
+            for (unsigned int b = 0; b < BINS; b++)
+            {
+                binMin[b] = glm::vec3(FLT_MAX);
+                binMax[b] = glm::vec3(-FLT_MAX);
+            }
+            float scale = BINS / extent;
+            for (unsigned int i = first; i < first + count; i++)
+            {
+                unsigned int b = std::min(BINS - 1, (unsigned int)((centroids[order[i]][axis] - cmin[axis]) * scale));
+                binCount[b]++;
+                binMin[b] = glm::min(binMin[b], (*boxMin)[order[i]]);
+                binMax[b] = glm::max(binMax[b], (*boxMax)[order[i]]);
+            }
+            float rightArea[BINS];
+            unsigned int rightCount[BINS];
+            glm::vec3 rmin(FLT_MAX), rmax(-FLT_MAX);
+            unsigned int rcount = 0;
+            for (unsigned int b = BINS - 1; b > 0; b--)
+            {
+                rmin = glm::min(rmin, binMin[b]);
+                rmax = glm::max(rmax, binMax[b]);
+                rcount += binCount[b];
+                rightArea[b] = area(rmin, rmax);
+                rightCount[b] = rcount;
+            }
+            glm::vec3 lmin(FLT_MAX), lmax(-FLT_MAX);
+            unsigned int lcount = 0;
+            for (unsigned int b = 0; b + 1 < BINS; b++)
+            {
+                lmin = glm::min(lmin, binMin[b]);
+                lmax = glm::max(lmax, binMax[b]);
+                lcount += binCount[b];
+                if (lcount == 0 || rightCount[b + 1] == 0)
+                    continue;
+                float cost = area(lmin, lmax) * lcount + rightArea[b + 1] * rightCount[b + 1];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        // a leaf is cheaper than splitting when intersecting its triangles costs less than visiting two children
+        float leafCost = area(min, max) * count;
+        if (bestAxis < 0 || (bestCost >= leafCost && count <= MAX_LEAF_SIZE))
+            return;
+
+        float scale = BINS / (cmax[bestAxis] - cmin[bestAxis]);
+        unsigned int *middle = std::partition(&order[first], &order[first] + count, [&](unsigned int t) {
+            return std::min(BINS - 1, (unsigned int)((centroids[t][bestAxis] - cmin[bestAxis]) * scale)) <= bestBin;
+        });
+        unsigned int leftCount = (unsigned int)(middle - &order[first]);
+        if (leftCount == 0 || leftCount == count)
+            leftCount = count / 2;
+
+        int left = (int)binary.size();
+        binary.push_back(BinaryNode());
+        binary.push_back(BinaryNode());
+        binary[index].left = left;
+        binary[index].right = left + 1;
+        split(left, first, leftCount, depth + 1);
+        split(left + 1, first + leftCount, count - leftCount, depth + 1);
+    }
+
+    // pulls up to four grandchildren into one wide node, opening the largest inner child first
+    void collapse(int node4, int node)
+    {
+        std::vector<int> children;
+        if (binary[node].left < 0)
+            children.push_back(node);
+        else
+        {
+            children.push_back(binary[node].left);
+            children.push_back(binary[node].right);
+        }
+        while (children.size() < 4)
+        {
+            int best = -1;
+            float bestArea = -1.0f;
+            for (unsigned int i = 0; i < children.size(); i++)
+            {
+                const BinaryNode &child = binary[children[i]];
+                if (child.left >= 0 && area(child.min, child.max) > bestArea)
+                {
+                    bestArea = area(child.min, child.max);
+                    best = (int)i;
+                }
+            }
+            if (best < 0)
+                break;
+            int opened = children[best];
+            children[best] = binary[opened].left;
+            children.push_back(binary[opened].right);
+        }
+
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            if (i >= children.size())
+            {
+                nodes[node4].minX[i] = nodes[node4].minY[i] = nodes[node4].minZ[i] = FLT_MAX;
+                nodes[node4].maxX[i] = nodes[node4].maxY[i] = nodes[node4].maxZ[i] = -FLT_MAX;
+                nodes[node4].child[i] = EMPTY;
+                continue;
+            }
+            const BinaryNode &child = binary[children[i]];
+            nodes[node4].minX[i] = child.min.x;
+            nodes[node4].minY[i] = child.min.y;
+            nodes[node4].minZ[i] = child.min.z;
+            nodes[node4].maxX[i] = child.max.x;
+            nodes[node4].maxY[i] = child.max.y;
+            nodes[node4].maxZ[i] = child.max.z;
+            if (child.left < 0)
+            {
+                Leaf leaf = { child.first, child.count };
+                leaves.push_back(leaf);
+                nodes[node4].child[i] = -(int)leaves.size();
+            }
+            else
+            {
+                int inner = (int)nodes.size();
+                nodes.push_back(Node4());
+                nodes[node4].child[i] = inner;
+                collapse(inner, children[i]);
+            }
+        }
+    }
+};
+
+// Offline path tracer over the scene's triangles, the ground truth the rasterized BRDFs are compared against.
+// Cook-Torrance materials use the shader's GGX / Smith-Schlick / Fresnel-Schlick BRDF with a Lambertian diffuse lobe,
+// Phong materials an energy normalized (Blinn-)Phong lobe. Direct light is sampled at every bounce with shadow rays
+// to the four point lights, indirect light by importance sampling the GGX distribution or the cosine lobe, so the
+// constant ambient term of the shaders is replaced by actual interreflection. The result is tone mapped and gamma
+// corrected like cookTorrance.fs. Pixels are traced in 16x16 tiles handed out to worker threads.
+class PathTracer
+{
+public:
+    static const int TILE_SIZE = 16;
+
+    int width;
+    int height;
+    unsigned int samples = 64;
+    unsigned int maxBounces = 4;
+    unsigned int threadCount;
+    // linear radiance, top row first
+    std::vector<glm::vec3> radiance;
+    unsigned long long rays = 0;
+    double ms = 0.0;
+
+    PathTracer(int width, int height, unsigned int threads = 0) : width(width), height(height)
+    {
+        threadCount = threads ? threads : JobSystem::Get().ThreadCount();
+        radiance.resize((size_t)width * height);
+    }
+
+    void Render(Scene &scene, Camera &camera, const SceneState &state)
+    {
+        PROFILE_SCOPE("trace.frame");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        lightPositions = scene.entities.lightPositions;
+        lightColors = scene.entities.lightColors;
+        blinn = state.blinn;
+
+        vector<DrawItem> items = scene.BuildDrawList(state);
+        {
+            PROFILE_SCOPE("trace.textures");
+            textures.Load(scene, items, threadCount);
+        }
+        {
+            PROFILE_SCOPE("trace.bvh");
+            gatherTriangles(scene, items);
+            std::vector<glm::vec3> triMin(triangles.size()), triMax(triangles.size());
+            for (unsigned int i = 0; i < triangles.size(); i++)
+            {
+                glm::vec3 p1 = triangles[i].p0 + triangles[i].e1, p2 = triangles[i].p0 + triangles[i].e2;
+                triMin[i] = glm::min(triangles[i].p0, glm::min(p1, p2));
+                triMax[i] = glm::max(triangles[i].p0, glm::max(p1, p2));
+            }
+            bvh.Build(triMin, triMax);
+        }
+
+        // the primary rays span the same frustum as the projection used by the rasterizers
+        eye = camera.Position;
+        float tanHalf = std::tan(glm::radians(camera.Zoom) * 0.5f);
+        right = camera.Right * tanHalf * ((float)width / height);
+        up = camera.Up * tanHalf;
+        forward = camera.Front;
+
+        {
+            PROFILE_SCOPE("trace.tiles");
+            std::atomic<unsigned int> nextTile(0);
+            std::atomic<unsigned long long> rayCount(0);
+            JobSystem::Get().RunParallel(threadCount, [&]() { tileWorker(nextTile, rayCount); });
+            rays = rayCount;
+        }
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Reinhard tone mapping and gamma correction, then 8 bits per channel
+    bool Save(const std::string &path) const
+    {
+        std::vector<unsigned char> pixels(radiance.size() * 3);
+        for (unsigned int i = 0; i < radiance.size(); i++)
+        {
+            glm::vec3 color = radiance[i] / (radiance[i] + glm::vec3(1.0f));
+            color = glm::pow(color, glm::vec3(1.0f / 2.2f));
+            for (int c = 0; c < 3; c++)
+                pixels[i * 3 + c] = (unsigned char)(std::min(std::max(color[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+        }
+        if (!stbi_write_png(path.c_str(), width, height, 3, &pixels[0], width * 3))
+        {
+            std::cout << "ERROR::PATH_TRACER::FILE_NOT_WRITABLE: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // vertex 0 and the two edges for the intersection test, the rest for shading
+    struct TraceTriangle {
+        glm::vec3 p0, e1, e2;
+        glm::vec3 normal[3];
+        glm::vec2 uv[3];
+        // the normal mapping tangent for the triangle seen from the front
+        glm::vec3 tangent;
+        unsigned int material;
+    };
+
+    struct Hit {
+        float t;
+        float u, v;
+        unsigned int triangle;
+    };
+
+    struct Surface {
+        glm::vec3 position;
+        glm::vec3 geometric;
+        glm::vec3 normal;
+        const SoftMaterial *material;
+        glm::vec3 albedo;
+        float metallic;
+        float roughness;
+    };
+
+    std::vector<glm::vec3> lightPositions;
+    std::vector<glm::vec3> lightColors;
+    bool blinn = false;
+    glm::vec3 eye, right, up, forward;
+
+    SoftTextureCache textures;
+    std::vector<SoftMaterial> materials;
+    std::vector<TraceTriangle> triangles;
+    TraceBvh bvh;
+
+    void gatherTriangles(Scene &scene, const vector<DrawItem> &items)
+    {
+        triangles.clear();
+        materials.clear();
+        for (unsigned int i = 0; i < items.size(); i++)
+        {
+            const DrawItem &item = items[i];
+            glm::mat3 normalMatrix = glm::mat3(item.transform);
+            if (item.model)
+            {
+                for (unsigned int m = 0; m < item.model->meshes.size(); m++)
+                {
+                    const Mesh &mesh = item.model->meshes[m];
+                    materials.push_back(textures.Material(scene, item, &mesh));
+                    glm::mat4 transform = item.model->IsFlat() ? item.transform : item.transform * item.model->MeshTransform(m);
+                    glm::mat3 meshNormalMatrix = glm::mat3(transform);
+                    for (unsigned int t = 0; t + 2 < mesh.indices.size(); t += 3)
+                    {
+                        const Vertex *v[3] = { &mesh.vertices[mesh.indices[t]], &mesh.vertices[mesh.indices[t + 1]], &mesh.vertices[mesh.indices[t + 2]] };
+                        glm::vec3 p[3], n[3];
+                        glm::vec2 uv[3];
+                        for (int k = 0; k < 3; k++)
+                        {
+                            p[k] = glm::vec3(transform * glm::vec4(v[k]->Position, 1.0f));
+                            n[k] = meshNormalMatrix * v[k]->Normal;
+                            uv[k] = v[k]->TexCoords;
+                        }
+                        addTriangle(p, n, uv);
+                    }
+                }
+                continue;
+            }
+
+            materials.push_back(textures.Material(scene, item));
+            const Geometry &geometry = *item.geometry;
+            for (unsigned int t = 0; t + 2 < geometry.count; t += (geometry.mode == GL_TRIANGLE_STRIP ? 1 : 3))
+            {
+                glm::vec3 p[3], n[3];
+                glm::vec2 uv[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int index = geometry.indexed ? geometry.indices[t + k] : t + k;
+                    const float *in = &geometry.vertices[index * 8];
+                    p[k] = glm::vec3(item.transform * glm::vec4(in[0], in[1], in[2], 1.0f));
+                    n[k] = normalMatrix * glm::vec3(in[3], in[4], in[5]);
+                    uv[k] = glm::vec2(in[6], in[7]);
+                }
+                addTriangle(p, n, uv);
+            }
+        }
+    }
+
+    void addTriangle(const glm::vec3 *p, const glm::vec3 *n, const glm::vec2 *uv)
+    {
+        TraceTriangle tri;
+        tri.p0 = p[0];
+        tri.e1 = p[1] - p[0];
+        tri.e2 = p[2] - p[0];
+        // strips have degenerate triangles joining the rows
+        if (glm::length(glm::cross(tri.e1, tri.e2)) == 0.0f)
+            return;
+        for (int k = 0; k < 3; k++)
+        {
+            tri.normal[k] = n[k];
+            tri.uv[k] = uv[k];
+        }
+        // same as the rasterizer: the world space edges weighted by the texture t differences
+        glm::vec3 tangent = tri.e1 * (uv[2].y - uv[0].y) - tri.e2 * (uv[1].y - uv[0].y);
+        float length = glm::length(tangent);
+        tri.tangent = length > 0.0f ? tangent / length : glm::vec3(0.0f);
+        tri.material = (unsigned int)materials.size() - 1;
+        triangles.push_back(tri);
+    }
+
+    // Moller-Trumbore
+    bool intersectTriangle(unsigned int index, glm::vec3 origin, glm::vec3 direction, Hit &hit) const
+    {
+        const TraceTriangle &tri = triangles[index];
+        glm::vec3 p = glm::cross(direction, tri.e2);
+        float det = glm::dot(tri.e1, p);
+        if (std::fabs(det) < 1e-12f)
+            return false;
+        float invDet = 1.0f / det;
+        glm::vec3 s = origin - tri.p0;
+        float u = glm::dot(s, p) * invDet;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, tri.e1);
+        float v = glm::dot(direction, q) * invDet;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        float t = glm::dot(tri.e2, q) * invDet;
+        if (t <= 0.0f || t >= hit.t)
+            return false;
+        hit.t = t;
+        hit.u = u;
+        hit.v = v;
+        hit.triangle = index;
+        return true;
+    }
+
+    // slab test of the ray against the four child boxes, a bit per child hit before maxT
+#ifdef __SSE2__
+    int intersectBoxes(const TraceBvh::Node4 &node, glm::vec3 origin, glm::vec3 invDirection, float maxT, float *entry) const
+    {
+        __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+        __m128 ix = _mm_set1_ps(invDirection.x), iy = _mm_set1_ps(invDirection.y), iz = _mm_set1_ps(invDirection.z);
+        __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), ox), ix);
+        __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), ox), ix);
+        __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), oy), iy);
+        __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), oy), iy);
+        __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), oz), iz);
+        __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), oz), iz);
+        __m128 tmin = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+        __m128 tmax = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(maxT)));
+        _mm_storeu_ps(entry, tmin);
+        return _mm_movemask_ps(_mm_cmple_ps(tmin, tmax));
+    }
+#else
+    int intersectBoxes(const TraceBvh::Node4 &node, glm::vec3 origin, glm::vec3 invDirection, float maxT, float *entry) const
+    {
+        int mask = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            float t0x = (node.minX[i] - origin.x) * invDirection.x, t1x = (node.maxX[i] - origin.x) * invDirection.x;
+            float t0y = (node.minY[i] - origin.y) * invDirection.y, t1y = (node.maxY[i] - origin.y) * invDirection.y;
+            float t0z = (node.minZ[i] - origin.z) * invDirection.z, t1z = (node.maxZ[i] - origin.z) * invDirection.z;
+            float tmin = std::max(std::max(std::min(t0x, t1x), std::min(t0y, t1y)), std::max(std::min(t0z, t1z), 0.0f));
+            float tmax = std::min(std::min(std::max(t0x, t1x), std::max(t0y, t1y)), std::min(std::max(t0z, t1z), maxT));
+            entry[i] = tmin;
+            if (tmin <= tmax)
+                mask |= 1 << i;
+        }
+        return mask;
+    }
+#endif
+
+    // closest hit, or with anyHit the first hit found, which is all shadow rays need
+    bool trace(glm::vec3 origin, glm::vec3 direction, Hit &hit, bool anyHit) const
+    {
+        if (bvh.nodes.empty())
+            return false;
+        glm::vec3 invDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        int stack[TraceBvh::STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        bool found = false;
+        while (top > 0)
+        {
+            int index = stack[--top];
+            if (index < 0)
+            {
+                const TraceBvh::Leaf &leaf = bvh.leaves[-index - 1];
+                for (unsigned int i = leaf.first; i < leaf.first + leaf.count; i++)
+                {
+                    if (intersectTriangle(bvh.order[i], origin, direction, hit))
+                    {
+                        found = true;
+                        if (anyHit)
+                            return true;
+                    }
+                }
+                continue;
+            }
+
+            const TraceBvh::Node4 &node = bvh.nodes[index];
+            float entry[4];
+            int mask = intersectBoxes(node, origin, invDirection, hit.t, entry);
+            // push the hit children farthest first so the nearest is visited next
+            int order[4], count = 0;
+            for (int i = 0; i < 4; i++)
+                if ((mask & (1 << i)) && node.child[i] != TraceBvh::EMPTY)
+                    order[count++] = i;
+            std::sort(order, order + count, [&](int a, int b) { return entry[a] > entry[b]; });
+            for (int i = 0; i < count; i++)
+                stack[top++] = node.child[order[i]];
+        }
+        return found;
+    }
+
+    // interpolates the hit and applies the normal map like getNormalFromMap()
+    Surface surface(glm::vec3 origin, glm::vec3 direction, const Hit &hit) const
+    {
+        const TraceTriangle &tri = triangles[hit.triangle];
+        float w0 = 1.0f - hit.u - hit.v;
+        Surface s;
+        s.position = origin + direction * hit.t;
+        s.material = &materials[tri.material];
+        glm::vec2 uv = tri.uv[0] * w0 + tri.uv[1] * hit.u + tri.uv[2] * hit.v;
+        glm::vec3 normal = glm::normalize(tri.normal[0] * w0 + tri.normal[1] * hit.u + tri.normal[2] * hit.v);
+        glm::vec3 geometric = glm::normalize(glm::cross(tri.e1, tri.e2));
+        bool front = glm::dot(geometric, direction) < 0.0f;
+
+        const SoftMaterial &material = *s.material;
+        if (material.shading == SHADING_PHONG)
+        {
+            s.albedo = glm::vec3(material.maps[0]->Sample(uv, 0.0f));
+            s.metallic = 0.0f;
+            s.roughness = 1.0f;
+        }
+        else
+        {
+            s.albedo = glm::vec3(material.maps[PBR_ALBEDO]->Sample(uv, 0.0f));
+            s.metallic = material.maps[PBR_METALLIC]->Sample(uv, 0.0f).x;
+            s.roughness = material.maps[PBR_ROUGHNESS]->Sample(uv, 0.0f).x;
+        }
+        // only materials the scene draws with the NORMAL_MAP variant
+        if (material.normalMap)
+        {
+            // the screen space tangent flips with the winding the triangle is seen with
+            glm::vec3 tangent = front ? tri.tangent : -tri.tangent;
+            // z is rebuilt from x and y as in cookTorrance.fs
+            glm::vec4 normalTexel = material.maps[PBR_NORMAL]->Sample(uv, 0.0f);
+            glm::vec2 tangentXY = glm::vec2(normalTexel.x, normalTexel.y) * 2.0f - glm::vec2(1.0f);
+            glm::vec3 tangentNormal(tangentXY, std::sqrt(std::max(1.0f - glm::dot(tangentXY, tangentXY), 0.0f)));
+            glm::vec3 bitangent = -glm::normalize(glm::cross(normal, tangent));
+            glm::vec3 mapped = tangent * tangentNormal.x + bitangent * tangentNormal.y + normal * tangentNormal.z;
+            if (glm::length(mapped) > 0.0f && std::isfinite(mapped.x + mapped.y + mapped.z))
+                normal = glm::normalize(mapped);
+        }
+
+        // shade the side the ray arrived from
+        s.geometric = front ? geometric : -geometric;
+        if (glm::dot(normal, s.geometric) < 0.0f)
+            normal = -normal;
+        s.normal = normal;
+        return s;
+    }
+
+    // the BRDF of the surface for the view and light directions, both pointing away from it
+    glm::vec3 brdf(const Surface &s, glm::vec3 V, glm::vec3 L) const
+    {
+        const float PI = 3.14159265359f;
+        glm::vec3 N = s.normal;
+        float NdotL = std::max(glm::dot(N, L), 0.0f);
+        float NdotV = std::max(glm::dot(N, V), 0.0f);
+        const SoftMaterial &material = *s.material;
+        if (material.shading == SHADING_PHONG)
+        {
+            glm::vec3 diffuse = material.diffuse * s.albedo / PI;
+            float n = material.shininess;
+            float lobe;
+            if (blinn)
+                lobe = (n + 8.0f) / (8.0f * PI) * std::pow(std::max(glm::dot(N, glm::normalize(L + V)), 0.0f), n);
+            else
+                lobe = (n + 2.0f) / (2.0f * PI) * std::pow(std::max(glm::dot(V, glm::reflect(-L, N)), 0.0f), n);
+            return diffuse + 0.5f * material.specular * lobe;
+        }
+
+        glm::vec3 H = glm::normalize(V + L);
+        glm::vec3 F0 = glm::mix(glm::vec3(0.04f), s.albedo, s.metallic);
+        float NDF = ggx(std::max(glm::dot(N, H), 0.0f), s.roughness);
+        float r = s.roughness + 1.0f;
+        float k = (r * r) / 8.0f;
+        float G = (NdotV / (NdotV * (1.0f - k) + k)) * (NdotL / (NdotL * (1.0f - k) + k));
+        glm::vec3 F = F0 + (glm::vec3(1.0f) - F0) * std::pow(glm::clamp(1.0f - std::max(glm::dot(H, V), 0.0f), 0.0f, 1.0f), 5.0f);
+        glm::vec3 specular = NDF * G * F / (4.0f * NdotV * NdotL + 0.0001f);
+        glm::vec3 kD = (glm::vec3(1.0f) - F) * (1.0f - s.metallic);
+        return kD * s.albedo / PI + specular;
+    }
+
+    static float ggx(float NdotH, float roughness)
+    {
+        const float PI = 3.14159265359f;
+        float a2 = roughness * roughness * roughness * roughness;
+        float denom = NdotH * NdotH * (a2 - 1.0f) + 1.0f;
+        return a2 / (PI * denom * denom);
+    }
+
+    // probability of picking the GGX lobe rather than the cosine lobe when sampling a direction
+    static float specularProbability(const Surface &s)
+    {
+        return s.material->shading == SHADING_PHONG ? 0.0f : 0.5f + 0.4f * s.metallic;
+    }
+
+    // a tangent frame around n
+    static void basis(glm::vec3 n, glm::vec3 &t, glm::vec3 &b)
+    {
+        t = std::fabs(n.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        t = glm::normalize(glm::cross(t, n));
+        b = glm::cross(n, t);
+    }
+
+    // picks the next direction and returns its pdf (solid angle), 0 if the sample is below the surface
+    float sampleDirection(const Surface &s, glm::vec3 V, TraceRandom &random, glm::vec3 &L) const
+    {
+        const float PI = 3.14159265359f;
+        glm::vec3 N = s.normal, T, B;
+        basis(N, T, B);
+        float pSpecular = specularProbability(s);
+        float u1 = random.Uniform(), u2 = random.Uniform();
+        if (random.Uniform() < pSpecular)
+        {
+            // GGX distribution of the half vector
+            float a2 = s.roughness * s.roughness * s.roughness * s.roughness;
+            float cosTheta = std::sqrt((1.0f - u2) / (1.0f + (a2 - 1.0f) * u2));
+            float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+            float phi = 2.0f * PI * u1;
+            glm::vec3 H = T * (sinTheta * std::cos(phi)) + B * (sinTheta * std::sin(phi)) + N * cosTheta;
+            L = glm::reflect(-V, H);
+        }
+        else
+        {
+            // cosine weighted hemisphere
+            float radius = std::sqrt(u1), phi = 2.0f * PI * u2;
+            L = T * (radius * std::cos(phi)) + B * (radius * std::sin(phi)) + N * std::sqrt(std::max(0.0f, 1.0f - u1));
+        }
+        float NdotL = glm::dot(N, L);
+        if (NdotL <= 0.0f || glm::dot(s.geometric, L) <= 0.0f)
+            return 0.0f;
+
+        float pdf = (1.0f - pSpecular) * NdotL / PI;
+        if (pSpecular > 0.0f)
+        {
+            glm::vec3 H = glm::normalize(V + L);
+            float NdotH = std::max(glm::dot(N, H), 0.0f);
+            float HdotV = std::max(glm::dot(H, V), 1e-6f);
+            pdf += pSpecular * ggx(NdotH, s.roughness) * NdotH / (4.0f * HdotV);
+        }
+        return pdf;
+    }
+
+    glm::vec3 tracePath(glm::vec3 origin, glm::vec3 direction, TraceRandom &random, unsigned long long &rayCount) const
+    {
+        glm::vec3 result(0.0f), throughput(1.0f);
+        for (unsigned int bounce = 0; bounce <= maxBounces; bounce++)
+        {
+            Hit hit;
+            hit.t = FLT_MAX;
+            rayCount++;
+            if (!trace(origin, direction, hit, false))
+                break;
+            Surface s = surface(origin, direction, hit);
+            glm::vec3 V = -direction;
+            float epsilon = 1e-4f * std::max(1.0f, hit.t);
+            glm::vec3 offset = s.position + s.geometric * epsilon;
+
+            // next event estimation towards every light
+            for (unsigned int i = 0; i < lightPositions.size(); i++)
+            {
+                glm::vec3 toLight = lightPositions[i] - offset;
+                float distance = glm::length(toLight);
+                glm::vec3 L = toLight / distance;
+                float NdotL = glm::dot(s.normal, L);
+                if (NdotL <= 0.0f || glm::dot(s.geometric, L) <= 0.0f)
+                    continue;
+                Hit shadow;
+                shadow.t = distance;
+                rayCount++;
+                if (trace(offset, L, shadow, true))
+                    continue;
+                result = result + throughput * brdf(s, V, L) * lightColors[i] * (NdotL / (distance * distance));
+            }
+            if (bounce == maxBounces)
+                break;
+
+            glm::vec3 L;
+            float pdf = sampleDirection(s, V, random, L);
+            if (pdf <= 0.0f)
+                break;
+            throughput = throughput * brdf(s, V, L) * (glm::dot(s.normal, L) / pdf);
+
+            // russian roulette once the path has bounced a few times
+            if (bounce >= 2)
+            {
+                float survive = std::min(0.95f, std::max(throughput.x, std::max(throughput.y, throughput.z)));
+                if (random.Uniform() >= survive)
+                    break;
+                throughput = throughput / survive;
+            }
+            origin = offset;
+            direction = L;
+        }
+        return result;
+    }
+
+    void tileWorker(std::atomic<unsigned int> &nextTile, std::atomic<unsigned long long> &rayCount)
+    {
+        PROFILE_SCOPE("trace.worker");
+        int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE, tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+        unsigned long long traced = 0;
+        for (unsigned int tile = nextTile++; tile < (unsigned int)(tilesX * tilesY); tile = nextTile++)
+        {
+            int x0 = (tile % tilesX) * TILE_SIZE, y0 = (tile / tilesX) * TILE_SIZE;
+            for (int y = y0; y < std::min(y0 + TILE_SIZE, height); y++)
+            {
+                for (int x = x0; x < std::min(x0 + TILE_SIZE, width); x++)
+                {
+                    TraceRandom random((uint64_t)y * width + x);
+                    glm::vec3 sum(0.0f);
+                    for (unsigned int i = 0; i < samples; i++)
+                    {
+                        // jittered inside the pixel, y pointing down the image
+                        float sx = ((x + random.Uniform()) / width) * 2.0f - 1.0f;
+                        float sy = 1.0f - ((y + random.Uniform()) / height) * 2.0f;
+                        glm::vec3 direction = glm::normalize(forward + right * sx + up * sy);
+                        glm::vec3 value = tracePath(eye, direction, random, traced);
+                        if (std::isfinite(value.x + value.y + value.z))
+                            sum = sum + value;
+                    }
+                    radiance[(size_t)y * width + x] = sum / (float)samples;
+                }
+            }
+        }
+        rayCount += traced;
+    }
+};
+#endif
@@ -8,31 +8,33 @@ in VS_OUT {
 } fs_in;
 
 uniform sampler2D brickTexture;
+#ifdef NORMAL_MAP
 uniform sampler2D normalMapTex;
+#endif
 
-uniform vec3 lightPositions[4];
+// how many of the lights the scene has, defined by the variant being compiled
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 4
+#endif
+// the array keeps one element without lights, as GLSL has no empty arrays
+#if LIGHT_COUNT > 0
+#define LIGHT_ARRAY_SIZE LIGHT_COUNT
+#else
+#define LIGHT_ARRAY_SIZE 1
+#endif
+uniform vec3 lightPositions[LIGHT_ARRAY_SIZE];
 uniform vec3 viewPos;
-uniform bool blinn;
 uniform float shininess;
 uniform vec3 materialDiffuse;
 uniform vec3 materialSpecular;
 
-// can add normal mapping if needed
- vec3 getNormalFromMap() {
-    vec3 tangentNormal = texture(normalMapTex, fs_in.TexCoords).xyz * 2.0 - 1.0;
+#ifdef NORMAL_MAP
+#include "normalMapping.glsl"
 
-    vec3 Q1  = dFdx(fs_in.FragPos);
-    vec3 Q2  = dFdy(fs_in.FragPos);
-    vec2 st1 = dFdx(fs_in.TexCoords);
-    vec2 st2 = dFdy(fs_in.TexCoords);
-
-    vec3 N   = normalize(fs_in.Normal);
-    vec3 T  = normalize(Q1*st2.t - Q2*st1.t);
-    vec3 B  = -normalize(cross(N, T));
-    mat3 TBN = mat3(T, B, N);
-
-    return normalize(TBN * tangentNormal);
+vec3 getNormalFromMap() {
+    return perturbNormal(unpackNormal(texture(normalMapTex, fs_in.TexCoords).xy), fs_in.Normal, fs_in.FragPos, fs_in.TexCoords);
 }
+#endif
 
 void main()
 {           
@@ -40,31 +42,28 @@ void main()
     // ambient
     vec3 ambient = 0.2 * color;
     // diffuse
-    //vec3 normal = getNormalFromMap();
+#ifdef NORMAL_MAP
+    vec3 normal = getNormalFromMap();
+#else
     vec3 normal = normalize(fs_in.Normal);
+#endif
     float totSpec = 0.0f;
     vec3 totDiff = vec3(0.0f, 0.0f, 0.0f);
-    for(int i = 0; i < 4; i++) {
+    for(int i = 0; i < LIGHT_COUNT; i++) {
         vec3 lightDir = normalize(lightPositions[i] - fs_in.FragPos);
-        //vec3 normal = normalize(fs_in.Normal);
-        // INCLUDE THIS FOR NORMAL MAPPING
         float diff = max(dot(lightDir, normal), 0.0);
         vec3 diffuse = diff * color;
         totDiff = totDiff + diffuse;
         // specular
         vec3 viewDir = normalize(viewPos - fs_in.FragPos);
         vec3 reflectDir = reflect(-lightDir, normal);
-        float spec = 0.0;
-        if(blinn)
-        {
-            vec3 halfwayDir = normalize(lightDir + viewDir);  
-            spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
-        }
-        else
-        {
-            vec3 reflectDir = reflect(-lightDir, normal);
-            spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
-        }
+        // Blinn or Phong, whichever the variant is compiled for
+#ifdef BLINN
+        vec3 halfwayDir = normalize(lightDir + viewDir);  
+        float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
+#else
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+#endif
         totSpec = totSpec + spec;
     }
     vec3 specular = vec3(0.5) * totSpec * materialSpecular; // assuming bright white light color
@@ -1,7 +1,5 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec2 aTexCoords;
+#include "meshVertex.glsl"
 
 // declare an interface block;
 out VS_OUT {
@@ -10,10 +8,6 @@ out VS_OUT {
     vec2 TexCoords;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
-
 void main()
 {
     vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
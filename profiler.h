@@ -0,0 +1,284 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+// a timed scope, times are nanoseconds since the profiler started
+struct ProfileEvent {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+    uint32_t depth;
+};
+
+// Fixed size ring of events written by exactly one thread. The owner publishes each event by advancing head with
+// release ordering, readers copy a snapshot and drop whatever the writer may have overwritten meanwhile, so neither
+// side ever takes a lock.
+struct ProfileThreadBuffer {
+    static const uint32_t CAPACITY = 1 << 16;
+
+    ProfileEvent events[CAPACITY];
+    std::atomic<uint64_t> head;
+    uint32_t depth;
+    uint32_t threadIndex;
+    std::string threadName;
+
+    ProfileThreadBuffer() : head(0), depth(0), threadIndex(0)
+    {
+    }
+
+    void Push(const char *name, uint64_t start, uint64_t end, uint32_t eventDepth)
+    {
+        uint64_t index = head.load(std::memory_order_relaxed);
+        ProfileEvent &event = events[index & (CAPACITY - 1)];
+        event.name = name;
+        event.start = start;
+        event.end = end;
+        event.depth = eventDepth;
+        head.store(index + 1, std::memory_order_release);
+    }
+
+    // copies the events still in the ring, oldest first
+    void Snapshot(std::vector<ProfileEvent> &out) const
+    {
+        uint64_t last = head.load(std::memory_order_acquire);
+        uint64_t first = last > CAPACITY ? last - CAPACITY : 0;
+        size_t begin = out.size();
+        for (uint64_t i = first; i < last; i++)
+            out.push_back(events[i & (CAPACITY - 1)]);
+        // anything the writer wrapped over while copying is no longer valid, including the slot of event now, which
+        // it may be writing at this moment
+        uint64_t now = head.load(std::memory_order_acquire);
+        uint64_t valid = now + 1 > CAPACITY ? now + 1 - CAPACITY : 0;
+        if (valid > first)
+            out.erase(out.begin() + begin, out.begin() + begin + (size_t)std::min(valid - first, last - first));
+    }
+};
+
+// per-scope averages over the last frames
+struct ScopeStat {
+    std::string name;
+    double avgMs;
+    double maxMs;
+    double callsPerFrame;
+};
+
+// Low-overhead CPU profiler. Scopes are recorded into per-thread ring buffers, the main thread marks frame
+// boundaries, and the recorded events can be summarized per scope or written out as a Chrome / Perfetto trace.
+class Profiler
+{
+public:
+    static Profiler &Get()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    std::atomic<bool> enabled;
+
+    uint64_t Now() const
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    // the calling thread's buffer, registered on first use; the profiler owns it, so the events of a thread that
+    // has ended are still in the trace
+    ProfileThreadBuffer &ThreadBuffer()
+    {
+        thread_local ProfileThreadBuffer *buffer = nullptr;
+        if (!buffer)
+        {
+            std::unique_ptr<ProfileThreadBuffer> created(new ProfileThreadBuffer());
+            std::lock_guard<std::mutex> lock(registryMutex);
+            created->threadIndex = (uint32_t)threads.size();
+            created->threadName = threads.empty() ? "main" : "worker " + std::to_string(threads.size());
+            buffer = created.get();
+            threads.push_back(std::move(created));
+        }
+        return *buffer;
+    }
+
+    void SetThreadName(const std::string &name)
+    {
+        ProfileThreadBuffer &buffer = ThreadBuffer();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffer.threadName = name;
+    }
+
+    // marks the end of a frame, called once per frame from the main thread
+    void EndFrame()
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        frameEnds.push_back(Now());
+        if (frameEnds.size() > MAX_FRAMES)
+            frameEnds.erase(frameEnds.begin(), frameEnds.begin() + (frameEnds.size() - MAX_FRAMES));
+    }
+
+    // averages every scope over the last completed frames, sorted by time spent
+    std::vector<ScopeStat> Breakdown(unsigned int frames = 120)
+    {
+        std::vector<ProfileEvent> events;
+        uint64_t from, to;
+        unsigned int counted;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            if (frameEnds.size() < 2)
+                return std::vector<ScopeStat>();
+            counted = std::min<unsigned int>(frames, (unsigned int)frameEnds.size() - 1);
+            from = frameEnds[frameEnds.size() - 1 - counted];
+            to = frameEnds.back();
+            for (unsigned int i = 0; i < threads.size(); i++)
+                threads[i]->Snapshot(events);
+        }
+
+        std::map<std::string, ScopeStat> scopes;
+        for (unsigned int i = 0; i < events.size(); i++)
+        {
+            const ProfileEvent &event = events[i];
+            if (event.start < from || event.end > to)
+                continue;
+            double ms = (event.end - event.start) / 1.0e6;
+            ScopeStat &stat = scopes[event.name];
+            if (stat.name.empty())
+                stat = { event.name, 0.0, 0.0, 0.0 };
+            stat.avgMs += ms;
+            stat.maxMs = std::max(stat.maxMs, ms);
+            stat.callsPerFrame += 1.0;
+        }
+
+        std::vector<ScopeStat> result;
+        for (std::map<std::string, ScopeStat>::iterator it = scopes.begin(); it != scopes.end(); ++it)
+        {
+            it->second.avgMs /= counted;
+            it->second.callsPerFrame /= counted;
+            result.push_back(it->second);
+        }
+        std::sort(result.begin(), result.end(), [](const ScopeStat &a, const ScopeStat &b) { return a.avgMs > b.avgMs; });
+        return result;
+    }
+
+    void PrintBreakdown(unsigned int frames = 120)
+    {
+        std::vector<ScopeStat> stats = Breakdown(frames);
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(3);
+        out << "---- CPU scopes, average over the last " << frames << " frames ----\n";
+        for (unsigned int i = 0; i < stats.size(); i++)
+            out << "  " << stats[i].name << ": " << stats[i].avgMs << " ms (max " << stats[i].maxMs << " ms, " << stats[i].callsPerFrame << " calls/frame)\n";
+        std::cout << out.str();
+    }
+
+    // the breakdown as a JSON array, for the benchmark report
+    std::string BreakdownJson(unsigned int frames = 120)
+    {
+        std::vector<ScopeStat> stats = Breakdown(frames);
+        std::ostringstream json;
+        json.precision(6);
+        json << "[";
+        for (unsigned int i = 0; i < stats.size(); i++)
+        {
+            json << (i ? ",\n    " : "\n    ");
+            json << "{ \"name\": \"" << stats[i].name << "\", \"avg_ms\": " << stats[i].avgMs << ", \"max_ms\": " << stats[i].maxMs
+                 << ", \"calls_per_frame\": " << stats[i].callsPerFrame << " }";
+        }
+        json << (stats.empty() ? "]" : "\n  ]");
+        return json.str();
+    }
+
+    // writes every event still held in the ring buffers in the Chrome trace event format (chrome://tracing, Perfetto)
+    bool WriteChromeTrace(const std::string &path)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::PROFILER::FILE_NOT_WRITABLE: " << path << std::endl;
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(registryMutex);
+        file.setf(std::ios::fixed);
+        file.precision(3);
+        file << "{\"traceEvents\":[\n";
+        bool first = true;
+        for (unsigned int t = 0; t < threads.size(); t++)
+        {
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threads[t]->threadIndex
+                 << ",\"args\":{\"name\":\"" << threads[t]->threadName << "\"}}";
+            first = false;
+
+            std::vector<ProfileEvent> events;
+            threads[t]->Snapshot(events);
+            for (unsigned int i = 0; i < events.size(); i++)
+            {
+                file << ",\n{\"name\":\"" << events[i].name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threads[t]->threadIndex
+                     << ",\"ts\":" << events[i].start / 1000.0 << ",\"dur\":" << (events[i].end - events[i].start) / 1000.0 << "}";
+            }
+        }
+        for (unsigned int i = 0; i < frameEnds.size(); i++)
+            file << ",\n{\"name\":\"frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":" << frameEnds[i] / 1000.0 << "}";
+        file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        return true;
+    }
+
+private:
+    static const unsigned int MAX_FRAMES = 4096;
+
+    std::chrono::steady_clock::time_point epoch;
+    std::mutex registryMutex;
+    std::vector<std::unique_ptr<ProfileThreadBuffer> > threads;
+    std::vector<uint64_t> frameEnds;
+
+    Profiler() : enabled(false), epoch(std::chrono::steady_clock::now())
+    {
+    }
+};
+
+// Times the enclosing scope when the profiler is enabled. The name must outlive the profiler, use string literals.
+class ProfileScope
+{
+public:
+    ProfileScope(const char *name) : name(name), start(0)
+    {
+        Profiler &profiler = Profiler::Get();
+        if (!profiler.enabled.load(std::memory_order_relaxed))
+            return;
+        buffer = &profiler.ThreadBuffer();
+        depth = buffer->depth++;
+        start = profiler.Now();
+    }
+
+    ~ProfileScope()
+    {
+        if (!buffer)
+            return;
+        buffer->Push(name, start, Profiler::Get().Now(), depth);
+        buffer->depth--;
+    }
+
+private:
+    const char *name;
+    uint64_t start;
+    uint32_t depth = 0;
+    ProfileThreadBuffer *buffer = nullptr;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#ifndef DISABLE_PROFILER
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
+#endif
@@ -0,0 +1,1116 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+#include "shaderVariants.h"
+#include "camera.h"
+#include "model.h"
+#include "profiler.h"
+#include "gpuResources.h"
+#include "gpuTimer.h"
+#include "textureCompression.h"
+#include "textureStreamer.h"
+#include "jobSystem.h"
+#include "sceneFile.h"
+#include "entityStore.h"
+#include "stb_image.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cfloat>
+#include <fstream>
+#include <iostream>
+
+unsigned int loadTexture(const char *path, TextureKind kind = TEXTURE_COLOR);
+unsigned int createTexture(const unsigned char *data, int width, int height, int nrComponents, bool srgb = false);
+
+// metallic, roughness and AO are read from one packed texture unless turned off
+bool usePackedOrm = true;
+
+// values that change the scene from frame to frame, driven by key input or a camera path
+struct SceneState {
+    // to rotate the spheres when keys are pressed, indexed by SceneSpin
+    float spins[SPIN_COUNT] = {0.0f, 0.0f, 0.0f, 0.0f};
+    // switch from Phong to Blinn-Phong
+    bool blinn = false;
+};
+
+// counters for the work submitted in a frame
+struct RenderStats {
+    unsigned int drawCalls = 0;
+    unsigned long long triangles = 0;
+    // entities outside the view frustum, not submitted
+    unsigned int culled = 0;
+};
+
+// what each of the maps holds, which decides how it is cooked, filtered and sampled
+const TextureKind PBR_MAP_KINDS[PBR_MAP_COUNT] = {TEXTURE_COLOR, TEXTURE_NORMAL, TEXTURE_GRAY, TEXTURE_GRAY, TEXTURE_GRAY};
+
+// the five maps read by cookTorrance.fs, each holding a reference to its texture
+struct PbrMaterial {
+    std::string name;
+    GpuTexture albedo;
+    GpuTexture normal;
+    GpuTexture metallic;
+    GpuTexture roughness;
+    GpuTexture ao;
+    // AO, roughness and metallic in red, green and blue, used instead of the three maps when the scene packs them
+    GpuTexture orm;
+    // the image files of the maps, indexed by PbrMap, for the CPU renderers
+    std::string paths[PBR_MAP_COUNT];
+    // written by --cook; packed while loading when it doesn't exist
+    std::string ormPath;
+};
+
+// albedo map and coefficients read by phongShader.fs
+struct PhongMaterial {
+    std::string name;
+    GpuTexture albedo;
+    std::string albedoPath;
+    float shininess;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+};
+
+// a vertex array drawn with a single call, with a CPU copy of its vertices (position, normal, texcoords) and indices
+struct Geometry {
+    unsigned int VAO = 0;
+    GLenum mode = GL_TRIANGLES;
+    unsigned int count = 0;
+    bool indexed = false;
+    unsigned int triangles = 0;
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    // the GL objects behind VAO, shared by copies of the geometry
+    GpuVertexArray vertexArray;
+    GpuBuffer vertexBuffer, indexBuffer;
+};
+
+// one object to draw this frame: either a geometry or a model, with a material of the given shading model
+struct DrawItem {
+    ShadingModel shading;
+    int material;
+    const Geometry *geometry;
+    Model *model;
+    glm::mat4 transform;
+};
+
+// The scene described by the scene file: the room with its spheres and chairs unless --scene names another one.
+// Owns the shaders, meshes and textures and draws them for a given camera, so the interactive window and the
+// offscreen modes render exactly the same frame. A scene created without gpu only holds the CPU side (geometry,
+// texture paths, the draw list) for the software renderers and needs no context.
+class Scene
+{
+public:
+    bool gpu;
+    // the Cook-Torrance shader is compiled with PACKED_ORM and materials load packed ORM textures
+    bool packedOrm;
+    // the variants of the two shaders the draws have used so far
+    ShaderVariants cookTorranceShaders;
+    ShaderVariants phongShaders;
+
+    // what the scene was built from
+    SceneDescription description;
+    // the quads of the scene file, the models it imports and the sphere shared by every sphere in the scene
+    vector<Geometry> geometries;
+    vector<Model> models;
+    Geometry sphere;
+
+    vector<PbrMaterial> pbrMaterials;
+    vector<PhongMaterial> phongMaterials;
+
+    // the instances and lights of the scene file
+    EntityStore entities;
+
+    RenderStats stats;
+
+    // cooked maps are registered with the streamer instead of loaded whole
+    bool streaming;
+    TextureStreamer streamer;
+
+    // reads the scene file and builds its shaders, meshes and materials. The images loaded whole are decoded on
+    // the job system while the models are imported, and uploaded once both are done. Models keep their vertices
+    // only for the CPU renderers and the streamer's bounds.
+    Scene(bool gpu = true) : gpu(gpu), packedOrm(usePackedOrm), streaming(gpu && useTextureStreaming), streamer(textureBudgetMB << 20)
+    {
+        if (gpu)
+        {
+            cookTorranceShaders = ShaderVariants("cookTorrance.vs", "cookTorrance.fs");
+            phongShaders = ShaderVariants("phongShader.vs", "phongShader.fs");
+        }
+        description.Load(sceneFile);
+        setupMaterials();
+        JobCounter decoding;
+        prepareImages(decoding);
+        {
+            PROFILE_SCOPE("load.geometry");
+            setupGeometry();
+        }
+        JobSystem::Get().Wait(decoding);
+        {
+            PROFILE_SCOPE("load.materials");
+            loadMaterials();
+        }
+        setupLights();
+        setupEntities();
+    }
+
+    // lists everything to draw for the given state, in submission order
+    vector<DrawItem> BuildDrawList(const SceneState &state)
+    {
+        entities.UpdateTransforms(state.spins);
+        entities.All(submitted);
+        return drawItems(submitted);
+    }
+
+    // renders the scene from the camera into the currently bound framebuffer, one pass per shading model, leaving
+    // out the entities outside the view
+    void Draw(Camera &camera, const SceneState &state, const glm::mat4 &projection)
+    {
+        vector<DrawItem> items;
+        {
+            PROFILE_SCOPE("scene.drawList");
+            entities.UpdateTransforms(state.spins);
+            entities.Cull(Frustum(projection * camera.GetViewMatrix()), submitted);
+            items = drawItems(submitted);
+        }
+        DrawList(items, camera, state, projection);
+        stats.culled = (unsigned int)(entities.Count() - submitted.size());
+    }
+
+    // renders any list of items with the scene's programs, geometry and lights
+    void DrawList(const vector<DrawItem> &items, Camera &camera, const SceneState &state, const glm::mat4 &projection)
+    {
+        stats = RenderStats();
+        glm::mat4 view = camera.GetViewMatrix();
+        if (streaming)
+            requestTextures(items, camera, projection);
+
+        {
+            RENDER_PASS("pass.cookTorrance");
+            drawPass(items, SHADING_COOK_TORRANCE, state, camera, view, projection);
+        }
+
+        {
+            RENDER_PASS("pass.phong");
+            drawPass(items, SHADING_PHONG, state, camera, view, projection);
+        }
+        glBindVertexArray(0);
+    }
+
+    // compiles the shader variants built from any of the files again in the background, reading them anew
+    void ReloadShaders(const std::vector<std::string> &changed)
+    {
+        for (size_t i = 0; i < changed.size(); i++)
+            ShaderPreprocessor::Get().Invalidate(changed[i]);
+        cookTorranceShaders.Reload(changed);
+        phongShaders.Reload(changed);
+    }
+
+    // swaps in the reloaded variants that are done, between frames
+    void UpdateShaders()
+    {
+        cookTorranceShaders.Update();
+        phongShaders.Update();
+    }
+
+    // changes whenever ShaderSources may have
+    unsigned int ShaderSourcesVersion() const
+    {
+        return cookTorranceShaders.SourcesVersion() + phongShaders.SourcesVersion();
+    }
+
+    // the files of every shader variant compiled so far, includes included
+    std::vector<std::string> ShaderSources() const
+    {
+        std::vector<std::string> files;
+        cookTorranceShaders.Sources(files);
+        phongShaders.Sources(files);
+        return files;
+    }
+
+    // a sphere of radius one drawn with a material of the given shading model
+    DrawItem Sphere(ShadingModel shading, int material, const glm::mat4 &transform) const
+    {
+        return drawGeometry(shading, material, &sphere, transform);
+    }
+
+    // index of the named material of a shading model, -1 if there is none
+    int FindMaterial(ShadingModel shading, const std::string &name) const
+    {
+        if (shading == SHADING_PHONG)
+        {
+            for (unsigned int i = 0; i < phongMaterials.size(); i++)
+                if (phongMaterials[i].name == name)
+                    return (int)i;
+            return -1;
+        }
+        for (unsigned int i = 0; i < pbrMaterials.size(); i++)
+            if (pbrMaterials[i].name == name)
+                return (int)i;
+        return -1;
+    }
+
+    // a 1x1 texture of a constant value, created once per value, to stand in for a map
+    GpuTexture ConstantTexture(glm::vec3 value)
+    {
+        unsigned char texel[3];
+        for (int c = 0; c < 3; c++)
+            texel[c] = (unsigned char)(glm::clamp(value[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+        unsigned int key = texel[0] | (texel[1] << 8) | (texel[2] << 16);
+        std::map<unsigned int, GpuTexture>::iterator found = constantTextures.find(key);
+        if (found != constantTextures.end())
+            return found->second;
+
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, texel);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        return constantTextures[key] = GpuTexture::Track(textureID, 3, "constant");
+    }
+
+    // packs the AO, roughness and metallic maps of a material, with constant roughness or metallic values where
+    // they are not negative, and constants for maps without an image
+    GpuTexture PackedOrmTexture(const PbrMaterial &material, float roughness = -1.0f, float metallic = -1.0f)
+    {
+        PackedChannel channels[3] = {
+            {material.paths[PBR_AO], 1.0f},
+            {roughness < 0.0f ? material.paths[PBR_ROUGHNESS] : "", roughness < 0.0f ? 0.5f : roughness},
+            {metallic < 0.0f ? material.paths[PBR_METALLIC] : "", metallic < 0.0f ? 0.0f : metallic},
+        };
+        std::vector<unsigned char> rgb;
+        int width, height;
+        TextureCooker::PackChannels(channels, rgb, width, height);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        unsigned int textureID = createTexture(&rgb[0], width, height, 3);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        return GpuTexture(textureID);
+    }
+
+private:
+    // the constant textures by their texel, kept for the materials created later
+    std::map<unsigned int, GpuTexture> constantTextures;
+
+    // the entities drawn this frame
+    vector<Entity> submitted;
+
+    // an image decoded on the job system before the textures are uploaded: a map loaded whole, or the AO,
+    // roughness and metallic maps of a material packed into one
+    struct PreparedImage {
+        std::string path;
+        TextureKind kind;
+        bool packed;
+        PackedChannel channels[3];
+        int width, height, components;
+        unsigned char *pixels;
+        std::vector<unsigned char> packedPixels;
+
+        const unsigned char *Data() const
+        {
+            return packed ? (packedPixels.empty() ? NULL : &packedPixels[0]) : pixels;
+        }
+    };
+    vector<PreparedImage> prepared;
+
+    // the geometry or model of each mesh of the scene file
+    vector<const Geometry *> meshGeometries;
+    vector<Model *> meshModels;
+
+    // the bounding sphere of a geometry or model in object space, and how many texture coordinates a unit of its
+    // surface spans on average
+    struct MeshBounds {
+        glm::vec3 center;
+        float radius;
+        float uvPerUnit;
+    };
+    std::map<const void *, MeshBounds> meshBounds;
+
+    // draws the items of a shading model, grouped by the variant of its shader they need in the order each variant
+    // is first needed, so the per-frame uniforms are set once per variant
+    void drawPass(const vector<DrawItem> &items, ShadingModel shading, const SceneState &state, Camera &camera, const glm::mat4 &view, const glm::mat4 &projection)
+    {
+        vector<uint32_t> keys(items.size());
+        vector<uint32_t> used;
+        for (unsigned int i = 0; i < items.size(); i++)
+        {
+            if (items[i].shading != shading)
+                continue;
+            keys[i] = variantKey(items[i], state);
+            if (std::find(used.begin(), used.end(), keys[i]) == used.end())
+                used.push_back(keys[i]);
+        }
+        for (unsigned int v = 0; v < used.size(); v++)
+        {
+            Shader &program = variant(shading, used[v]);
+            program.use();
+            program.setMat4("projection", projection);
+            program.setMat4("view", view);
+            program.setVec3(shading == SHADING_PHONG ? "viewPos" : "camPos", camera.Position);
+            for (unsigned int i = 0; i < entities.lightPositions.size(); ++i)
+            {
+                program.setVec3("lightPositions[" + std::to_string(i) + "]", entities.lightPositions[i]);
+                if (shading == SHADING_COOK_TORRANCE)
+                    program.setVec3("lightColors[" + std::to_string(i) + "]", entities.lightColors[i]);
+            }
+            drawVariant(items, keys, shading, used[v], program);
+        }
+    }
+
+    // the shader variant an item is drawn with: Blinn or Phong as the state says, the normal map where the
+    // material has one (models bind their own), packed ORM textures if the scene loads them, and the scene's lights
+    uint32_t variantKey(const DrawItem &item, const SceneState &state) const
+    {
+        unsigned int features = 0;
+        if (item.shading == SHADING_PHONG)
+            features |= state.blinn ? SHADER_BLINN : 0;
+        else
+        {
+            if (item.model || !pbrMaterials[item.material].paths[PBR_NORMAL].empty())
+                features |= SHADER_NORMAL_MAP;
+            if (packedOrm)
+                features |= SHADER_PACKED_ORM;
+        }
+        return ShaderVariantKey(features, (unsigned int)entities.lightPositions.size());
+    }
+
+    // the program of a variant, with its samplers assigned to the units the materials bind when it is compiled
+    Shader &variant(ShadingModel shading, uint32_t key)
+    {
+        bool compiled = false;
+        if (shading == SHADING_PHONG)
+        {
+            Shader &program = phongShaders.Get(key, &compiled);
+            if (compiled)
+            {
+                program.use();
+                program.setInt("brickTexture", 0);
+            }
+            return program;
+        }
+        Shader &program = cookTorranceShaders.Get(key, &compiled);
+        if (compiled)
+        {
+            // define each of the maps as locations
+            program.use();
+            program.setInt("albedoMap", PBR_ALBEDO);
+            program.setInt("normalMap", PBR_NORMAL);
+            if (packedOrm)
+                program.setInt("ormMap", PBR_ORM);
+            else
+            {
+                program.setInt("metallicMap", PBR_METALLIC);
+                program.setInt("roughnessMap", PBR_ROUGHNESS);
+                program.setInt("aoMap", PBR_AO);
+            }
+        }
+        return program;
+    }
+
+    // draws the items of one variant, in order
+    void drawVariant(const vector<DrawItem> &items, const vector<uint32_t> &keys, ShadingModel shading, uint32_t key, Shader &program)
+    {
+        int boundMaterial = -1;
+        for (unsigned int i = 0; i < items.size(); i++)
+        {
+            const DrawItem &item = items[i];
+            if (item.shading != shading || keys[i] != key)
+                continue;
+            // only rebind textures when the material changes
+            if (item.material != boundMaterial)
+            {
+                if (shading == SHADING_PHONG)
+                    bindPhongMaterial(phongMaterials[item.material], program);
+                else
+                    bindPbrMaterial(pbrMaterials[item.material]);
+                boundMaterial = item.material;
+            }
+            program.setMat4("model", item.transform);
+
+            if (item.model)
+            {
+                item.model->Draw(program, item.transform);
+                stats.drawCalls += item.model->meshes.size();
+                for (unsigned int m = 0; m < item.model->meshes.size(); m++)
+                    stats.triangles += item.model->meshes[m].indexCount / 3;
+                // the model's meshes bind their own textures, so the material has to be bound again afterwards
+                boundMaterial = -1;
+            }
+            else
+            {
+                glBindVertexArray(item.geometry->VAO);
+                if (item.geometry->indexed)
+                    glDrawElements(item.geometry->mode, item.geometry->count, GL_UNSIGNED_INT, 0);
+                else
+                    glDrawArrays(item.geometry->mode, 0, item.geometry->count);
+                stats.drawCalls++;
+                stats.triangles += item.geometry->triangles;
+            }
+        }
+    }
+
+    // asks the streamer for the mip level of every map drawn this frame, from the distance of each item to the
+    // camera and the texture density of its surface
+    void requestTextures(const vector<DrawItem> &items, const Camera &camera, const glm::mat4 &projection)
+    {
+        PROFILE_SCOPE("streaming.request");
+        streamer.BeginFrame();
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        // pixels spanned by a unit of length facing the camera at a distance of one
+        float pixelsPerUnit = projection[1][1] * viewport[3] * 0.5f;
+        for (unsigned int i = 0; i < items.size(); i++)
+        {
+            const DrawItem &item = items[i];
+            const MeshBounds &bounds = item.model ? modelBounds(item.model) : geometryBounds(item.geometry);
+            glm::vec3 center = glm::vec3(item.transform * glm::vec4(bounds.center, 1.0f));
+            float scale = std::max(glm::length(glm::vec3(item.transform[0])), std::max(glm::length(glm::vec3(item.transform[1])), glm::length(glm::vec3(item.transform[2]))));
+            float radius = bounds.radius * scale;
+            // behind the camera
+            if (glm::dot(center - camera.Position, camera.Front) < -radius)
+                continue;
+            // the nearest point of the item decides the finest level it needs
+            float distance = std::max(glm::length(center - camera.Position) - radius, 0.1f);
+            float uvPerPixel = bounds.uvPerUnit / scale * distance / pixelsPerUnit;
+            if (item.shading == SHADING_PHONG)
+            {
+                streamer.Request(phongMaterials[item.material].albedo.Name(), uvPerPixel);
+                continue;
+            }
+            const PbrMaterial &material = pbrMaterials[item.material];
+            streamer.Request(material.albedo.Name(), uvPerPixel);
+            streamer.Request(material.normal.Name(), uvPerPixel);
+            if (packedOrm)
+                streamer.Request(material.orm.Name(), uvPerPixel);
+            else
+            {
+                streamer.Request(material.metallic.Name(), uvPerPixel);
+                streamer.Request(material.roughness.Name(), uvPerPixel);
+                streamer.Request(material.ao.Name(), uvPerPixel);
+            }
+        }
+        streamer.Update();
+    }
+
+    const MeshBounds &geometryBounds(const Geometry *geometry)
+    {
+        std::map<const void *, MeshBounds>::iterator found = meshBounds.find(geometry);
+        if (found != meshBounds.end())
+            return found->second;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> uvs;
+        for (size_t v = 0; v + 8 <= geometry->vertices.size(); v += 8)
+        {
+            positions.push_back(glm::vec3(geometry->vertices[v], geometry->vertices[v + 1], geometry->vertices[v + 2]));
+            uvs.push_back(glm::vec2(geometry->vertices[v + 6], geometry->vertices[v + 7]));
+        }
+        std::vector<unsigned int> triangles;
+        for (unsigned int t = 0; t < geometry->triangles; t++)
+        {
+            // a strip makes a triangle of every three consecutive vertices, a list of every three after another
+            unsigned int first = geometry->mode == GL_TRIANGLE_STRIP ? t : t * 3;
+            for (unsigned int corner = 0; corner < 3; corner++)
+                triangles.push_back(geometry->indexed ? geometry->indices[first + corner] : first + corner);
+        }
+        return meshBounds[geometry] = computeBounds(positions, uvs, triangles);
+    }
+
+    const MeshBounds &modelBounds(const Model *model)
+    {
+        std::map<const void *, MeshBounds>::iterator found = meshBounds.find(model);
+        if (found != meshBounds.end())
+            return found->second;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> uvs;
+        std::vector<unsigned int> triangles;
+        for (unsigned int m = 0; m < model->meshes.size(); m++)
+        {
+            const Mesh &mesh = model->meshes[m];
+            unsigned int base = (unsigned int)positions.size();
+            const glm::mat4 &transform = model->MeshTransform(m);
+            for (unsigned int v = 0; v < mesh.vertices.size(); v++)
+            {
+                positions.push_back(model->IsFlat() ? mesh.vertices[v].Position : glm::vec3(transform * glm::vec4(mesh.vertices[v].Position, 1.0f)));
+                uvs.push_back(mesh.vertices[v].TexCoords);
+            }
+            for (unsigned int index = 0; index < mesh.indices.size(); index++)
+                triangles.push_back(base + mesh.indices[index]);
+        }
+        return meshBounds[model] = computeBounds(positions, uvs, triangles);
+    }
+
+    static MeshBounds computeBounds(const std::vector<glm::vec3> &positions, const std::vector<glm::vec2> &uvs, const std::vector<unsigned int> &triangles)
+    {
+        MeshBounds bounds = { glm::vec3(0.0f), 0.0f, 1.0f };
+        if (positions.empty())
+            return bounds;
+        glm::vec3 low = positions[0], high = positions[0];
+        for (size_t v = 1; v < positions.size(); v++)
+        {
+            low = glm::min(low, positions[v]);
+            high = glm::max(high, positions[v]);
+        }
+        bounds.center = (low + high) * 0.5f;
+        for (size_t v = 0; v < positions.size(); v++)
+            bounds.radius = std::max(bounds.radius, glm::length(positions[v] - bounds.center));
+
+        // the ratio of the areas is the square of the ratio of the lengths
+        double area = 0.0, uvArea = 0.0;
+        for (size_t t = 0; t + 3 <= triangles.size(); t += 3)
+        {
+            unsigned int a = triangles[t], b = triangles[t + 1], c = triangles[t + 2];
+            area += glm::length(glm::cross(positions[b] - positions[a], positions[c] - positions[a])) * 0.5;
+            glm::vec2 u = uvs[b] - uvs[a], w = uvs[c] - uvs[a];
+            uvArea += std::abs(u.x * w.y - u.y * w.x) * 0.5;
+        }
+        if (area > 0.0 && uvArea > 0.0)
+            bounds.uvPerUnit = (float)std::sqrt(uvArea / area);
+        return bounds;
+    }
+
+    DrawItem drawGeometry(ShadingModel shading, int material, const Geometry *geometry, const glm::mat4 &transform) const
+    {
+        DrawItem item = { shading, material, geometry, nullptr, transform };
+        return item;
+    }
+
+    // binds the textures the material's handles resolve to, none for a handle whose texture was released
+    void bindPbrMaterial(const PbrMaterial &material)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, material.albedo.Name());
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, material.normal.Name());
+        if (packedOrm)
+        {
+            glActiveTexture(GL_TEXTURE0 + PBR_ORM);
+            glBindTexture(GL_TEXTURE_2D, material.orm.Name());
+            return;
+        }
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, material.metallic.Name());
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, material.roughness.Name());
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, material.ao.Name());
+    }
+
+    void bindPhongMaterial(const PhongMaterial &material, Shader &program)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, material.albedo.Name());
+        // set shininess, diffuse and specular values for the material
+        program.setFloat("shininess", material.shininess);
+        program.setVec3("materialDiffuse", material.diffuse);
+        program.setVec3("materialSpecular", material.specular);
+    }
+
+    // uploads a quad of the scene file as two triangles of 6 vertices with positions, normals and texcoords
+    Geometry createQuad(const SceneMesh &mesh)
+    {
+        // the corners of the two triangles and their texture coordinates
+        static const int corners[6] = {0, 1, 2, 0, 2, 3};
+        static const float uvs[4][2] = {{1.0f, 0.0f}, {0.0f, 0.0f}, {0.0f, 1.0f}, {1.0f, 1.0f}};
+        float vertices[6 * 8];
+        for (int v = 0; v < 6; v++)
+        {
+            float *vertex = &vertices[v * 8];
+            for (int c = 0; c < 3; c++)
+            {
+                vertex[c] = mesh.corners[corners[v]][c];
+                vertex[3 + c] = mesh.normal[c];
+            }
+            vertex[6] = uvs[corners[v]][0] * mesh.tiling;
+            vertex[7] = uvs[corners[v]][1] * mesh.tiling;
+        }
+
+        Geometry quad;
+        quad.mode = GL_TRIANGLES;
+        quad.count = 6;
+        quad.triangles = 2;
+        quad.vertices.assign(vertices, vertices + 6 * 8);
+        if (!gpu)
+            return quad;
+
+        unsigned int VBO;
+        glGenVertexArrays(1, &quad.VAO);
+        glGenBuffers(1, &VBO);
+        quad.vertexArray = GpuVertexArray::Track(quad.VAO, 0, mesh.name);
+        quad.vertexBuffer = GpuBuffer::Track(VBO, 6 * 8 * sizeof(float), mesh.name + " vertices");
+        glBindVertexArray(quad.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, 6 * 8 * sizeof(float), vertices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+        glBindVertexArray(0);
+        return quad;
+    }
+
+    // creates the meshes of the scene file; the vectors are reserved up front so the pointers to their elements
+    // in the draw items stay valid
+    void setupGeometry()
+    {
+        setupSphere();
+        const vector<SceneMesh> &meshes = description.meshes;
+        geometries.reserve(meshes.size());
+        models.reserve(meshes.size());
+        meshGeometries.assign(meshes.size(), NULL);
+        meshModels.assign(meshes.size(), NULL);
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            if (meshes[i].kind == SCENE_MESH_QUAD)
+            {
+                geometries.push_back(createQuad(meshes[i]));
+                meshGeometries[i] = &geometries.back();
+            }
+            else if (meshes[i].kind == SCENE_MESH_MODEL)
+            {
+                models.push_back(Model(meshes[i].path, meshes[i].gamma, gpu, useTextureStreaming));
+                meshModels[i] = &models.back();
+            }
+            else
+                meshGeometries[i] = &sphere;
+        }
+    }
+
+    // creates the sphere as a single indexed triangle strip
+    void setupSphere()
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> uv;
+        std::vector<glm::vec3> normals;
+        std::vector<unsigned int> indices;
+
+        const unsigned int X_SEGMENTS = 64;
+        const unsigned int Y_SEGMENTS = 64;
+        const float PI = 3.14159265359f;
+        for (unsigned int x = 0; x <= X_SEGMENTS; ++x) {
+            for (unsigned int y = 0; y <= Y_SEGMENTS; ++y) {
+                float xSegment = (float)x / (float)X_SEGMENTS;
+                float ySegment = (float)y / (float)Y_SEGMENTS;
+                float xPos = std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
+                float yPos = std::cos(ySegment * PI);
+                float zPos = std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
+
+                positions.push_back(glm::vec3(xPos, yPos, zPos));
+                uv.push_back(glm::vec2(xSegment, ySegment));
+                normals.push_back(glm::vec3(xPos, yPos, zPos));
+            }
+        }
+
+        bool oddRow = false;
+        for (unsigned int y = 0; y < Y_SEGMENTS; ++y) {
+            // even rows: y == 0, y == 2; and so on
+            if (!oddRow) {
+                for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
+                {
+                    indices.push_back(y * (X_SEGMENTS + 1) + x);
+                    indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+                }
+            }
+            else {
+                for (int x = X_SEGMENTS; x >= 0; --x) {
+                    indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+                    indices.push_back(y * (X_SEGMENTS + 1) + x);
+                }
+            }
+            oddRow = !oddRow;
+        }
+        sphere.mode = GL_TRIANGLE_STRIP;
+        sphere.indexed = true;
+        sphere.count = static_cast<unsigned int>(indices.size());
+        sphere.triangles = sphere.count - 2;
+
+        std::vector<float> data;
+        for (unsigned int i = 0; i < positions.size(); ++i) {
+            data.push_back(positions[i].x);
+            data.push_back(positions[i].y);
+            data.push_back(positions[i].z);
+            if (normals.size() > 0) {
+                data.push_back(normals[i].x);
+                data.push_back(normals[i].y);
+                data.push_back(normals[i].z);
+            }
+            if (uv.size() > 0) {
+                data.push_back(uv[i].x);
+                data.push_back(uv[i].y);
+            }
+        }
+        sphere.vertices = data;
+        sphere.indices = indices;
+        if (!gpu)
+            return;
+
+        glGenVertexArrays(1, &sphere.VAO);
+        unsigned int vbo, ebo;
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        sphere.vertexArray = GpuVertexArray::Track(sphere.VAO, 0, "sphere");
+        sphere.vertexBuffer = GpuBuffer::Track(vbo, data.size() * sizeof(float), "sphere vertices");
+        sphere.indexBuffer = GpuBuffer::Track(ebo, indices.size() * sizeof(unsigned int), "sphere indices");
+        glBindVertexArray(sphere.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        unsigned int stride = (3 + 2 + 3) * sizeof(float);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+        glBindVertexArray(0);
+    }
+
+    // records the materials of the scene file with the paths of their maps; loadMaterials creates their textures
+    void setupMaterials()
+    {
+        for (size_t i = 0; i < description.materials.size(); i++)
+        {
+            const SceneMaterial &source = description.materials[i];
+            if (source.shading == SHADING_PHONG)
+            {
+                PhongMaterial material;
+                material.name = source.name;
+                material.albedoPath = source.maps[PBR_ALBEDO];
+                // shininess, diffuse and specular values for the material
+                material.shininess = source.shininess;
+                material.diffuse = source.diffuse;
+                material.specular = source.specular;
+                phongMaterials.push_back(material);
+                continue;
+            }
+            PbrMaterial material;
+            material.name = source.name;
+            for (int map = 0; map < PBR_MAP_COUNT; map++)
+                material.paths[map] = source.maps[map];
+            const std::string &albedoPath = source.maps[PBR_ALBEDO];
+            material.ormPath = albedoPath.substr(0, albedoPath.find_last_of('/') + 1) + source.name + "_orm.png";
+            pbrMaterials.push_back(material);
+        }
+    }
+
+    // starts decoding every image loadMaterials will upload whole on the job system: the maps without a cooked
+    // version the GPU can sample, and the packed ORM textures --cook hasn't written
+    void prepareImages(JobCounter &counter)
+    {
+        if (!gpu)
+            return;
+        for (size_t i = 0; i < pbrMaterials.size(); i++)
+        {
+            const PbrMaterial &material = pbrMaterials[i];
+            prepareImage(material.paths[PBR_ALBEDO], TEXTURE_COLOR);
+            prepareImage(material.paths[PBR_NORMAL], TEXTURE_NORMAL);
+            if (!packedOrm)
+            {
+                prepareImage(material.paths[PBR_METALLIC], TEXTURE_GRAY);
+                prepareImage(material.paths[PBR_ROUGHNESS], TEXTURE_GRAY);
+                prepareImage(material.paths[PBR_AO], TEXTURE_GRAY);
+            }
+            else if (!AssetPack::Exists(material.ormPath))
+            {
+                PreparedImage image = { material.ormPath, TEXTURE_ORM, true,
+                                        {{material.paths[PBR_AO], 1.0f}, {material.paths[PBR_ROUGHNESS], 0.5f}, {material.paths[PBR_METALLIC], 0.0f}},
+                                        0, 0, 3, NULL, std::vector<unsigned char>() };
+                prepared.push_back(image);
+            }
+        }
+        for (size_t i = 0; i < phongMaterials.size(); i++)
+            prepareImage(phongMaterials[i].albedoPath, TEXTURE_COLOR_RAW);
+
+        // the list is complete before the first job starts, so each job owns its element
+        for (size_t i = 0; i < prepared.size(); i++)
+        {
+            PreparedImage *image = &prepared[i];
+            JobSystem::Get().Run([image]() { decodeImage(*image); }, &counter);
+        }
+    }
+
+    void prepareImage(const std::string &path, TextureKind kind)
+    {
+        BlockFormat formats[2];
+        if (findPrepared(path) || (useCookedTextures && findCookedFormats(path, kind, formats) > 0))
+            return;
+        PreparedImage image = { path, kind, false, {}, 0, 0, 0, NULL, std::vector<unsigned char>() };
+        prepared.push_back(image);
+    }
+
+    static void decodeImage(PreparedImage &image)
+    {
+        PROFILE_SCOPE("load.decodeImage");
+        if (image.packed)
+            TextureCooker::PackChannels(image.channels, image.packedPixels, image.width, image.height);
+        else
+            image.pixels = AssetPack::LoadImage(image.path, &image.width, &image.height, &image.components, 0);
+    }
+
+    const PreparedImage *findPrepared(const std::string &path) const
+    {
+        for (size_t i = 0; i < prepared.size(); i++)
+            if (prepared[i].path == path)
+                return &prepared[i];
+        return NULL;
+    }
+
+    // creates the textures of the materials, from the prepared images where there are some, and frees those
+    void loadMaterials()
+    {
+        if (!gpu)
+            return;
+        for (size_t i = 0; i < pbrMaterials.size(); i++)
+        {
+            PbrMaterial &material = pbrMaterials[i];
+            material.albedo = streamTexture(material.paths[PBR_ALBEDO], TEXTURE_COLOR);
+            material.normal = streamTexture(material.paths[PBR_NORMAL], TEXTURE_NORMAL);
+            if (packedOrm)
+                material.orm = loadOrmTexture(material);
+            else
+            {
+                material.metallic = streamTexture(material.paths[PBR_METALLIC], TEXTURE_GRAY);
+                material.roughness = streamTexture(material.paths[PBR_ROUGHNESS], TEXTURE_GRAY);
+                material.ao = streamTexture(material.paths[PBR_AO], TEXTURE_GRAY);
+            }
+        }
+
+        // the textures of the concrete ball and brick ball
+        for (size_t i = 0; i < phongMaterials.size(); i++)
+            phongMaterials[i].albedo = streamTexture(phongMaterials[i].albedoPath, TEXTURE_COLOR_RAW);
+
+        for (size_t i = 0; i < prepared.size(); i++)
+            if (prepared[i].pixels)
+                stbi_image_free(prepared[i].pixels);
+        prepared.clear();
+    }
+
+    // the cooked packed texture, or the maps packed while loading if --cook hasn't written it
+    GpuTexture loadOrmTexture(const PbrMaterial &material)
+    {
+        if (AssetPack::Exists(material.ormPath))
+            return streamTexture(material.ormPath, TEXTURE_ORM);
+        const PreparedImage *image = findPrepared(material.ormPath);
+        if (!image || !image->Data())
+        {
+            PROFILE_SCOPE("load.packOrm");
+            return PackedOrmTexture(material);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        unsigned int textureID = createTexture(image->Data(), image->width, image->height, 3);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        return GpuTexture(textureID);
+    }
+
+    // registers the cooked texture of a map with the streamer, or loads the map whole when it isn't streamed; the
+    // reference returned shares a streamed texture with the streamer
+    GpuTexture streamTexture(const std::string &path, TextureKind kind)
+    {
+        unsigned int textureID = streaming && useCookedTextures ? streamer.Register(path, kind) : 0;
+        if (!textureID)
+        {
+            const PreparedImage *image = findPrepared(path);
+            if (image && image->Data())
+            {
+                PROFILE_SCOPE("load.texture");
+                textureID = createTexture(image->Data(), image->width, image->height, image->components, kind == TEXTURE_COLOR);
+            }
+            else
+                textureID = loadTexture(path.c_str(), kind);
+            return GpuTexture(textureID);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return GpuTexture(textureID);
+    }
+
+    // the scene file's lights, as many as it has since the shaders are compiled for the count
+    void setupLights()
+    {
+        for (size_t i = 0; i < description.lights.size(); i++)
+            entities.AddLight(description.lights[i].position, description.lights[i].color);
+    }
+
+    // creates an entity for every instance of the scene file, resolved to its mesh and material, with the steps
+    // of its transform before a spin applied and those after it kept for the spin component
+    void setupEntities()
+    {
+        // the entities of the named instances, which the instances after them can be placed relative to
+        std::map<std::string, Entity> named;
+        for (size_t i = 0; i < description.instances.size(); i++)
+        {
+            const SceneInstance &source = description.instances[i];
+            int parent = -1;
+            if (!source.parent.empty())
+            {
+                std::map<std::string, Entity>::const_iterator found = named.find(source.parent);
+                if (found == named.end())
+                {
+                    std::cout << "ERROR::SCENE::UNKNOWN_PARENT: " << source.parent << std::endl;
+                    continue;
+                }
+                parent = (int)found->second;
+            }
+            int mesh = description.FindMesh(source.mesh);
+            int material = FindMaterial(source.shading, source.material);
+            if (mesh < 0 || material < 0)
+            {
+                std::cout << "ERROR::SCENE::UNKNOWN_" << (mesh < 0 ? "MESH: " + source.mesh : "MATERIAL: " + source.material) << std::endl;
+                continue;
+            }
+            // models bind their own maps and are drawn with the Cook-Torrance shader only
+            if (meshModels[mesh] && source.shading != SHADING_COOK_TORRANCE)
+            {
+                std::cout << "ERROR::SCENE::MODEL_NEEDS_COOKTORRANCE: " << source.mesh << std::endl;
+                continue;
+            }
+            glm::mat4 before = glm::mat4(1.0f), after = glm::mat4(1.0f);
+            int spin = -1;
+            bool hasAfter = false;
+            for (size_t s = 0; s < source.steps.size(); s++)
+            {
+                const SceneTransformStep &step = source.steps[s];
+                if (step.op == TRANSFORM_SPIN)
+                {
+                    spin = FindSpin(step.spin);
+                    if (spin < 0)
+                        std::cout << "ERROR::SCENE::UNKNOWN_SPIN: " << step.spin << std::endl;
+                    continue;
+                }
+                glm::mat4 &transform = spin >= 0 ? after : before;
+                hasAfter = spin >= 0;
+                if (step.op == TRANSFORM_TRANSLATE)
+                    transform = glm::translate(transform, step.value);
+                else if (step.op == TRANSFORM_SCALE)
+                    transform = glm::scale(transform, step.value);
+                else
+                    transform = glm::rotate(transform, step.angle, step.value);
+            }
+            glm::vec4 bounds = meshModels[mesh] ? modelSphere(*meshModels[mesh]) : geometrySphere(meshGeometries[mesh]);
+            Entity entity = entities.Create(parent, meshGeometries[mesh], meshModels[mesh], bounds, source.shading, material, before);
+            if (spin >= 0)
+                entities.AddSpin(entity, spin, hasAfter, after);
+            if (!source.name.empty())
+                named[source.name] = entity;
+        }
+    }
+
+    // the items of the given entities, read from their components in entity order
+    vector<DrawItem> drawItems(const vector<Entity> &list) const
+    {
+        vector<DrawItem> items(list.size());
+        for (size_t i = 0; i < list.size(); i++)
+        {
+            Entity entity = list[i];
+            DrawItem &item = items[i];
+            item.shading = entities.shadings[entity];
+            item.material = entities.materials[entity];
+            item.geometry = entities.geometries[entity];
+            item.model = entities.models[entity];
+            item.transform = entities.transforms.worldTransforms[entity];
+        }
+        return items;
+    }
+
+    // the bounding spheres the entities are culled with, as center and radius
+    glm::vec4 geometrySphere(const Geometry *geometry)
+    {
+        const MeshBounds &bounds = geometryBounds(geometry);
+        return glm::vec4(bounds.center, bounds.radius);
+    }
+
+    // from the boxes of the meshes, which stay when a model frees its vertices, moved by their nodes
+    static glm::vec4 modelSphere(const Model &model)
+    {
+        if (model.meshes.empty())
+            return glm::vec4(0.0f);
+        glm::vec3 low = glm::vec3(FLT_MAX), high = glm::vec3(-FLT_MAX);
+        for (unsigned int m = 0; m < model.meshes.size(); m++)
+        {
+            const Mesh &mesh = model.meshes[m];
+            for (int corner = 0; corner < 8; corner++)
+            {
+                glm::vec3 point = glm::vec3(corner & 1 ? mesh.boundsMax.x : mesh.boundsMin.x, corner & 2 ? mesh.boundsMax.y : mesh.boundsMin.y,
+                                            corner & 4 ? mesh.boundsMax.z : mesh.boundsMin.z);
+                if (!model.IsFlat())
+                    point = glm::vec3(model.MeshTransform(m) * glm::vec4(point, 1.0f));
+                low = glm::min(low, point);
+                high = glm::max(high, point);
+            }
+        }
+        return glm::vec4((low + high) * 0.5f, glm::length(high - low) * 0.5f);
+    }
+};
+
+
+// function to load textures, from the cooked block compressed version when there is one
+unsigned int loadTexture(char const * path, TextureKind kind) {
+    PROFILE_SCOPE("load.texture");
+    unsigned int textureID = useCookedTextures ? loadCookedTexture(path, kind) : 0;
+    if (textureID) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return textureID;
+    }
+
+    int width, height, nrComponents;
+    unsigned char *data = AssetPack::LoadImage(path, &width, &height, &nrComponents, 0);
+    if (data) {
+        textureID = createTexture(data, width, height, nrComponents, kind == TEXTURE_COLOR);
+        stbi_image_free(data);
+    }
+    else {
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+        glGenTextures(1, &textureID);
+        GpuResources::Get().Add(GPU_TEXTURE, textureID, 0, path);
+    }
+
+    return textureID;
+}
+
+// uploads an 8-bit image with 1, 3 or 4 channels and generates its mipmaps; srgb colour images are decoded to
+// linear by the sampler
+unsigned int createTexture(const unsigned char *data, int width, int height, int nrComponents, bool srgb) {
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    GLenum format = GL_RGB;
+    if (nrComponents == 1)
+        format = GL_RED;
+    else if (nrComponents == 3)
+        format = GL_RGB;
+    else if (nrComponents == 4)
+        format = GL_RGBA;
+    GLenum internalFormat = format;
+    if (srgb && format != GL_RED)
+        internalFormat = format == GL_RGBA ? GL_SRGB8_ALPHA8 : GL_SRGB8;
+
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    GpuResources::Get().Add(GPU_TEXTURE, textureID, GpuResources::ImageBytes(width, height, nrComponents), "image");
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    return textureID;
+}
+#endif
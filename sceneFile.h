@@ -0,0 +1,592 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <glm/glm.hpp>
+
+#include "profiler.h"
+#include "assetPack.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+// the scene file the renderer loads, set with --scene
+std::string sceneFile = "room.scene";
+
+// which shader draws an object
+enum ShadingModel {
+    SHADING_COOK_TORRANCE,
+    SHADING_PHONG
+};
+
+// the texture units the Cook-Torrance maps are bound to, which is also the order of the maps of a material
+enum PbrMap {
+    PBR_ALBEDO,
+    PBR_NORMAL,
+    PBR_METALLIC,
+    PBR_ROUGHNESS,
+    PBR_AO,
+    PBR_MAP_COUNT,
+    // with PACKED_ORM the packed AO, roughness and metallic map takes the unit of the metallic map
+    PBR_ORM = PBR_METALLIC
+};
+
+const char *const PBR_MAP_NAMES[PBR_MAP_COUNT] = {"albedo", "normal", "metallic", "roughness", "ao"};
+
+enum SceneMeshKind {
+    // two triangles between four corners with texture coordinates (t,0), (0,0), (0,t) and (t,t) for a tiling t
+    SCENE_MESH_QUAD,
+    // the unit sphere every sphere of the scene shares
+    SCENE_MESH_SPHERE,
+    // a file imported with Assimp, or its cooked version from the asset pack
+    SCENE_MESH_MODEL
+};
+
+struct SceneMesh {
+    std::string name;
+    SceneMeshKind kind = SCENE_MESH_SPHERE;
+    glm::vec3 corners[4];
+    glm::vec3 normal = glm::vec3(0.0f, 1.0f, 0.0f);
+    float tiling = 1.0f;
+    std::string path;
+    // diffuse maps of the model are sRGB
+    bool gamma = false;
+};
+
+// a Cook-Torrance material uses all five maps, a Phong material only the albedo map and its coefficients
+struct SceneMaterial {
+    std::string name;
+    ShadingModel shading = SHADING_COOK_TORRANCE;
+    std::string maps[PBR_MAP_COUNT];
+    float shininess = 32.0f;
+    glm::vec3 diffuse = glm::vec3(0.8f);
+    glm::vec3 specular = glm::vec3(0.3f);
+};
+
+struct SceneLight {
+    glm::vec3 position;
+    glm::vec3 color;
+};
+
+enum SceneTransformOp {
+    TRANSFORM_TRANSLATE,
+    TRANSFORM_SCALE,
+    // by an angle in radians around an axis
+    TRANSFORM_ROTATE,
+    // around y by one of the animated angles of the scene state, in degrees
+    TRANSFORM_SPIN
+};
+
+struct SceneTransformStep {
+    SceneTransformOp op;
+    glm::vec3 value;
+    float angle;
+    // the animated angle of TRANSFORM_SPIN
+    std::string spin;
+};
+
+// an object to draw: a mesh with a material, placed by its transform steps applied in order like glm::translate,
+// glm::scale and glm::rotate calls on an identity matrix, relative to the named instance it is the child of
+struct SceneInstance {
+    std::string name;
+    std::string parent;
+    std::string mesh;
+    ShadingModel shading = SHADING_COOK_TORRANCE;
+    std::string material;
+    std::vector<SceneTransformStep> steps;
+};
+
+// Meshes, materials, lights and instances of a scene, read from a text file for authoring or from the cooked
+// binary --cook writes next to it as <scene>.bin. The cooked file is used when it is at least as new as the text.
+//
+// Text file, one entry per line, '#' starts a comment; vectors are comma separated and angles are in degrees,
+// or radians with an "rad" suffix:
+//   mesh <name> quad <corner> <corner> <corner> <corner> normal=<x,y,z> tiling=<t>
+//   mesh <name> sphere
+//   mesh <name> model <path> [gamma]
+//   material <name> cooktorrance albedo=<path> normal=<path> metallic=<path> roughness=<path> ao=<path>
+//   material <name> phong albedo=<path> [shininess=<s>] [diffuse=<r,g,b>] [specular=<r,g,b>]
+//   light <x,y,z> <r,g,b>
+//   instance <mesh> <cooktorrance|phong> <material> [translate=<x,y,z>] [scale=<x,y,z>|<s>]
+//            [rotate=<angle>,<x,y,z>] [spin=<sphere|brickSphere|phongSphere|phongSphere2>]
+//            [name=<name>] [parent=<name of an instance before>]
+// Instances are drawn in the order of the file.
+class SceneDescription
+{
+public:
+    static const uint32_t MAGIC = 0x424e4353; // "SCNB"
+    static const uint32_t VERSION = 2;
+
+    std::vector<SceneMesh> meshes;
+    std::vector<SceneMaterial> materials;
+    std::vector<SceneLight> lights;
+    std::vector<SceneInstance> instances;
+
+    // reads the cooked file when it is up to date, the text otherwise
+    bool Load(const std::string &path)
+    {
+        PROFILE_SCOPE("load.sceneFile");
+        std::string cookedPath = path + ".bin";
+        // a cooked file that does not load, such as one of an older version, falls back to the text
+        if (const AssetPack::Entry *cooked = AssetPack::Get().Find(cookedPath))
+        {
+            if (loadCooked(cooked->data, cooked->size, cookedPath))
+                return true;
+        }
+        else
+        {
+            struct stat textStat, cookedStat;
+            std::string data;
+            if (stat(cookedPath.c_str(), &cookedStat) == 0 && (stat(path.c_str(), &textStat) != 0 || cookedStat.st_mtime >= textStat.st_mtime) &&
+                AssetPack::ReadText(cookedPath, data) && loadCooked((const unsigned char *)data.data(), data.size(), cookedPath))
+                return true;
+        }
+        std::string text;
+        if (!AssetPack::ReadText(path, text))
+        {
+            std::cout << "ERROR::SCENE::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        return parse(text, path);
+    }
+
+    // writes the cooked file of a scene read from path
+    bool SaveCooked(const std::string &path) const
+    {
+        std::vector<unsigned char> blob = Cook();
+        std::ofstream file((path + ".bin").c_str(), std::ios::binary);
+        file.write((const char *)blob.data(), (std::streamsize)blob.size());
+        if (!file)
+        {
+            std::cout << "ERROR::SCENE::FILE_NOT_WRITABLE: " << path << ".bin" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // the scene as the cooked file stores it: the magic and version, then the meshes, materials, lights and
+    // instances, each a count followed by the fields of every entry in declaration order
+    std::vector<unsigned char> Cook() const
+    {
+        std::vector<unsigned char> blob;
+        putWord(blob, MAGIC);
+        putWord(blob, VERSION);
+        putWord(blob, (uint32_t)meshes.size());
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            const SceneMesh &mesh = meshes[i];
+            putString(blob, mesh.name);
+            putWord(blob, mesh.kind);
+            for (int c = 0; c < 4; c++)
+                putVec3(blob, mesh.corners[c]);
+            putVec3(blob, mesh.normal);
+            putFloat(blob, mesh.tiling);
+            putString(blob, mesh.path);
+            putWord(blob, mesh.gamma);
+        }
+        putWord(blob, (uint32_t)materials.size());
+        for (size_t i = 0; i < materials.size(); i++)
+        {
+            const SceneMaterial &material = materials[i];
+            putString(blob, material.name);
+            putWord(blob, material.shading);
+            for (int map = 0; map < PBR_MAP_COUNT; map++)
+                putString(blob, material.maps[map]);
+            putFloat(blob, material.shininess);
+            putVec3(blob, material.diffuse);
+            putVec3(blob, material.specular);
+        }
+        putWord(blob, (uint32_t)lights.size());
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            putVec3(blob, lights[i].position);
+            putVec3(blob, lights[i].color);
+        }
+        putWord(blob, (uint32_t)instances.size());
+        for (size_t i = 0; i < instances.size(); i++)
+        {
+            const SceneInstance &instance = instances[i];
+            putString(blob, instance.name);
+            putString(blob, instance.parent);
+            putString(blob, instance.mesh);
+            putWord(blob, instance.shading);
+            putString(blob, instance.material);
+            putWord(blob, (uint32_t)instance.steps.size());
+            for (size_t s = 0; s < instance.steps.size(); s++)
+            {
+                putWord(blob, instance.steps[s].op);
+                putVec3(blob, instance.steps[s].value);
+                putFloat(blob, instance.steps[s].angle);
+                putString(blob, instance.steps[s].spin);
+            }
+        }
+        return blob;
+    }
+
+    int FindMesh(const std::string &name) const
+    {
+        for (size_t i = 0; i < meshes.size(); i++)
+            if (meshes[i].name == name)
+                return (int)i;
+        return -1;
+    }
+
+private:
+    bool parse(const std::string &text, const std::string &path)
+    {
+        meshes.clear();
+        materials.clear();
+        lights.clear();
+        instances.clear();
+        std::istringstream lines(text);
+        std::string line;
+        unsigned int lineNumber = 0;
+        while (std::getline(lines, line))
+        {
+            lineNumber++;
+            size_t comment = line.find('#');
+            if (comment != std::string::npos)
+                line = line.substr(0, comment);
+            std::istringstream tokens(line);
+            std::string type;
+            if (!(tokens >> type))
+                continue;
+            bool valid;
+            if (type == "mesh")
+                valid = parseMesh(tokens);
+            else if (type == "material")
+                valid = parseMaterial(tokens);
+            else if (type == "light")
+                valid = parseLight(tokens);
+            else if (type == "instance")
+                valid = parseInstance(tokens);
+            else
+                valid = false;
+            if (!valid)
+            {
+                std::cout << "ERROR::SCENE::INVALID_LINE " << path << ":" << lineNumber << ": " << line << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool parseMesh(std::istringstream &tokens)
+    {
+        SceneMesh mesh;
+        std::string kind;
+        if (!(tokens >> mesh.name >> kind))
+            return false;
+        if (kind == "sphere")
+            mesh.kind = SCENE_MESH_SPHERE;
+        else if (kind == "model")
+        {
+            mesh.kind = SCENE_MESH_MODEL;
+            std::string option;
+            if (!(tokens >> mesh.path))
+                return false;
+            while (tokens >> option)
+            {
+                if (option != "gamma")
+                    return false;
+                mesh.gamma = true;
+            }
+        }
+        else if (kind == "quad")
+        {
+            mesh.kind = SCENE_MESH_QUAD;
+            std::string corner, option;
+            for (int c = 0; c < 4; c++)
+                if (!(tokens >> corner) || !parseVec3(corner, mesh.corners[c]))
+                    return false;
+            while (tokens >> option)
+            {
+                std::string key, value;
+                splitOption(option, key, value);
+                if (key == "normal" && parseVec3(value, mesh.normal))
+                    continue;
+                if (key == "tiling" && parseFloat(value, mesh.tiling))
+                    continue;
+                return false;
+            }
+        }
+        else
+            return false;
+        meshes.push_back(mesh);
+        return true;
+    }
+
+    bool parseMaterial(std::istringstream &tokens)
+    {
+        SceneMaterial material;
+        std::string shading, option;
+        if (!(tokens >> material.name >> shading) || !parseShading(shading, material.shading))
+            return false;
+        while (tokens >> option)
+        {
+            std::string key, value;
+            splitOption(option, key, value);
+            int map = 0;
+            while (map < PBR_MAP_COUNT && key != PBR_MAP_NAMES[map])
+                map++;
+            // Phong only has an albedo map
+            if (map < PBR_MAP_COUNT && (material.shading == SHADING_COOK_TORRANCE || map == PBR_ALBEDO))
+                material.maps[map] = value;
+            else if (material.shading == SHADING_PHONG && key == "shininess" && parseFloat(value, material.shininess))
+                ;
+            else if (material.shading == SHADING_PHONG && key == "diffuse" && parseVec3(value, material.diffuse))
+                ;
+            else if (material.shading == SHADING_PHONG && key == "specular" && parseVec3(value, material.specular))
+                ;
+            else
+                return false;
+        }
+        materials.push_back(material);
+        return true;
+    }
+
+    bool parseLight(std::istringstream &tokens)
+    {
+        SceneLight light;
+        std::string position, color;
+        if (!(tokens >> position >> color) || !parseVec3(position, light.position) || !parseVec3(color, light.color))
+            return false;
+        lights.push_back(light);
+        return true;
+    }
+
+    bool parseInstance(std::istringstream &tokens)
+    {
+        SceneInstance instance;
+        std::string shading, option;
+        if (!(tokens >> instance.mesh >> shading >> instance.material) || !parseShading(shading, instance.shading))
+            return false;
+        while (tokens >> option)
+        {
+            std::string key, value;
+            splitOption(option, key, value);
+            SceneTransformStep step;
+            step.angle = 0.0f;
+            step.value = glm::vec3(0.0f);
+            if (key == "translate")
+            {
+                step.op = TRANSFORM_TRANSLATE;
+                if (!parseVec3(value, step.value))
+                    return false;
+            }
+            else if (key == "scale")
+            {
+                step.op = TRANSFORM_SCALE;
+                float uniform;
+                if (!parseVec3(value, step.value))
+                {
+                    if (!parseFloat(value, uniform))
+                        return false;
+                    step.value = glm::vec3(uniform);
+                }
+            }
+            else if (key == "rotate")
+            {
+                step.op = TRANSFORM_ROTATE;
+                size_t comma = value.find(',');
+                if (comma == std::string::npos || !parseAngle(value.substr(0, comma), step.angle) || !parseVec3(value.substr(comma + 1), step.value))
+                    return false;
+            }
+            else if (key == "spin")
+            {
+                step.op = TRANSFORM_SPIN;
+                step.spin = value;
+            }
+            else if (key == "name" && !value.empty())
+            {
+                instance.name = value;
+                continue;
+            }
+            else if (key == "parent" && !value.empty())
+            {
+                instance.parent = value;
+                continue;
+            }
+            else
+                return false;
+            instance.steps.push_back(step);
+        }
+        instances.push_back(instance);
+        return true;
+    }
+
+    static void splitOption(const std::string &option, std::string &key, std::string &value)
+    {
+        size_t equals = option.find('=');
+        key = option.substr(0, equals);
+        value = equals == std::string::npos ? "" : option.substr(equals + 1);
+    }
+
+    static bool parseShading(const std::string &value, ShadingModel &shading)
+    {
+        if (value == "cooktorrance")
+            shading = SHADING_COOK_TORRANCE;
+        else if (value == "phong")
+            shading = SHADING_PHONG;
+        else
+            return false;
+        return true;
+    }
+
+    static bool parseFloat(const std::string &value, float &result)
+    {
+        char *end;
+        result = strtof(value.c_str(), &end);
+        return !value.empty() && *end == '\0';
+    }
+
+    // degrees, or radians with an "rad" suffix
+    static bool parseAngle(const std::string &value, float &radians)
+    {
+        bool inRadians = value.size() > 3 && value.compare(value.size() - 3, 3, "rad") == 0;
+        if (!parseFloat(inRadians ? value.substr(0, value.size() - 3) : value, radians))
+            return false;
+        if (!inRadians)
+            radians = glm::radians(radians);
+        return true;
+    }
+
+    static bool parseVec3(const std::string &value, glm::vec3 &result)
+    {
+        char *end;
+        const char *start = value.c_str();
+        for (int i = 0; i < 3; i++)
+        {
+            result[i] = strtof(start, &end);
+            if (end == start || *end != (i < 2 ? ',' : '\0'))
+                return false;
+            start = end + 1;
+        }
+        return true;
+    }
+
+    bool loadCooked(const unsigned char *data, size_t size, const std::string &path)
+    {
+        const unsigned char *end = data + size;
+        uint32_t magic = 0, version = 0, count = 0, value = 0;
+        bool valid = getWord(data, end, magic) && magic == MAGIC && getWord(data, end, version) && version == VERSION;
+        meshes.clear();
+        materials.clear();
+        lights.clear();
+        instances.clear();
+        valid = valid && getWord(data, end, count);
+        for (uint32_t i = 0; valid && i < count; i++)
+        {
+            SceneMesh mesh;
+            valid = getString(data, end, mesh.name) && getWord(data, end, value);
+            mesh.kind = (SceneMeshKind)value;
+            for (int c = 0; c < 4; c++)
+                valid = valid && getVec3(data, end, mesh.corners[c]);
+            valid = valid && getVec3(data, end, mesh.normal) && getFloat(data, end, mesh.tiling) && getString(data, end, mesh.path) && getWord(data, end, value);
+            mesh.gamma = value != 0;
+            meshes.push_back(mesh);
+        }
+        valid = valid && getWord(data, end, count);
+        for (uint32_t i = 0; valid && i < count; i++)
+        {
+            SceneMaterial material;
+            valid = getString(data, end, material.name) && getWord(data, end, value);
+            material.shading = (ShadingModel)value;
+            for (int map = 0; map < PBR_MAP_COUNT; map++)
+                valid = valid && getString(data, end, material.maps[map]);
+            valid = valid && getFloat(data, end, material.shininess) && getVec3(data, end, material.diffuse) && getVec3(data, end, material.specular);
+            materials.push_back(material);
+        }
+        valid = valid && getWord(data, end, count);
+        for (uint32_t i = 0; valid && i < count; i++)
+        {
+            SceneLight light;
+            valid = getVec3(data, end, light.position) && getVec3(data, end, light.color);
+            lights.push_back(light);
+        }
+        valid = valid && getWord(data, end, count);
+        for (uint32_t i = 0; valid && i < count; i++)
+        {
+            SceneInstance instance;
+            uint32_t steps = 0;
+            valid = getString(data, end, instance.name) && getString(data, end, instance.parent) && getString(data, end, instance.mesh) && getWord(data, end, value) && getString(data, end, instance.material) && getWord(data, end, steps);
+            instance.shading = (ShadingModel)value;
+            for (uint32_t s = 0; valid && s < steps; s++)
+            {
+                SceneTransformStep step;
+                valid = getWord(data, end, value) && getVec3(data, end, step.value) && getFloat(data, end, step.angle) && getString(data, end, step.spin);
+                step.op = (SceneTransformOp)value;
+                instance.steps.push_back(step);
+            }
+            instances.push_back(instance);
+        }
+        if (!valid)
+            std::cout << "ERROR::SCENE::INVALID_COOKED_SCENE: " << path << std::endl;
+        return valid;
+    }
+
+    static void putWord(std::vector<unsigned char> &blob, uint32_t word)
+    {
+        const unsigned char *bytes = (const unsigned char *)&word;
+        blob.insert(blob.end(), bytes, bytes + 4);
+    }
+
+    static void putFloat(std::vector<unsigned char> &blob, float value)
+    {
+        uint32_t word;
+        memcpy(&word, &value, 4);
+        putWord(blob, word);
+    }
+
+    static void putVec3(std::vector<unsigned char> &blob, const glm::vec3 &value)
+    {
+        for (int i = 0; i < 3; i++)
+            putFloat(blob, value[i]);
+    }
+
+    static void putString(std::vector<unsigned char> &blob, const std::string &text)
+    {
+        putWord(blob, (uint32_t)text.size());
+        blob.insert(blob.end(), text.begin(), text.end());
+    }
+
+    static bool getWord(const unsigned char *&data, const unsigned char *end, uint32_t &word)
+    {
+        if (end - data < 4)
+            return false;
+        memcpy(&word, data, 4);
+        data += 4;
+        return true;
+    }
+
+    static bool getFloat(const unsigned char *&data, const unsigned char *end, float &value)
+    {
+        uint32_t word;
+        if (!getWord(data, end, word))
+            return false;
+        memcpy(&value, &word, 4);
+        return true;
+    }
+
+    static bool getVec3(const unsigned char *&data, const unsigned char *end, glm::vec3 &value)
+    {
+        return getFloat(data, end, value.x) && getFloat(data, end, value.y) && getFloat(data, end, value.z);
+    }
+
+    static bool getString(const unsigned char *&data, const unsigned char *end, std::string &text)
+    {
+        uint32_t length;
+        if (!getWord(data, end, length) || (size_t)(end - data) < length)
+            return false;
+        text.assign((const char *)data, length);
+        data += length;
+        return true;
+    }
+};
+#endif
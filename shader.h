@@ -4,97 +4,125 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "profiler.h"
+#include "gpuResources.h"
+#include "assetPack.h"
+#include "shaderPreprocessor.h"
+
 #include <string>
+#include <vector>
 #include <fstream>
+#include <algorithm>
+#include <memory>
+#include <cstring>
 #include <sstream>
 #include <iostream>
 
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// whether the driver compiles shaders in parallel with the frames and can be asked if a program is done, looked
+// up once
+struct ParallelShaderCompile {
+    bool checked = false;
+    bool supported = false;
+
+    static ParallelShaderCompile &Get()
+    {
+        static ParallelShaderCompile parallel;
+        if (!parallel.checked)
+        {
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; i++)
+            {
+                const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+                if (extension && (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0 || strcmp(extension, "GL_ARB_parallel_shader_compile") == 0))
+                    parallel.supported = true;
+            }
+            parallel.checked = true;
+        }
+        return parallel;
+    }
+};
+
 class Shader
 {
 public:
     unsigned int ID;
+    // keeps the program alive while any copy of the shader is
+    GpuProgram program;
+    // the files the stages were read from, includes included
+    std::vector<std::string> sources;
+    // an empty program, for scenes that are rendered without OpenGL
+    Shader() : ID(0)
+    {
+    }
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    // each of the defines is added to every stage after its #version line, to compile variants of one shader
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string> &defines) : Shader(vertexPath, fragmentPath, nullptr, defines)
+    {
+    }
+    // with wait false the program is left compiling and linking, in parallel with the frames where the driver
+    // supports it, until Ready says it is done and Finish checks it
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::vector<std::string> &defines = std::vector<std::string>(), bool wait = true)
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
+        PROFILE_SCOPE("load.shader");
+        const char *paths[3] = {vertexPath, fragmentPath, geometryPath};
+        const GLenum types[3] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER};
+        pending = std::make_shared<PendingStages>();
+        ID = glCreateProgram();
+        for (int stage = 0; stage < 3; stage++)
         {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
             // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
+            if (paths[stage] == nullptr)
+                continue;
+            // 1. retrieve the source code from the asset pack or filePath, with the includes expanded
+            ShaderSource &source = pending->sources[stage];
+            ShaderPreprocessor::Get().Expand(paths[stage], source);
+            addSources(source);
+            addDefines(source, defines);
+            const char *code = source.code.c_str();
+            // 2. compile the stage and attach it to the shader Program
+            pending->stages[stage] = glCreateShader(types[stage]);
+            glShaderSource(pending->stages[stage], 1, &code, NULL);
+            glCompileShader(pending->stages[stage]);
+            glAttachShader(ID, pending->stages[stage]);
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if(geometryPath != nullptr)
-        {
-            const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
-        }
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        program = GpuProgram::Track(ID, 0, std::string(vertexPath) + " " + fragmentPath);
+        if (wait)
+            Finish();
+    }
+    // whether the program has finished compiling and linking; without GL_KHR_parallel_shader_compile the driver
+    // can't be asked, so it is said to be done from the second time on, and finishing it then waits for it a
+    // frame after it was started instead of in the same one
+    bool Ready()
+    {
+        if (!pending)
+            return true;
+        if (!ParallelShaderCompile::Get().supported)
+            return pending->asked++ > 0;
+        GLint done = 0;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+        return done != 0;
+    }
+    // checks the stages and the program for errors, printing them, and deletes the stages; true if it linked
+    bool Finish()
+    {
+        if (!pending)
+            return linked;
+        static const char *const types[3] = {"VERTEX", "FRAGMENT", "GEOMETRY"};
+        linked = true;
+        for (int stage = 0; stage < 3; stage++)
+            if (pending->stages[stage])
+                linked = checkCompileErrors(pending->stages[stage], types[stage], &pending->sources[stage]) && linked;
+        linked = checkCompileErrors(ID, "PROGRAM") && linked;
         // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
-
+        pending.reset();
+        return linked;
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -162,9 +190,46 @@ public:
     }
 
 private:
-    // utility function for checking shader compilation/linking errors.
+    // the stages of a program that hasn't been finished yet, with their code for naming the files in errors
+    struct PendingStages {
+        unsigned int stages[3] = {0, 0, 0};
+        ShaderSource sources[3];
+        // how many times Ready was called, for drivers that can't be asked
+        unsigned int asked = 0;
+
+        ~PendingStages()
+        {
+            for (int stage = 0; stage < 3; stage++)
+                if (stages[stage])
+                    glDeleteShader(stages[stage]);
+        }
+    };
+
+    std::shared_ptr<PendingStages> pending;
+    bool linked = false;
+
+    // inserts "#define <name>" lines after the #version line, which has to stay first
+    // ------------------------------------------------------------------------
+    static void addDefines(ShaderSource &source, const std::vector<std::string> &defines)
+    {
+        if (source.code.empty() || defines.empty())
+            return;
+        std::string lines;
+        for (unsigned int i = 0; i < defines.size(); i++)
+            lines += "#define " + defines[i] + "\n";
+        source.Insert(source.code.compare(0, 8, "#version") == 0 ? 1 : 0, lines);
+    }
+    // records the files of a stage that aren't recorded yet
+    // ------------------------------------------------------------------------
+    void addSources(const ShaderSource &source)
+    {
+        for (unsigned int i = 0; i < source.files.size(); i++)
+            if (std::find(sources.begin(), sources.end(), source.files[i]) == sources.end())
+                sources.push_back(source.files[i]);
+    }
+    // utility function for checking shader compilation/linking errors, naming the files of the stage in the log
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type, const ShaderSource *source = nullptr)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -174,7 +239,7 @@ private:
             if(!success)
             {
                 glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << (source ? ShaderPreprocessor::MapLog(infoLog, *source) : std::string(infoLog)) << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
         else
@@ -186,6 +251,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
 };
 #endif
\ No newline at end of file
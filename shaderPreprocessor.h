@@ -0,0 +1,195 @@
+#ifndef SHADER_PREPROCESSOR_H
+#define SHADER_PREPROCESSOR_H
+
+#include "assetPack.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+#include <iostream>
+
+// the code of a shader stage with its includes expanded
+struct ShaderSource {
+    std::string code;
+    // the files the code was read from, the stage's own file first and then each include in the order it was
+    // first included
+    std::vector<std::string> files;
+    // the file, as an index into files, and the line of it each line of the code came from
+    std::vector<std::pair<unsigned int, unsigned int> > lines;
+
+    // inserts lines of code after the given number of lines, counted as coming from the line before them
+    void Insert(unsigned int after, const std::string &text)
+    {
+        size_t position = 0;
+        for (unsigned int i = 0; i < after && position < code.size(); i++)
+        {
+            position = code.find('\n', position);
+            position = position == std::string::npos ? code.size() : position + 1;
+        }
+        code.insert(position, text);
+        after = std::min(after, (unsigned int)lines.size());
+        std::pair<unsigned int, unsigned int> origin = after > 0 ? lines[after - 1] : std::make_pair(0u, 0u);
+        lines.insert(lines.begin() + after, (size_t)std::count(text.begin(), text.end(), '\n'), origin);
+    }
+};
+
+// Expands the #include "<file>" lines of shaders, the file resolved next to the one including it, before the code
+// is handed to OpenGL. A file is included once per stage however many times it is asked for. Each file is read
+// and split at its includes once, and kept for every shader and variant that includes it until it is invalidated.
+// The expanded code records the file and line each of its lines came from, which MapLog turns the line numbers
+// of the compiler's errors back into. That is done instead of #line directives with source string numbers, as
+// drivers such as Mesa's report every line as coming from source string 0 whatever the directive says.
+//
+// Includes are expanded before the GLSL preprocessor runs, so an #include inside an #ifdef is still read, its code
+// then left out by the #ifdef.
+class ShaderPreprocessor
+{
+public:
+    static ShaderPreprocessor &Get()
+    {
+        static ShaderPreprocessor preprocessor;
+        return preprocessor;
+    }
+
+    // the code of a stage with its includes; false, after printing which, if the file or one of its includes
+    // can't be read
+    bool Expand(const std::string &path, ShaderSource &source)
+    {
+        source.code.clear();
+        source.files.clear();
+        source.lines.clear();
+        return append(path, source, "");
+    }
+
+    // forgets a file read before, so the next shader including it reads it again
+    void Invalidate(const std::string &path)
+    {
+        files.erase(path);
+    }
+
+    // the info log of a stage with the source string and line its messages start with, as in "0:12(5)" or
+    // "0(12)", replaced by the file and line of the code they came from
+    static std::string MapLog(const std::string &log, const ShaderSource &source)
+    {
+        std::istringstream lines(log);
+        std::string line, mapped;
+        while (std::getline(lines, line))
+        {
+            size_t digits = skipDigits(line, 0);
+            if (digits > 0 && digits < line.size() && (line[digits] == ':' || line[digits] == '('))
+            {
+                size_t end = skipDigits(line, digits + 1);
+                size_t number = (size_t)std::strtoul(line.substr(digits + 1, end - digits - 1).c_str(), NULL, 10);
+                if (number >= 1 && number <= source.lines.size())
+                {
+                    const std::pair<unsigned int, unsigned int> &origin = source.lines[number - 1];
+                    line = source.files[origin.first] + line[digits] + std::to_string(origin.second) + line.substr(end);
+                }
+            }
+            mapped += line + "\n";
+        }
+        return mapped;
+    }
+
+private:
+    // a run of lines of a file starting at the given line, followed by the file it includes if any
+    struct Part {
+        std::string text;
+        unsigned int firstLine = 1;
+        unsigned int lineCount = 0;
+        std::string include;
+    };
+
+    struct File {
+        bool found = false;
+        std::vector<Part> parts;
+    };
+
+    std::map<std::string, File> files;
+
+    ShaderPreprocessor()
+    {
+    }
+
+    // the parts of a file, split at its includes, reading it the first time
+    const File &read(const std::string &path)
+    {
+        std::map<std::string, File>::iterator found = files.find(path);
+        if (found != files.end())
+            return found->second;
+        File &file = files[path];
+        std::string text;
+        if (!AssetPack::ReadText(path, text))
+            return file;
+        file.found = true;
+        std::istringstream lines(text);
+        std::string line;
+        unsigned int lineNumber = 0;
+        Part part;
+        while (std::getline(lines, line))
+        {
+            lineNumber++;
+            size_t start = line.find_first_not_of(" \t");
+            if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+            {
+                size_t open = line.find('"', start), close = line.rfind('"');
+                if (open != std::string::npos && close > open)
+                {
+                    part.include = directory(path) + line.substr(open + 1, close - open - 1);
+                    file.parts.push_back(part);
+                    part = Part();
+                    part.firstLine = lineNumber + 1;
+                    continue;
+                }
+                std::cout << "ERROR::SHADER::INVALID_INCLUDE " << path << ":" << lineNumber << ": " << line << std::endl;
+            }
+            part.text += line + "\n";
+            part.lineCount++;
+        }
+        file.parts.push_back(part);
+        return file;
+    }
+
+    bool append(const std::string &path, ShaderSource &source, const std::string &includedBy)
+    {
+        unsigned int index = (unsigned int)source.files.size();
+        source.files.push_back(path);
+        const File &file = read(path);
+        if (!file.found)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << (includedBy.empty() ? "" : " included by " + includedBy) << std::endl;
+            return false;
+        }
+        bool complete = true;
+        for (size_t i = 0; i < file.parts.size(); i++)
+        {
+            const Part &part = file.parts[i];
+            source.code += part.text;
+            for (unsigned int line = 0; line < part.lineCount; line++)
+                source.lines.push_back(std::make_pair(index, part.firstLine + line));
+            if (!part.include.empty() && std::find(source.files.begin(), source.files.end(), part.include) == source.files.end())
+                complete = append(part.include, source, path) && complete;
+        }
+        return complete;
+    }
+
+    static size_t skipDigits(const std::string &text, size_t position)
+    {
+        while (position < text.size() && std::isdigit((unsigned char)text[position]))
+            position++;
+        return position;
+    }
+
+    // the directory of a path with its trailing slash, empty for a file in the working directory
+    static std::string directory(const std::string &path)
+    {
+        size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    }
+};
+#endif
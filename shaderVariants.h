@@ -0,0 +1,196 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "shader.h"
+#include "profiler.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <sstream>
+#include <iostream>
+
+// the features a shader can be specialized for, each compiled in with the #define of its name
+enum ShaderFeature {
+    // Blinn-Phong instead of Phong specular highlights
+    SHADER_BLINN = 1 << 0,
+    // normals read from the normal map instead of interpolated
+    SHADER_NORMAL_MAP = 1 << 1,
+    // AO, roughness and metallic read from one packed texture
+    SHADER_PACKED_ORM = 1 << 2,
+    SHADER_FEATURE_COUNT = 3
+};
+
+const char *const SHADER_FEATURE_DEFINES[SHADER_FEATURE_COUNT] = {"BLINN", "NORMAL_MAP", "PACKED_ORM"};
+
+// a variant: its features and the number of lights its loops run over, which is compiled in as LIGHT_COUNT
+uint32_t ShaderVariantKey(unsigned int features, unsigned int lightCount)
+{
+    return features | lightCount << 16;
+}
+
+// The permutations of one vertex and fragment shader. Each key is compiled the first time it is asked for, with
+// the defines of its features and light count, and cached from then on, so every draw runs a program specialized
+// for what it uses instead of branching on uniforms per fragment.
+//
+// Reload compiles the variants built from changed files again in the background, and Update swaps each one in
+// once it has linked, between frames, keeping the old program if it failed.
+class ShaderVariants
+{
+public:
+    ShaderVariants()
+    {
+    }
+    ShaderVariants(const std::string &vertexPath, const std::string &fragmentPath) : vertexPath(vertexPath), fragmentPath(fragmentPath)
+    {
+    }
+
+    // the program of a key, compiling it if this is the first time; compiled is set when it was, or when a reload
+    // swapped it since
+    Shader &Get(uint32_t key, bool *compiled = nullptr)
+    {
+        std::map<uint32_t, Shader>::iterator found = variants.find(key);
+        std::vector<uint32_t>::iterator swap = std::find(swapped.begin(), swapped.end(), key);
+        if (compiled)
+            *compiled = found == variants.end() || swap != swapped.end();
+        if (swap != swapped.end())
+            swapped.erase(swap);
+        if (found != variants.end())
+            return found->second;
+        PROFILE_SCOPE("shader.variant");
+        Clock::time_point start = Clock::now();
+        Shader &program = variants[key] = Shader(vertexPath.c_str(), fragmentPath.c_str(), Defines(key));
+        sourcesVersion++;
+        compileSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+        return program;
+    }
+
+    // the defines a key is compiled with
+    static std::vector<std::string> Defines(uint32_t key)
+    {
+        std::vector<std::string> defines;
+        for (int feature = 0; feature < SHADER_FEATURE_COUNT; feature++)
+            if (key & (1u << feature))
+                defines.push_back(SHADER_FEATURE_DEFINES[feature]);
+        defines.push_back("LIGHT_COUNT " + std::to_string(key >> 16));
+        return defines;
+    }
+
+    size_t Count() const
+    {
+        return variants.size();
+    }
+
+    // changes whenever the files the variants are built from may have: a variant was compiled, or a reload
+    // swapped in includes other files than before
+    unsigned int SourcesVersion() const
+    {
+        return sourcesVersion;
+    }
+
+    // the files the variants were built from, includes included
+    void Sources(std::vector<std::string> &files) const
+    {
+        for (std::map<uint32_t, Shader>::const_iterator variant = variants.begin(); variant != variants.end(); ++variant)
+            for (size_t i = 0; i < variant->second.sources.size(); i++)
+                if (std::find(files.begin(), files.end(), variant->second.sources[i]) == files.end())
+                    files.push_back(variant->second.sources[i]);
+    }
+
+    // starts compiling every variant built from one of the files again, without waiting for it; a reload already
+    // under way is dropped for the new one
+    void Reload(const std::vector<std::string> &changed)
+    {
+        for (std::map<uint32_t, Shader>::iterator variant = variants.begin(); variant != variants.end(); ++variant)
+        {
+            const std::vector<std::string> &sources = variant->second.sources;
+            bool uses = false;
+            for (size_t i = 0; i < changed.size() && !uses; i++)
+                uses = std::find(sources.begin(), sources.end(), changed[i]) != sources.end();
+            if (!uses)
+                continue;
+            Reloading &reload = reloading[variant->first];
+            reload.start = Clock::now();
+            reload.shader = Shader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, Defines(variant->first), false);
+        }
+    }
+
+    // swaps in the reloaded variants that have finished linking; one that failed to compile keeps its old program
+    void Update()
+    {
+        std::map<uint32_t, Reloading>::iterator reload = reloading.begin();
+        while (reload != reloading.end())
+        {
+            if (!reload->second.shader.Ready())
+            {
+                ++reload;
+                continue;
+            }
+            double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - reload->second.start).count();
+            if (reload->second.shader.Finish())
+            {
+                if (reload->second.shader.sources != variants[reload->first].sources)
+                    sourcesVersion++;
+                variants[reload->first] = reload->second.shader;
+                swapped.push_back(reload->first);
+                reloads++;
+                std::cout << "Reloaded " << fragmentPath << " variant " << describe(reload->first) << " in " << milliseconds << " ms" << std::endl;
+            }
+            else
+            {
+                failedReloads++;
+                std::cout << "ERROR::SHADER::RELOAD_FAILED: " << fragmentPath << " variant " << describe(reload->first) << ", keeping the old program" << std::endl;
+            }
+            reload = reloading.erase(reload);
+        }
+    }
+
+    // how many variants were compiled and how long that took, and how many reloads were swapped in or failed
+    std::string StatsJson() const
+    {
+        std::ostringstream json;
+        json << "{\"variants\": " << variants.size() << ", \"compile_ms\": " << compileSeconds * 1000.0 << ", \"reloads\": " << reloads
+             << ", \"failed_reloads\": " << failedReloads << "}";
+        return json.str();
+    }
+
+    void PrintStats() const
+    {
+        std::cout << fragmentPath << ": " << variants.size() << " variants compiled in " << compileSeconds * 1000.0 << " ms, " << reloads
+                  << " reloaded, " << failedReloads << " failed" << std::endl;
+    }
+
+private:
+    typedef std::chrono::high_resolution_clock Clock;
+
+    // a variant compiling again, and since when
+    struct Reloading {
+        Shader shader;
+        Clock::time_point start;
+    };
+
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::map<uint32_t, Shader> variants;
+    std::map<uint32_t, Reloading> reloading;
+    // the variants reloaded since Get last returned them
+    std::vector<uint32_t> swapped;
+    unsigned int sourcesVersion = 0;
+    double compileSeconds = 0.0;
+    unsigned int reloads = 0;
+    unsigned int failedReloads = 0;
+
+    // the defines of a key on one line
+    static std::string describe(uint32_t key)
+    {
+        std::vector<std::string> defines = Defines(key);
+        std::string text;
+        for (size_t i = 0; i < defines.size(); i++)
+            text += (i > 0 ? ", " : "") + defines[i];
+        return text;
+    }
+};
+#endif
@@ -0,0 +1,115 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <iostream>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Tells which of the watched shader files were written since it was last asked, for --hot-reload. On Linux the
+// directories of the files are watched with inotify, so a poll is one non-blocking read whether anything changed
+// or not; the whole directory is watched as editors often save by writing a new file and renaming it over the old
+// one. Elsewhere the files' modification times are compared instead.
+class ShaderWatcher
+{
+public:
+    ShaderWatcher()
+    {
+#ifdef __linux__
+        inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify < 0)
+            std::cout << "ERROR::SHADER_WATCHER::INOTIFY_INIT_FAILED: falling back to polling the files" << std::endl;
+#endif
+    }
+
+    ~ShaderWatcher()
+    {
+#ifdef __linux__
+        if (inotify >= 0)
+            close(inotify);
+#endif
+    }
+
+    ShaderWatcher(const ShaderWatcher &) = delete;
+    ShaderWatcher &operator=(const ShaderWatcher &) = delete;
+
+    // starts watching a file, if it isn't watched already
+    void Watch(const std::string &path)
+    {
+        if (files.count(path))
+            return;
+        files[path] = modified(path);
+#ifdef __linux__
+        if (inotify < 0)
+            return;
+        size_t slash = path.find_last_of('/');
+        std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+        int watch = inotify_add_watch(inotify, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watch < 0)
+            std::cout << "ERROR::SHADER_WATCHER::CANNOT_WATCH: " << (directory.empty() ? "." : directory) << std::endl;
+        else
+            directories[watch] = directory;
+#endif
+    }
+
+    // the watched files written since the last poll, each once
+    std::vector<std::string> Poll()
+    {
+        std::vector<std::string> changed;
+#ifdef __linux__
+        if (inotify >= 0)
+        {
+            alignas(struct inotify_event) char buffer[4096];
+            ssize_t length;
+            while ((length = read(inotify, buffer, sizeof(buffer))) > 0)
+            {
+                for (char *next = buffer; next < buffer + length;)
+                {
+                    const struct inotify_event *event = (const struct inotify_event *)next;
+                    next += sizeof(struct inotify_event) + event->len;
+                    std::map<int, std::string>::const_iterator directory = directories.find(event->wd);
+                    if (event->len == 0 || directory == directories.end())
+                        continue;
+                    std::string path = directory->second + event->name;
+                    if (files.count(path) && std::find(changed.begin(), changed.end(), path) == changed.end())
+                        changed.push_back(path);
+                }
+            }
+            return changed;
+        }
+#endif
+        for (std::map<std::string, time_t>::iterator file = files.begin(); file != files.end(); ++file)
+        {
+            time_t time = modified(file->first);
+            if (time != file->second)
+            {
+                file->second = time;
+                changed.push_back(file->first);
+            }
+        }
+        return changed;
+    }
+
+private:
+    // the watched files with their modification time when last polled
+    std::map<std::string, time_t> files;
+#ifdef __linux__
+    int inotify = -1;
+    // the directory of each inotify watch, with its trailing slash
+    std::map<int, std::string> directories;
+#endif
+
+    static time_t modified(const std::string &path)
+    {
+        struct stat fileStat;
+        return stat(path.c_str(), &fileStat) == 0 ? fileStat.st_mtime : 0;
+    }
+};
+#endif
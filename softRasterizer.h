@@ -0,0 +1,773 @@
+#ifndef SOFT_RASTERIZER_H
+#define SOFT_RASTERIZER_H
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "scene.h"
+#include "profiler.h"
+#include "jobSystem.h"
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// An image with its mip chain, sampled the way the textures made by loadTexture are sampled on the GPU
+// (GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR). One and three channel images are expanded to RGBA like GL_RED and GL_RGB.
+// The mips are built like the cooked ones for the kind of texture, and TEXTURE_COLOR texels are decoded from sRGB
+// before they are filtered, as the GPU does for sRGB textures.
+class SoftTexture
+{
+public:
+    bool Load(const std::string &path, TextureKind kind)
+    {
+        int width, height, nrComponents;
+        unsigned char *data = AssetPack::LoadImage(path, &width, &height, &nrComponents, 0);
+        if (!data)
+        {
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+            return false;
+        }
+        levels.resize(1);
+        Level &base = levels[0];
+        base.width = width;
+        base.height = height;
+        base.texels.resize((size_t)width * height * 4);
+        for (size_t i = 0; i < (size_t)width * height; i++)
+        {
+            const unsigned char *in = data + i * nrComponents;
+            unsigned char *out = &base.texels[i * 4];
+            out[0] = in[0];
+            out[1] = nrComponents > 1 ? in[1] : 0;
+            out[2] = nrComponents > 2 ? in[2] : 0;
+            out[3] = nrComponents > 3 ? in[3] : 255;
+        }
+        stbi_image_free(data);
+
+        // the textures are decoded on the cache's threads already, so the mips are built on this one
+        std::vector<std::vector<unsigned char> > mips(1);
+        mips[0].swap(base.texels);
+        MipGenerator(1).Build(mips, width, height, kind);
+        srgb = kind == TEXTURE_COLOR;
+        levels.resize(mips.size());
+        for (size_t level = 0; level < mips.size(); level++)
+        {
+            levels[level].width = std::max(1, width >> level);
+            levels[level].height = std::max(1, height >> level);
+            levels[level].texels.swap(mips[level]);
+        }
+        return true;
+    }
+
+    bool Valid() const
+    {
+        return !levels.empty();
+    }
+
+    // level of detail for the given texture coordinate derivatives
+    float Lod(glm::vec2 dUVdx, glm::vec2 dUVdy) const
+    {
+        if (levels.empty())
+            return 0.0f;
+        glm::vec2 size((float)levels[0].width, (float)levels[0].height);
+        glm::vec2 dx = dUVdx * size, dy = dUVdy * size;
+        float rho = std::max(glm::dot(dx, dx), glm::dot(dy, dy));
+        return rho > 0.0f ? 0.5f * std::log2(rho) : 0.0f;
+    }
+
+    // an incomplete texture samples as opaque black, like an unloaded texture on the GPU
+    glm::vec4 Sample(glm::vec2 uv, float lod) const
+    {
+        if (levels.empty())
+            return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        if (lod <= 0.0f)
+            return bilinear(levels[0], uv);
+        float maxLevel = (float)(levels.size() - 1);
+        if (lod >= maxLevel)
+            return bilinear(levels.back(), uv);
+        int level = (int)lod;
+        float t = lod - level;
+        return glm::mix(bilinear(levels[level], uv), bilinear(levels[level + 1], uv), t);
+    }
+
+private:
+    struct Level {
+        int width;
+        int height;
+        std::vector<unsigned char> texels;
+    };
+    std::vector<Level> levels;
+    bool srgb = false;
+
+    glm::vec4 fetch(const Level &level, int x, int y) const
+    {
+        x %= level.width;
+        y %= level.height;
+        if (x < 0)
+            x += level.width;
+        if (y < 0)
+            y += level.height;
+        const unsigned char *t = &level.texels[((size_t)y * level.width + x) * 4];
+        if (srgb)
+        {
+            const float *decode = srgbDecodeTable();
+            return glm::vec4(decode[t[0]], decode[t[1]], decode[t[2]], t[3] * (1.0f / 255.0f));
+        }
+        return glm::vec4(t[0], t[1], t[2], t[3]) * (1.0f / 255.0f);
+    }
+
+    glm::vec4 bilinear(const Level &level, glm::vec2 uv) const
+    {
+        float u = uv.x * level.width - 0.5f;
+        float v = uv.y * level.height - 0.5f;
+        float fu = std::floor(u), fv = std::floor(v);
+        int x = (int)fu, y = (int)fv;
+        float tu = u - fu, tv = v - fv;
+        glm::vec4 top = glm::mix(fetch(level, x, y), fetch(level, x + 1, y), tu);
+        glm::vec4 bottom = glm::mix(fetch(level, x, y + 1), fetch(level, x + 1, y + 1), tu);
+        return glm::mix(top, bottom, tv);
+    }
+};
+
+// the textures and constants bound for a draw
+struct SoftMaterial {
+    ShadingModel shading;
+    const SoftTexture *maps[PBR_MAP_COUNT];
+    // the normal map perturbs the normal, as the NORMAL_MAP variant the scene draws the item with does
+    bool normalMap;
+    float shininess;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+};
+
+// The images of the scene's materials decoded for the CPU renderers, keyed by path and kind: Phong reads the
+// albedo maps it shares with Cook-Torrance without sRGB decoding
+class SoftTextureCache
+{
+public:
+    typedef std::pair<std::string, TextureKind> Key;
+
+    // decodes every map bound by the draw list that isn't loaded yet, including the model's own textures
+    void Load(Scene &scene, const vector<DrawItem> &items, unsigned int threadCount)
+    {
+        std::vector<Key> keys;
+        for (unsigned int i = 0; i < items.size(); i++)
+        {
+            const DrawItem &item = items[i];
+            if (item.shading == SHADING_PHONG)
+                keys.push_back(Key(scene.phongMaterials[item.material].albedoPath, TEXTURE_COLOR_RAW));
+            else
+                for (unsigned int m = 0; m < PBR_MAP_COUNT; m++)
+                    keys.push_back(Key(scene.pbrMaterials[item.material].paths[m], PBR_MAP_KINDS[m]));
+            if (item.model)
+                for (unsigned int m = 0; m < item.model->meshes.size(); m++)
+                    for (unsigned int t = 0; t < item.model->meshes[m].textures.size(); t++)
+                        keys.push_back(modelKey(*item.model, item.model->meshes[m].textures[t]));
+        }
+
+        // decode in parallel, each thread filling entries that already exist in the map
+        std::vector<SoftTexture *> pending;
+        std::vector<Key> pendingKeys;
+        for (unsigned int i = 0; i < keys.size(); i++)
+        {
+            if (textures.count(keys[i]))
+                continue;
+            pending.push_back(&textures[keys[i]]);
+            pendingKeys.push_back(keys[i]);
+        }
+        std::atomic<unsigned int> next(0);
+        auto load = [&]() {
+            for (unsigned int i = next++; i < pending.size(); i = next++)
+                pending[i]->Load(pendingKeys[i].first, pendingKeys[i].second);
+        };
+        JobSystem::Get().RunParallel(std::min<unsigned int>(threadCount, (unsigned int)pending.size()), load);
+    }
+
+    const SoftTexture *Get(const std::string &path, TextureKind kind)
+    {
+        return &textures[Key(path, kind)];
+    }
+
+    // what a draw item binds, for one mesh of its model if it has one
+    SoftMaterial Material(Scene &scene, const DrawItem &item, const Mesh *mesh = nullptr)
+    {
+        SoftMaterial material;
+        material.shading = item.shading;
+        material.normalMap = false;
+        material.shininess = 0.0f;
+        if (item.shading == SHADING_PHONG)
+        {
+            const PhongMaterial &phong = scene.phongMaterials[item.material];
+            for (unsigned int m = 0; m < PBR_MAP_COUNT; m++)
+                material.maps[m] = Get(phong.albedoPath, TEXTURE_COLOR_RAW);
+            material.shininess = phong.shininess;
+            material.diffuse = phong.diffuse;
+            material.specular = phong.specular;
+        }
+        else
+        {
+            for (unsigned int m = 0; m < PBR_MAP_COUNT; m++)
+                material.maps[m] = Get(scene.pbrMaterials[item.material].paths[m], PBR_MAP_KINDS[m]);
+            // the same condition as Scene::variantKey
+            material.normalMap = item.model || !scene.pbrMaterials[item.material].paths[PBR_NORMAL].empty();
+        }
+        // like Mesh::Draw, the mesh's own textures replace the material on units 0, 1, ...
+        if (mesh)
+            for (unsigned int t = 0; t < mesh->textures.size() && t < PBR_MAP_COUNT; t++)
+                material.maps[t] = &textures[modelKey(*item.model, mesh->textures[t])];
+        return material;
+    }
+
+private:
+    std::map<Key, SoftTexture> textures;
+
+    static Key modelKey(const Model &model, const Texture &texture)
+    {
+        return Key(model.directory + '/' + texture.path, TextureKindFromType(texture.type, model.gammaCorrection));
+    }
+};
+
+// counters for the last frame rendered on the CPU
+struct SoftRasterStats {
+    unsigned long long triangles = 0;
+    unsigned long long fragments = 0;
+    double ms = 0.0;
+};
+
+// CPU reference renderer for the scene. Implements the vertex and fragment stages of cookTorrance.vs/.fs and
+// phongShader.vs/.fs on the draw list of a Scene, so comparison images can be made without a GL context.
+// Triangles are transformed, clipped against the near plane and binned into screen tiles on the calling thread,
+// then the tiles are rasterized and shaded by worker threads. Coverage and depth are tested four pixels at a time
+// with SSE2 where available. There is no multisampling, and derivatives are exact per triangle instead of per quad.
+class SoftRasterizer
+{
+public:
+    static const int TILE_SIZE = 32;
+
+    int width;
+    int height;
+    unsigned int threadCount;
+    // RGB, bottom row first like glReadPixels
+    std::vector<unsigned char> color;
+    SoftRasterStats stats;
+
+    SoftRasterizer(int width, int height, unsigned int threads = 0) : width(width), height(height)
+    {
+        threadCount = threads ? threads : JobSystem::Get().ThreadCount();
+        color.resize((size_t)width * height * 3);
+    }
+
+    // renders the scene from the camera with the same passes, in the same order, as Scene::Draw
+    void Render(Scene &scene, Camera &camera, const SceneState &state, const glm::mat4 &projection)
+    {
+        PROFILE_SCOPE("soft.frame");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        stats = SoftRasterStats();
+        camPos = camera.Position;
+        lightPositions = scene.entities.lightPositions;
+        lightColors = scene.entities.lightColors;
+        blinn = state.blinn;
+
+        vector<DrawItem> items = scene.BuildDrawList(state);
+        {
+            PROFILE_SCOPE("soft.textures");
+            textures.Load(scene, items, threadCount);
+        }
+        {
+            PROFILE_SCOPE("soft.geometry");
+            glm::mat4 viewProjection = projection * camera.GetViewMatrix();
+            triangles.clear();
+            materials.clear();
+            submitPass(scene, items, SHADING_COOK_TORRANCE, viewProjection);
+            submitPass(scene, items, SHADING_PHONG, viewProjection);
+            stats.triangles = triangles.size();
+            binTriangles();
+        }
+        {
+            PROFILE_SCOPE("soft.raster");
+            std::atomic<unsigned int> nextTile(0);
+            std::atomic<unsigned long long> fragments(0);
+            JobSystem::Get().RunParallel(threadCount, [&]() { rasterWorker(nextTile, fragments); });
+            stats.fragments = fragments;
+        }
+        stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool Save(const std::string &path) const
+    {
+        // image files start at the top row
+        std::vector<unsigned char> flipped(color.size());
+        size_t row = (size_t)width * 3;
+        for (int y = 0; y < height; y++)
+            std::copy(color.begin() + (height - 1 - y) * row, color.begin() + (height - y) * row, flipped.begin() + y * row);
+        if (!stbi_write_png(path.c_str(), width, height, 3, &flipped[0], (int)row))
+        {
+            std::cout << "ERROR::SOFT_RASTERIZER::FILE_NOT_WRITABLE: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // post-transform vertex, the outputs of the vertex shaders
+    struct SoftVertex {
+        glm::vec4 clip;
+        glm::vec3 world;
+        glm::vec3 normal;
+        glm::vec2 uv;
+    };
+
+    // a screen space triangle ready for rasterization, counter-clockwise with y up
+    struct SoftTriangle {
+        float edgeA[3], edgeB[3], edgeC[3];
+        bool topLeft[3];
+        float area;
+        float zA, zB, zC;
+        float invW[3];
+        glm::vec3 world[3];
+        glm::vec3 normal[3];
+        glm::vec2 uv[3];
+        // the tangent getNormalFromMap() builds from the screen space derivatives, constant over a triangle
+        glm::vec3 tangent;
+        int minX, minY, maxX, maxY;
+        unsigned int material;
+    };
+
+    glm::vec3 camPos;
+    std::vector<glm::vec3> lightPositions;
+    std::vector<glm::vec3> lightColors;
+    bool blinn = false;
+
+    SoftTextureCache textures;
+    std::vector<SoftMaterial> materials;
+    std::vector<SoftTriangle> triangles;
+    std::vector<std::vector<unsigned int> > bins;
+    int tilesX = 0, tilesY = 0;
+
+    // transforms and sets up the triangles of one shading model in draw list order
+    void submitPass(Scene &scene, const vector<DrawItem> &items, ShadingModel shading, const glm::mat4 &viewProjection)
+    {
+        for (unsigned int i = 0; i < items.size(); i++)
+        {
+            const DrawItem &item = items[i];
+            if (item.shading != shading)
+                continue;
+
+            std::vector<SoftVertex> vertices;
+            if (item.model)
+            {
+                for (unsigned int m = 0; m < item.model->meshes.size(); m++)
+                {
+                    const Mesh &mesh = item.model->meshes[m];
+                    materials.push_back(textures.Material(scene, item, &mesh));
+                    glm::mat4 transform = item.model->IsFlat() ? item.transform : item.transform * item.model->MeshTransform(m);
+
+                    vertices.resize(mesh.vertices.size());
+                    for (unsigned int v = 0; v < mesh.vertices.size(); v++)
+                        vertices[v] = transformVertex(transform, viewProjection, mesh.vertices[v].Position, mesh.vertices[v].Normal, mesh.vertices[v].TexCoords);
+                    for (unsigned int t = 0; t + 2 < mesh.indices.size(); t += 3)
+                        submitTriangle(vertices[mesh.indices[t]], vertices[mesh.indices[t + 1]], vertices[mesh.indices[t + 2]]);
+                }
+                continue;
+            }
+
+            materials.push_back(textures.Material(scene, item));
+            const Geometry &geometry = *item.geometry;
+            const std::vector<float> &data = geometry.vertices;
+            vertices.resize(data.size() / 8);
+            for (unsigned int v = 0; v < vertices.size(); v++)
+            {
+                const float *in = &data[v * 8];
+                vertices[v] = transformVertex(item.transform, viewProjection, glm::vec3(in[0], in[1], in[2]), glm::vec3(in[3], in[4], in[5]), glm::vec2(in[6], in[7]));
+            }
+            unsigned int count = geometry.count;
+            for (unsigned int t = 0; t + 2 < count; t += (geometry.mode == GL_TRIANGLE_STRIP ? 1 : 3))
+            {
+                unsigned int a = geometry.indexed ? geometry.indices[t] : t;
+                unsigned int b = geometry.indexed ? geometry.indices[t + 1] : t + 1;
+                unsigned int c = geometry.indexed ? geometry.indices[t + 2] : t + 2;
+                submitTriangle(vertices[a], vertices[b], vertices[c]);
+            }
+        }
+    }
+
+    // cookTorrance.vs and phongShader.vs
+    SoftVertex transformVertex(const glm::mat4 &model, const glm::mat4 &viewProjection, glm::vec3 position, glm::vec3 normal, glm::vec2 uv) const
+    {
+        SoftVertex vertex;
+        vertex.world = glm::vec3(model * glm::vec4(position, 1.0f));
+        vertex.normal = glm::mat3(model) * normal;
+        vertex.uv = uv;
+        vertex.clip = viewProjection * glm::vec4(vertex.world, 1.0f);
+        return vertex;
+    }
+
+    static SoftVertex lerpVertex(const SoftVertex &a, const SoftVertex &b, float t)
+    {
+        SoftVertex v;
+        v.clip = glm::mix(a.clip, b.clip, t);
+        v.world = glm::mix(a.world, b.world, t);
+        v.normal = glm::mix(a.normal, b.normal, t);
+        v.uv = a.uv + (b.uv - a.uv) * t;
+        return v;
+    }
+
+    // clips against the near plane (z > -w) and splits the result into triangles
+    void submitTriangle(const SoftVertex &a, const SoftVertex &b, const SoftVertex &c)
+    {
+        const SoftVertex *in[3] = { &a, &b, &c };
+        float d[3];
+        int inside = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            d[i] = in[i]->clip.z + in[i]->clip.w;
+            inside += d[i] >= 0.0f;
+        }
+        if (inside == 0)
+            return;
+        if (inside == 3)
+        {
+            setupTriangle(a, b, c);
+            return;
+        }
+        SoftVertex polygon[4];
+        int count = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            int j = (i + 1) % 3;
+            if (d[i] >= 0.0f)
+                polygon[count++] = *in[i];
+            if ((d[i] >= 0.0f) != (d[j] >= 0.0f))
+                polygon[count++] = lerpVertex(*in[i], *in[j], d[i] / (d[i] - d[j]));
+        }
+        for (int i = 1; i + 1 < count; i++)
+            setupTriangle(polygon[0], polygon[i], polygon[i + 1]);
+    }
+
+    void setupTriangle(const SoftVertex &a, const SoftVertex &b, const SoftVertex &c)
+    {
+        const SoftVertex *v[3] = { &a, &b, &c };
+        float x[3], y[3], z[3], invW[3];
+        for (int i = 0; i < 3; i++)
+        {
+            invW[i] = 1.0f / v[i]->clip.w;
+            // window coordinates snapped to 1/256 of a pixel so shared edges are evaluated identically
+            x[i] = std::floor(((v[i]->clip.x * invW[i]) * 0.5f + 0.5f) * width * 256.0f + 0.5f) / 256.0f;
+            y[i] = std::floor(((v[i]->clip.y * invW[i]) * 0.5f + 0.5f) * height * 256.0f + 0.5f) / 256.0f;
+            z[i] = v[i]->clip.z * invW[i];
+        }
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (area == 0.0f || !std::isfinite(area))
+            return;
+        // there is no face culling, so clockwise triangles are made counter-clockwise
+        if (area < 0.0f)
+        {
+            std::swap(v[1], v[2]);
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(z[1], z[2]);
+            std::swap(invW[1], invW[2]);
+            area = -area;
+        }
+
+        SoftTriangle tri;
+        tri.minX = std::max(0, (int)std::floor(std::min(x[0], std::min(x[1], x[2]))));
+        tri.minY = std::max(0, (int)std::floor(std::min(y[0], std::min(y[1], y[2]))));
+        tri.maxX = std::min(width - 1, (int)std::ceil(std::max(x[0], std::max(x[1], x[2]))));
+        tri.maxY = std::min(height - 1, (int)std::ceil(std::max(y[0], std::max(y[1], y[2]))));
+        if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+            return;
+
+        // edge i is opposite vertex i and is positive inside, edge(p) / area is the screen space barycentric
+        for (int i = 0; i < 3; i++)
+        {
+            int j = (i + 1) % 3, k = (i + 2) % 3;
+            float dx = x[k] - x[j], dy = y[k] - y[j];
+            tri.edgeA[i] = -dy;
+            tri.edgeB[i] = dx;
+            tri.edgeC[i] = dy * x[j] - dx * y[j];
+            // pixels exactly on an edge belong to the triangle on its top or left side only
+            tri.topLeft[i] = dy < 0.0f || (dy == 0.0f && dx < 0.0f);
+        }
+        tri.area = area;
+        float invArea = 1.0f / area;
+        tri.zA = (tri.edgeA[0] * z[0] + tri.edgeA[1] * z[1] + tri.edgeA[2] * z[2]) * invArea;
+        tri.zB = (tri.edgeB[0] * z[0] + tri.edgeB[1] * z[1] + tri.edgeB[2] * z[2]) * invArea;
+        tri.zC = (tri.edgeC[0] * z[0] + tri.edgeC[1] * z[1] + tri.edgeC[2] * z[2]) * invArea;
+        for (int i = 0; i < 3; i++)
+        {
+            tri.invW[i] = invW[i];
+            tri.world[i] = v[i]->world;
+            tri.normal[i] = v[i]->normal;
+            tri.uv[i] = v[i]->uv;
+        }
+
+        // Q1 * st2.t - Q2 * st1.t from getNormalFromMap() works out to the world space edges weighted by the
+        // texture t differences, scaled by the (here positive) determinant of the screen space derivatives
+        glm::vec3 tangent = (tri.world[1] - tri.world[0]) * (tri.uv[2].y - tri.uv[0].y) - (tri.world[2] - tri.world[0]) * (tri.uv[1].y - tri.uv[0].y);
+        float length = glm::length(tangent);
+        tri.tangent = length > 0.0f ? tangent / length : glm::vec3(0.0f);
+        tri.material = (unsigned int)materials.size() - 1;
+        triangles.push_back(tri);
+    }
+
+    // lists the triangles overlapping each tile, keeping submission order
+    void binTriangles()
+    {
+        tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+        tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+        bins.assign((size_t)tilesX * tilesY, std::vector<unsigned int>());
+        for (unsigned int i = 0; i < triangles.size(); i++)
+        {
+            const SoftTriangle &tri = triangles[i];
+            for (int ty = tri.minY / TILE_SIZE; ty <= tri.maxY / TILE_SIZE; ty++)
+                for (int tx = tri.minX / TILE_SIZE; tx <= tri.maxX / TILE_SIZE; tx++)
+                    bins[ty * tilesX + tx].push_back(i);
+        }
+    }
+
+    void rasterWorker(std::atomic<unsigned int> &nextTile, std::atomic<unsigned long long> &fragments)
+    {
+        PROFILE_SCOPE("soft.tiles");
+        float depth[TILE_SIZE * TILE_SIZE];
+        unsigned long long shaded = 0;
+        for (unsigned int tile = nextTile++; tile < bins.size(); tile = nextTile++)
+            shaded += rasterTile(tile, depth);
+        fragments += shaded;
+    }
+
+    unsigned long long rasterTile(unsigned int tile, float *depth)
+    {
+        int tileX = (tile % tilesX) * TILE_SIZE, tileY = (tile / tilesX) * TILE_SIZE;
+        int endX = std::min(tileX + TILE_SIZE, width) - 1, endY = std::min(tileY + TILE_SIZE, height) - 1;
+
+        // clear to the same colour and depth as the GL passes
+        std::fill(depth, depth + TILE_SIZE * TILE_SIZE, 1.0f);
+        for (int y = tileY; y <= endY; y++)
+            for (int x = tileX; x <= endX; x++)
+                writeColor(x, y, glm::vec3(0.3f));
+
+        unsigned long long shaded = 0;
+        const std::vector<unsigned int> &bin = bins[tile];
+        for (unsigned int i = 0; i < bin.size(); i++)
+        {
+            const SoftTriangle &tri = triangles[bin[i]];
+            int x0 = std::max(tri.minX, tileX), x1 = std::min(tri.maxX, endX);
+            int y0 = std::max(tri.minY, tileY), y1 = std::min(tri.maxY, endY);
+            // blocks of four pixels are aligned to the tile so the depth loads stay inside it
+            x0 = tileX + ((x0 - tileX) & ~3);
+            for (int y = y0; y <= y1; y++)
+            {
+                float py = y + 0.5f;
+                float *depthRow = depth + (y - tileY) * TILE_SIZE - tileX;
+                for (int x = x0; x <= x1; x += 4)
+                {
+                    int mask = coverage(tri, x, py, x1, depthRow + x);
+                    for (int lane = 0; lane < 4; lane++)
+                    {
+                        if (!(mask & (1 << lane)))
+                            continue;
+                        shadePixel(tri, x + lane, y);
+                        shaded++;
+                    }
+                }
+            }
+        }
+        return shaded;
+    }
+
+    // tests four pixels starting at x against the edges and the depth buffer, writing the depth of those that pass
+#ifdef __SSE2__
+    int coverage(const SoftTriangle &tri, int x, float py, int lastX, float *depth) const
+    {
+        const __m128 zero = _mm_setzero_ps();
+        __m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+        __m128 mask = _mm_cmple_ps(px, _mm_set1_ps(lastX + 0.5f));
+        for (int i = 0; i < 3; i++)
+        {
+            __m128 e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.edgeA[i]), px), _mm_set1_ps(tri.edgeB[i] * py + tri.edgeC[i]));
+            __m128 inside = tri.topLeft[i] ? _mm_cmpge_ps(e, zero) : _mm_cmpgt_ps(e, zero);
+            mask = _mm_and_ps(mask, inside);
+        }
+        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.zA), px), _mm_set1_ps(tri.zB * py + tri.zC));
+        __m128 stored = _mm_loadu_ps(depth);
+        mask = _mm_and_ps(mask, _mm_cmplt_ps(z, stored));
+        _mm_storeu_ps(depth, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, stored)));
+        return _mm_movemask_ps(mask);
+    }
+#else
+    int coverage(const SoftTriangle &tri, int x, float py, int lastX, float *depth) const
+    {
+        int mask = 0;
+        for (int lane = 0; lane < 4 && x + lane <= lastX; lane++)
+        {
+            float px = x + lane + 0.5f;
+            bool inside = true;
+            for (int i = 0; i < 3 && inside; i++)
+            {
+                float e = tri.edgeA[i] * px + tri.edgeB[i] * py + tri.edgeC[i];
+                inside = tri.topLeft[i] ? e >= 0.0f : e > 0.0f;
+            }
+            float z = tri.zA * px + tri.zB * py + tri.zC;
+            if (inside && z < depth[lane])
+            {
+                depth[lane] = z;
+                mask |= 1 << lane;
+            }
+        }
+        return mask;
+    }
+#endif
+
+    // perspective correct weights of the three vertices at a point in window coordinates
+    void weights(const SoftTriangle &tri, float px, float py, float *w) const
+    {
+        float sum = 0.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            w[i] = (tri.edgeA[i] * px + tri.edgeB[i] * py + tri.edgeC[i]) * tri.invW[i];
+            sum += w[i];
+        }
+        for (int i = 0; i < 3; i++)
+            w[i] /= sum;
+    }
+
+    glm::vec2 interpolateUV(const SoftTriangle &tri, const float *w) const
+    {
+        return tri.uv[0] * w[0] + tri.uv[1] * w[1] + tri.uv[2] * w[2];
+    }
+
+    void shadePixel(const SoftTriangle &tri, int x, int y)
+    {
+        float px = x + 0.5f, py = y + 0.5f;
+        float w[3], wx[3], wy[3];
+        weights(tri, px, py, w);
+        weights(tri, px + 1.0f, py, wx);
+        weights(tri, px, py + 1.0f, wy);
+
+        glm::vec3 world = tri.world[0] * w[0] + tri.world[1] * w[1] + tri.world[2] * w[2];
+        glm::vec3 normal = tri.normal[0] * w[0] + tri.normal[1] * w[1] + tri.normal[2] * w[2];
+        glm::vec2 uv = interpolateUV(tri, w);
+        glm::vec2 dUVdx = interpolateUV(tri, wx) - uv;
+        glm::vec2 dUVdy = interpolateUV(tri, wy) - uv;
+
+        const SoftMaterial &material = materials[tri.material];
+        if (material.shading == SHADING_PHONG)
+            writeColor(x, y, shadePhong(material, world, normal, uv, dUVdx, dUVdy));
+        else
+            writeColor(x, y, shadeCookTorrance(material, tri.tangent, world, normal, uv, dUVdx, dUVdy));
+    }
+
+    static glm::vec4 sample(const SoftTexture *texture, glm::vec2 uv, glm::vec2 dUVdx, glm::vec2 dUVdy)
+    {
+        return texture->Sample(uv, texture->Lod(dUVdx, dUVdy));
+    }
+
+    // phongShader.fs
+    glm::vec3 shadePhong(const SoftMaterial &material, glm::vec3 fragPos, glm::vec3 fragNormal, glm::vec2 uv, glm::vec2 dUVdx, glm::vec2 dUVdy) const
+    {
+        glm::vec3 color = glm::vec3(sample(material.maps[0], uv, dUVdx, dUVdy));
+        glm::vec3 ambient = 0.2f * color;
+        glm::vec3 normal = glm::normalize(fragNormal);
+        glm::vec3 viewDir = glm::normalize(camPos - fragPos);
+        float totSpec = 0.0f;
+        glm::vec3 totDiff(0.0f);
+        for (unsigned int i = 0; i < lightPositions.size(); i++)
+        {
+            glm::vec3 lightDir = glm::normalize(lightPositions[i] - fragPos);
+            float diff = std::max(glm::dot(lightDir, normal), 0.0f);
+            totDiff = totDiff + diff * color;
+            float spec;
+            if (blinn)
+            {
+                glm::vec3 halfwayDir = glm::normalize(lightDir + viewDir);
+                spec = std::pow(std::max(glm::dot(normal, halfwayDir), 0.0f), material.shininess);
+            }
+            else
+            {
+                glm::vec3 reflectDir = glm::reflect(-lightDir, normal);
+                spec = std::pow(std::max(glm::dot(viewDir, reflectDir), 0.0f), material.shininess);
+            }
+            totSpec += spec;
+        }
+        glm::vec3 specular = glm::vec3(0.5f) * totSpec * material.specular;
+        return ambient + totDiff * material.diffuse + specular;
+    }
+
+    // cookTorrance.fs
+    glm::vec3 shadeCookTorrance(const SoftMaterial &material, glm::vec3 tangent, glm::vec3 worldPos, glm::vec3 fragNormal, glm::vec2 uv, glm::vec2 dUVdx, glm::vec2 dUVdy) const
+    {
+        const float PI = 3.14159265359f;
+        glm::vec3 albedo = glm::vec3(sample(material.maps[PBR_ALBEDO], uv, dUVdx, dUVdy));
+        float metallic = sample(material.maps[PBR_METALLIC], uv, dUVdx, dUVdy).x;
+        float roughness = sample(material.maps[PBR_ROUGHNESS], uv, dUVdx, dUVdy).x;
+        float ao = sample(material.maps[PBR_AO], uv, dUVdx, dUVdy).x;
+
+        // getNormalFromMap(), only for materials with a normal map
+        glm::vec3 N = glm::normalize(fragNormal);
+        if (material.normalMap)
+        {
+            glm::vec4 normalTexel = sample(material.maps[PBR_NORMAL], uv, dUVdx, dUVdy);
+            glm::vec2 tangentXY = glm::vec2(normalTexel.x, normalTexel.y) * 2.0f - glm::vec2(1.0f);
+            glm::vec3 tangentNormal(tangentXY, std::sqrt(std::max(1.0f - glm::dot(tangentXY, tangentXY), 0.0f)));
+            glm::vec3 B = -glm::normalize(glm::cross(N, tangent));
+            N = glm::normalize(tangent * tangentNormal.x + B * tangentNormal.y + N * tangentNormal.z);
+        }
+        glm::vec3 V = glm::normalize(camPos - worldPos);
+
+        glm::vec3 F0 = glm::mix(glm::vec3(0.04f), albedo, metallic);
+        float a2 = roughness * roughness * roughness * roughness;
+        float r = roughness + 1.0f;
+        float k = (r * r) / 8.0f;
+        float NdotV = std::max(glm::dot(N, V), 0.0f);
+
+        glm::vec3 Lo(0.0f);
+        for (unsigned int i = 0; i < lightPositions.size(); i++)
+        {
+            glm::vec3 L = glm::normalize(lightPositions[i] - worldPos);
+            glm::vec3 H = glm::normalize(V + L);
+            float distance = glm::length(lightPositions[i] - worldPos);
+            glm::vec3 radiance = lightColors[i] * (1.0f / (distance * distance));
+
+            float NdotL = std::max(glm::dot(N, L), 0.0f);
+            float NH = std::max(glm::dot(N, H), 0.0f);
+            float denom = NH * NH * (a2 - 1.0f) + 1.0f;
+            float NDF = a2 / (PI * denom * denom);
+            float G = (NdotV / (NdotV * (1.0f - k) + k)) * (NdotL / (NdotL * (1.0f - k) + k));
+            glm::vec3 F = F0 + (glm::vec3(1.0f) - F0) * std::pow(glm::clamp(1.0f - std::max(glm::dot(H, V), 0.0f), 0.0f, 1.0f), 5.0f);
+
+            glm::vec3 specular = NDF * G * F / (4.0f * NdotV * NdotL + 0.0001f);
+            glm::vec3 kD = (glm::vec3(1.0f) - F) * (1.0f - metallic);
+            Lo = Lo + (kD * albedo / PI + specular) * radiance * NdotL;
+        }
+
+        glm::vec3 color = glm::vec3(0.03f) * albedo * ao + Lo;
+        color = color / (color + glm::vec3(1.0f));
+        return glm::pow(color, glm::vec3(1.0f / 2.2f));
+    }
+
+    // stores a colour clamped and rounded like a write to an RGBA8 attachment
+    void writeColor(int x, int y, glm::vec3 value)
+    {
+        unsigned char *out = &color[((size_t)y * width + x) * 3];
+        for (int c = 0; c < 3; c++)
+        {
+            float v = value[c];
+            v = v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f;
+            out[c] = (unsigned char)(v * 255.0f + 0.5f);
+        }
+    }
+};
+#endif
@@ -0,0 +1,954 @@
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include <glad/glad.h>
+
+#include "profiler.h"
+#include "gpuResources.h"
+#include "assetPack.h"
+#include "jobSystem.h"
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <climits>
+#include <sys/stat.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// block compressed formats of the S3TC and BPTC extensions, which are not part of the OpenGL 3.3 core loader
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+
+// what a texture holds, which decides the block format it is cooked to
+enum TextureKind {
+    // sRGB albedo, decoded to linear by the sampler: BC7, or BC1/BC3 without BPTC support
+    TEXTURE_COLOR,
+    // an sRGB image sampled as stored, for phongShader.fs which lights the values without decoding them
+    TEXTURE_COLOR_RAW,
+    // tangent space normal map: BC5 with x and y only, z is reconstructed in the shader
+    TEXTURE_NORMAL,
+    // metallic, roughness and AO maps read from the red channel: BC4
+    TEXTURE_GRAY,
+    // AO, roughness and metallic packed into red, green and blue: BC7, or BC1 without BPTC support
+    TEXTURE_ORM
+};
+
+// one channel of a packed texture: the red channel of an image, or a constant value where there is no image
+struct PackedChannel {
+    std::string path;
+    float value;
+};
+
+enum BlockFormat {
+    BLOCK_BC1,
+    BLOCK_BC3,
+    BLOCK_BC4,
+    BLOCK_BC5,
+    BLOCK_BC7,
+    BLOCK_FORMAT_COUNT
+};
+
+struct BlockFormatInfo {
+    const char *name;
+    unsigned int dxgiFormat;
+    GLenum glFormat;
+    // the same blocks decoded from sRGB by the sampler, 0 for the formats without an sRGB variant
+    GLenum srgbGlFormat;
+    unsigned int blockBytes;
+};
+
+// DDS files name the UNORM formats; whether a colour map is sampled as sRGB is decided when it is uploaded
+const BlockFormatInfo BLOCK_FORMATS[BLOCK_FORMAT_COUNT] = {
+    {"bc1", 71, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, 8},
+    {"bc3", 77, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 16},
+    {"bc4", 80, GL_COMPRESSED_RED_RGTC1, 0, 8},
+    {"bc5", 83, GL_COMPRESSED_RG_RGTC2, 0, 16},
+    {"bc7", 98, GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, 16},
+};
+
+// an image and its mip chain in one block format, largest level first
+struct CompressedTexture {
+    BlockFormat format;
+    int width;
+    int height;
+    std::vector<std::vector<unsigned char> > levels;
+};
+
+// cooked textures are used by loadTexture when they are present and up to date, unless turned off
+bool useCookedTextures = true;
+
+// the sRGB transfer functions, for colour maps that are filtered or shaded in linear space
+float srgbToLinear(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float c)
+{
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+// the linear value of every 8 bit sRGB value
+const float *srgbDecodeTable()
+{
+    static const struct Table {
+        float values[256];
+        Table()
+        {
+            for (int i = 0; i < 256; i++)
+                values[i] = srgbToLinear(i / 255.0f);
+        }
+    } table;
+    return table.values;
+}
+
+// Builds mip chains on the CPU, in parallel over the rows of each level. Every level averages 2x2 texels of the
+// previous one in the space the kind of texture is filtered in: colour maps are decoded from sRGB and encoded again
+// after averaging, so that distant surfaces keep their brightness; normals are averaged as vectors and renormalized;
+// data maps are averaged as stored, two texels at a time with SSE2 where available.
+class MipGenerator
+{
+public:
+    unsigned int threadCount;
+
+    MipGenerator(unsigned int threads = 0)
+    {
+        threadCount = threads ? threads : JobSystem::Get().ThreadCount();
+    }
+
+    // appends the levels below mips[0], an RGBA image of width x height, down to 1x1
+    void Build(std::vector<std::vector<unsigned char> > &mips, int width, int height, TextureKind kind) const
+    {
+        PROFILE_SCOPE("cook.mips");
+        while (width > 1 || height > 1)
+        {
+            int dstWidth = std::max(1, width / 2), dstHeight = std::max(1, height / 2);
+            mips.push_back(std::vector<unsigned char>((size_t)dstWidth * dstHeight * 4));
+            const unsigned char *src = &mips[mips.size() - 2][0];
+            unsigned char *dst = &mips.back()[0];
+            std::atomic<int> nextRow(0);
+            auto worker = [&]() {
+                for (int y = nextRow++; y < dstHeight; y = nextRow++)
+                {
+                    const unsigned char *row0 = src + (size_t)std::min(y * 2, height - 1) * width * 4;
+                    const unsigned char *row1 = src + (size_t)std::min(y * 2 + 1, height - 1) * width * 4;
+                    unsigned char *out = dst + (size_t)y * dstWidth * 4;
+                    if (kind == TEXTURE_NORMAL)
+                        downsampleNormals(row0, row1, width, out, dstWidth);
+                    else if (kind == TEXTURE_GRAY || kind == TEXTURE_ORM)
+                        downsampleLinear(row0, row1, width, out, dstWidth);
+                    else
+                        downsampleSrgb(row0, row1, width, out, dstWidth);
+                }
+            };
+            // levels below 64K texels are done on this thread
+            JobSystem::Get().RunParallel((unsigned int)std::min<size_t>(threadCount, (size_t)dstWidth * dstHeight / 65536 + 1), worker);
+            width = dstWidth;
+            height = dstHeight;
+        }
+    }
+
+private:
+    // the source columns of destination texel x; only a 1 texel wide source repeats its column
+    static void columns(int x, int width, int &x0, int &x1)
+    {
+        x0 = std::min(x * 2, width - 1);
+        x1 = std::min(x * 2 + 1, width - 1);
+    }
+
+    static void downsampleLinear(const unsigned char *row0, const unsigned char *row1, int width, unsigned char *out, int dstWidth)
+    {
+        int x = 0;
+#ifdef __SSE2__
+        // four source texels of both rows widened to 16 bits, summed down the rows and then across the pairs
+        const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+        for (; x + 2 <= dstWidth; x += 2)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)(row0 + x * 8));
+            __m128i b = _mm_loadu_si128((const __m128i *)(row1 + x * 8));
+            __m128i left = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            __m128i right = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+            __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(left, right), _mm_unpackhi_epi64(left, right));
+            sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+            _mm_storel_epi64((__m128i *)(out + x * 4), _mm_packus_epi16(sum, sum));
+        }
+#endif
+        for (; x < dstWidth; x++)
+        {
+            int x0, x1;
+            columns(x, width, x0, x1);
+            for (int c = 0; c < 4; c++)
+            {
+                int sum = row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c];
+                out[x * 4 + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+
+    // alpha is coverage, not a colour, and is averaged as stored
+    static void downsampleSrgb(const unsigned char *row0, const unsigned char *row1, int width, unsigned char *out, int dstWidth)
+    {
+        static const SrgbEncodeTable encode;
+        const float *decode = srgbDecodeTable();
+        for (int x = 0; x < dstWidth; x++)
+        {
+            int x0, x1;
+            columns(x, width, x0, x1);
+            for (int c = 0; c < 3; c++)
+            {
+                float sum = decode[row0[x0 * 4 + c]] + decode[row0[x1 * 4 + c]] + decode[row1[x0 * 4 + c]] + decode[row1[x1 * 4 + c]];
+                out[x * 4 + c] = encode.values[(int)(sum * (SrgbEncodeTable::STEPS / 4.0f) + 0.5f)];
+            }
+            int alpha = row0[x0 * 4 + 3] + row0[x1 * 4 + 3] + row1[x0 * 4 + 3] + row1[x1 * 4 + 3];
+            out[x * 4 + 3] = (unsigned char)((alpha + 2) / 4);
+        }
+    }
+
+    static void downsampleNormals(const unsigned char *row0, const unsigned char *row1, int width, unsigned char *out, int dstWidth)
+    {
+        const unsigned char *texels[4];
+        for (int x = 0; x < dstWidth; x++)
+        {
+            int x0, x1;
+            columns(x, width, x0, x1);
+            texels[0] = row0 + x0 * 4;
+            texels[1] = row0 + x1 * 4;
+            texels[2] = row1 + x0 * 4;
+            texels[3] = row1 + x1 * 4;
+            float n[3] = {0.0f, 0.0f, 0.0f};
+            int alpha = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                for (int c = 0; c < 3; c++)
+                    n[c] += texels[i][c] * (2.0f / 255.0f) - 1.0f;
+                alpha += texels[i][3];
+            }
+            float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            // normals that cancel out fall back to the surface normal
+            if (length < 1e-6f)
+            {
+                n[0] = n[1] = 0.0f;
+                n[2] = length = 1.0f;
+            }
+            for (int c = 0; c < 3; c++)
+                out[x * 4 + c] = (unsigned char)std::min(std::max((n[c] / length * 0.5f + 0.5f) * 255.0f + 0.5f, 0.0f), 255.0f);
+            out[x * 4 + 3] = (unsigned char)((alpha + 2) / 4);
+        }
+    }
+
+    // linear values quantized to STEPS, encoded to 8 bit sRGB
+    struct SrgbEncodeTable {
+        static const int STEPS = 4096;
+        unsigned char values[STEPS + 1];
+
+        SrgbEncodeTable()
+        {
+            for (int i = 0; i <= STEPS; i++)
+                values[i] = (unsigned char)(linearToSrgb((float)i / STEPS) * 255.0f + 0.5f);
+        }
+    };
+};
+
+// Encoders for 4x4 blocks of RGBA texels. Endpoints are the extremes of the block along its principal axis, and
+// each texel takes the nearest palette entry. BC7 uses mode 6 only: one RGBA subset with 7 bit endpoints, a p-bit
+// per endpoint and 16 interpolated values, which suits smooth albedo maps well.
+class BlockEncoder
+{
+public:
+    static void Encode(BlockFormat format, const unsigned char *rgba, unsigned char *out)
+    {
+        switch (format)
+        {
+        case BLOCK_BC1:
+            encodeBC1(rgba, out);
+            break;
+        case BLOCK_BC3:
+            encodeBC4(rgba + 3, out);
+            encodeBC1(rgba, out + 8);
+            break;
+        case BLOCK_BC4:
+            encodeBC4(rgba, out);
+            break;
+        case BLOCK_BC5:
+            encodeBC4(rgba, out);
+            encodeBC4(rgba + 1, out + 8);
+            break;
+        case BLOCK_BC7:
+            encodeBC7(rgba, out);
+            break;
+        default:
+            break;
+        }
+    }
+
+private:
+    // mean and principal axis of the first channels of the block, by power iteration on the covariance
+    static void principalAxis(const unsigned char *rgba, int channels, float *mean, float *axis)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            mean[c] = 0.0f;
+            for (int i = 0; i < 16; i++)
+                mean[c] += rgba[i * 4 + c];
+            mean[c] /= 16.0f;
+        }
+        float covariance[4][4] = {};
+        for (int i = 0; i < 16; i++)
+            for (int a = 0; a < channels; a++)
+                for (int b = 0; b < channels; b++)
+                    covariance[a][b] += (rgba[i * 4 + a] - mean[a]) * (rgba[i * 4 + b] - mean[b]);
+        for (int c = 0; c < channels; c++)
+            axis[c] = 1.0f;
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[4] = {}, length = 0.0f;
+            for (int a = 0; a < channels; a++)
+            {
+                for (int b = 0; b < channels; b++)
+                    next[a] += covariance[a][b] * axis[b];
+                length = std::max(length, std::fabs(next[a]));
+            }
+            if (length == 0.0f)
+                break;
+            for (int c = 0; c < channels; c++)
+                axis[c] = next[c] / length;
+        }
+    }
+
+    // the two ends of the block along its principal axis
+    static void endpoints(const unsigned char *rgba, int channels, float *low, float *high)
+    {
+        float mean[4], axis[4];
+        principalAxis(rgba, channels, mean, axis);
+        float minT = 0.0f, maxT = 0.0f, axisLength = 0.0f;
+        for (int c = 0; c < channels; c++)
+            axisLength += axis[c] * axis[c];
+        for (int i = 0; i < 16; i++)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < channels; c++)
+                t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+            t = axisLength > 0.0f ? t / axisLength : 0.0f;
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+        for (int c = 0; c < channels; c++)
+        {
+            low[c] = std::min(std::max(mean[c] + axis[c] * minT, 0.0f), 255.0f);
+            high[c] = std::min(std::max(mean[c] + axis[c] * maxT, 0.0f), 255.0f);
+        }
+    }
+
+    static unsigned short pack565(const float *color)
+    {
+        int r = (int)(color[0] * 31.0f / 255.0f + 0.5f), g = (int)(color[1] * 63.0f / 255.0f + 0.5f), b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+        return (unsigned short)((r << 11) | (g << 5) | b);
+    }
+
+    static void unpack565(unsigned short packed, int *color)
+    {
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    static void encodeBC1(const unsigned char *rgba, unsigned char *out)
+    {
+        float low[3], high[3];
+        endpoints(rgba, 3, low, high);
+        unsigned short c0 = pack565(high), c1 = pack565(low);
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        // four colour mode needs c0 > c1; equal endpoints give a flat block with every index 0
+        int palette[4][3];
+        unpack565(c0, palette[0]);
+        unpack565(c1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        unsigned int indices = 0;
+        if (c0 != c1)
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0, bestError = INT_MAX;
+                for (int p = 0; p < 4; p++)
+                {
+                    int error = 0;
+                    for (int c = 0; c < 3; c++)
+                    {
+                        int d = rgba[i * 4 + c] - palette[p][c];
+                        error += d * d;
+                    }
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        best = p;
+                    }
+                }
+                indices |= (unsigned int)best << (i * 2);
+            }
+        out[0] = c0 & 0xFF;
+        out[1] = c0 >> 8;
+        out[2] = c1 & 0xFF;
+        out[3] = c1 >> 8;
+        for (int b = 0; b < 4; b++)
+            out[4 + b] = (indices >> (b * 8)) & 0xFF;
+    }
+
+    // one channel of the block, at a stride of four bytes
+    static void encodeBC4(const unsigned char *channel, unsigned char *out)
+    {
+        int r0 = 0, r1 = 255;
+        for (int i = 0; i < 16; i++)
+        {
+            r0 = std::max(r0, (int)channel[i * 4]);
+            r1 = std::min(r1, (int)channel[i * 4]);
+        }
+        // eight value mode when r0 > r1, and a flat block when they are equal
+        int palette[8] = {r0, r1};
+        for (int p = 2; p < 8; p++)
+            palette[p] = ((8 - p) * r0 + (p - 1) * r1 + 3) / 7;
+        unsigned long long indices = 0;
+        if (r0 != r1)
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0, bestError = INT_MAX;
+                for (int p = 0; p < 8; p++)
+                {
+                    int error = std::abs(channel[i * 4] - palette[p]);
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        best = p;
+                    }
+                }
+                indices |= (unsigned long long)best << (i * 3);
+            }
+        out[0] = (unsigned char)r0;
+        out[1] = (unsigned char)r1;
+        for (int b = 0; b < 6; b++)
+            out[2 + b] = (indices >> (b * 8)) & 0xFF;
+    }
+
+    static void encodeBC7(const unsigned char *rgba, unsigned char *out)
+    {
+        static const int WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+        float low[4], high[4];
+        endpoints(rgba, 4, low, high);
+
+        // the p-bit is the lowest bit of all four channels of an endpoint, so each combination is tried
+        int bestEndpoints[2][4], bestPBits[2] = {0, 0}, bestIndices[16];
+        int bestError = INT_MAX;
+        for (int p = 0; p < 4; p++)
+        {
+            int pBits[2] = {p & 1, p >> 1}, quantized[2][4], palette[16][4];
+            for (int c = 0; c < 4; c++)
+            {
+                quantized[0][c] = std::min(std::max((int)((low[c] - pBits[0]) / 2.0f + 0.5f), 0), 127);
+                quantized[1][c] = std::min(std::max((int)((high[c] - pBits[1]) / 2.0f + 0.5f), 0), 127);
+            }
+            for (int w = 0; w < 16; w++)
+                for (int c = 0; c < 4; c++)
+                {
+                    int e0 = (quantized[0][c] << 1) | pBits[0], e1 = (quantized[1][c] << 1) | pBits[1];
+                    palette[w][c] = ((64 - WEIGHTS[w]) * e0 + WEIGHTS[w] * e1 + 32) >> 6;
+                }
+            int total = 0, indices[16];
+            for (int i = 0; i < 16 && total < bestError; i++)
+            {
+                int best = 0, bestTexelError = INT_MAX;
+                for (int w = 0; w < 16; w++)
+                {
+                    int error = 0;
+                    for (int c = 0; c < 4; c++)
+                    {
+                        int d = rgba[i * 4 + c] - palette[w][c];
+                        error += d * d;
+                    }
+                    if (error < bestTexelError)
+                    {
+                        bestTexelError = error;
+                        best = w;
+                    }
+                }
+                indices[i] = best;
+                total += bestTexelError;
+            }
+            if (total < bestError)
+            {
+                bestError = total;
+                memcpy(bestEndpoints, quantized, sizeof(quantized));
+                bestPBits[0] = pBits[0];
+                bestPBits[1] = pBits[1];
+                memcpy(bestIndices, indices, sizeof(indices));
+            }
+        }
+
+        // the top bit of the first index is implied to be 0, which swapping the endpoints guarantees
+        if (bestIndices[0] & 8)
+        {
+            for (int c = 0; c < 4; c++)
+                std::swap(bestEndpoints[0][c], bestEndpoints[1][c]);
+            std::swap(bestPBits[0], bestPBits[1]);
+            for (int i = 0; i < 16; i++)
+                bestIndices[i] = 15 - bestIndices[i];
+        }
+
+        memset(out, 0, 16);
+        unsigned int bit = 0;
+        writeBits(out, bit, 1 << 6, 7);
+        for (int c = 0; c < 4; c++)
+        {
+            writeBits(out, bit, bestEndpoints[0][c], 7);
+            writeBits(out, bit, bestEndpoints[1][c], 7);
+        }
+        writeBits(out, bit, bestPBits[0], 1);
+        writeBits(out, bit, bestPBits[1], 1);
+        writeBits(out, bit, bestIndices[0], 3);
+        for (int i = 1; i < 16; i++)
+            writeBits(out, bit, bestIndices[i], 4);
+    }
+
+    static void writeBits(unsigned char *out, unsigned int &bit, int value, int count)
+    {
+        for (int b = 0; b < count; b++, bit++)
+            if (value & (1 << b))
+                out[bit >> 3] |= (unsigned char)(1 << (bit & 7));
+    }
+};
+
+// Cooks source images into block compressed DDS files next to them, with their mip chains, for loadTexture.
+// The mips are built by MipGenerator before compression, and blocks are encoded on worker threads, a row of blocks
+// at a time.
+class TextureCooker
+{
+public:
+    unsigned int threadCount;
+
+    TextureCooker(unsigned int threads = 0)
+    {
+        threadCount = threads ? threads : JobSystem::Get().ThreadCount();
+    }
+
+    // the cache file of a source image in a block format, e.g. albedo.png.bc7.dds
+    static std::string CookedPath(const std::string &source, BlockFormat format)
+    {
+        return source + "." + BLOCK_FORMATS[format].name + ".dds";
+    }
+
+    // true if the cache file exists and is not older than the source image
+    static bool IsCooked(const std::string &source, BlockFormat format)
+    {
+        // the asset pack is written from cooked files, so what it holds is up to date
+        if (AssetPack::Get().Find(CookedPath(source, format)))
+            return true;
+        struct stat sourceStat, cookedStat;
+        if (stat(CookedPath(source, format).c_str(), &cookedStat) != 0)
+            return false;
+        return stat(source.c_str(), &sourceStat) != 0 || cookedStat.st_mtime >= sourceStat.st_mtime;
+    }
+
+    // Packs the red channels of up to three images into one RGB image, at the size of the largest of them; the
+    // others are resampled bilinearly. Without any image it is a single texel of the constant values.
+    static bool PackChannels(const PackedChannel channels[3], std::vector<unsigned char> &rgb, int &width, int &height)
+    {
+        struct Source {
+            unsigned char *data = NULL;
+            int width = 0, height = 0;
+        } sources[3];
+        width = height = 1;
+        bool loaded = true;
+        for (int c = 0; c < 3; c++)
+        {
+            if (channels[c].path.empty())
+                continue;
+            int nrComponents;
+            sources[c].data = AssetPack::LoadImage(channels[c].path, &sources[c].width, &sources[c].height, &nrComponents, 1);
+            if (!sources[c].data)
+            {
+                std::cout << "Texture failed to load at path: " << channels[c].path << std::endl;
+                loaded = false;
+                continue;
+            }
+            if ((size_t)sources[c].width * sources[c].height > (size_t)width * height)
+            {
+                width = sources[c].width;
+                height = sources[c].height;
+            }
+        }
+
+        rgb.resize((size_t)width * height * 3);
+        for (int c = 0; c < 3; c++)
+        {
+            const Source &source = sources[c];
+            unsigned char constant = (unsigned char)(std::min(std::max(channels[c].value, 0.0f), 1.0f) * 255.0f + 0.5f);
+            for (int y = 0; y < height; y++)
+                for (int x = 0; x < width; x++)
+                {
+                    unsigned char value = constant;
+                    if (source.data && source.width == width && source.height == height)
+                        value = source.data[(size_t)y * width + x];
+                    else if (source.data)
+                    {
+                        // texel centres of the packed image mapped onto the source
+                        float sx = std::max((x + 0.5f) * source.width / width - 0.5f, 0.0f);
+                        float sy = std::max((y + 0.5f) * source.height / height - 0.5f, 0.0f);
+                        int x0 = std::min((int)sx, source.width - 1), y0 = std::min((int)sy, source.height - 1);
+                        int x1 = std::min(x0 + 1, source.width - 1), y1 = std::min(y0 + 1, source.height - 1);
+                        float fx = sx - x0, fy = sy - y0;
+                        float top = source.data[(size_t)y0 * source.width + x0] * (1.0f - fx) + source.data[(size_t)y0 * source.width + x1] * fx;
+                        float bottom = source.data[(size_t)y1 * source.width + x0] * (1.0f - fx) + source.data[(size_t)y1 * source.width + x1] * fx;
+                        value = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+                    }
+                    rgb[((size_t)y * width + x) * 3 + c] = value;
+                }
+            if (source.data)
+                stbi_image_free(source.data);
+        }
+        return loaded;
+    }
+
+    // packs the channels into a PNG at the given path and cooks it
+    bool CookPacked(const std::string &path, const PackedChannel channels[3])
+    {
+        std::vector<unsigned char> rgb;
+        int width, height;
+        if (!PackChannels(channels, rgb, width, height))
+            return false;
+        if (!stbi_write_png(path.c_str(), width, height, 3, &rgb[0], width * 3))
+        {
+            std::cout << "ERROR::TEXTURE::FILE_NOT_WRITABLE: " << path << std::endl;
+            return false;
+        }
+        return Cook(path, TEXTURE_ORM);
+    }
+
+    // writes every format the kind of texture can be loaded as; colour maps get BC7 and BC1, or BC3 with alpha
+    bool Cook(const std::string &source, TextureKind kind)
+    {
+        PROFILE_SCOPE("cook.texture");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int width, height, nrComponents;
+        unsigned char *data = stbi_load(source.c_str(), &width, &height, &nrComponents, 4);
+        if (!data)
+        {
+            std::cout << "Texture failed to load at path: " << source << std::endl;
+            return false;
+        }
+        std::vector<std::vector<unsigned char> > mips(1, std::vector<unsigned char>(data, data + (size_t)width * height * 4));
+        stbi_image_free(data);
+        MipGenerator(threadCount).Build(mips, width, height, kind);
+
+        std::vector<BlockFormat> formats;
+        if (kind == TEXTURE_NORMAL)
+            formats.push_back(BLOCK_BC5);
+        else if (kind == TEXTURE_GRAY)
+            formats.push_back(BLOCK_BC4);
+        else
+        {
+            bool alpha = false;
+            for (size_t i = 3; i < mips[0].size() && !alpha; i += 4)
+                alpha = mips[0][i] < 255;
+            formats.push_back(BLOCK_BC7);
+            formats.push_back(alpha ? BLOCK_BC3 : BLOCK_BC1);
+        }
+
+        size_t sourceBytes = 0, cookedBytes = 0;
+        for (size_t f = 0; f < formats.size(); f++)
+        {
+            CompressedTexture texture;
+            texture.format = formats[f];
+            texture.width = width;
+            texture.height = height;
+            for (size_t level = 0; level < mips.size(); level++)
+            {
+                texture.levels.push_back(compress(formats[f], mips[level], std::max(1, width >> level), std::max(1, height >> level)));
+                cookedBytes += f == 0 ? texture.levels.back().size() : 0;
+                sourceBytes += f == 0 ? mips[level].size() : 0;
+            }
+            if (!SaveDds(CookedPath(source, formats[f]), texture))
+                return false;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << source << ": " << width << "x" << height << " " << BLOCK_FORMATS[formats[0]].name << ", " << sourceBytes / 1024 << " KB to "
+                  << cookedBytes / 1024 << " KB in " << ms << " ms" << std::endl;
+        return true;
+    }
+
+    // the DDS header with its DX10 extension, followed by the levels, largest first
+    static const size_t DDS_HEADER_SIZE = (32 + 5) * 4;
+
+    // DDS with the DX10 header extension, which names the BC4, BC5 and BC7 formats
+    static bool SaveDds(const std::string &path, const CompressedTexture &texture)
+    {
+        unsigned int header[DDS_HEADER_SIZE / 4] = {};
+        header[0] = 0x20534444; // "DDS "
+        header[1] = 124;
+        // caps, height, width, pixel format, mipmap count and linear size are set
+        header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+        header[3] = texture.height;
+        header[4] = texture.width;
+        header[5] = (unsigned int)texture.levels[0].size();
+        header[7] = (unsigned int)texture.levels.size();
+        // pixel format: size and a "DX10" four character code
+        header[19] = 32;
+        header[20] = 0x4;
+        header[21] = 0x30315844;
+        // texture, mipmap and complex caps
+        header[27] = 0x1000 | 0x400000 | 0x8;
+        // DX10 header: format, 2D resource dimension, array size
+        header[32] = BLOCK_FORMATS[texture.format].dxgiFormat;
+        header[33] = 3;
+        header[35] = 1;
+
+        std::ofstream file(path.c_str(), std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::TEXTURE::FILE_NOT_WRITABLE: " << path << std::endl;
+            return false;
+        }
+        file.write((const char *)header, sizeof(header));
+        for (size_t level = 0; level < texture.levels.size(); level++)
+            file.write((const char *)&texture.levels[level][0], texture.levels[level].size());
+        return (bool)file;
+    }
+
+    static bool LoadDds(const std::string &path, CompressedTexture &texture)
+    {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!LoadDdsHeader(file, path, texture))
+            return false;
+        for (size_t level = 0; level < texture.levels.size(); level++)
+        {
+            texture.levels[level].resize(LevelSize(texture.format, std::max(1, texture.width >> level), std::max(1, texture.height >> level)));
+            if (!file.read((char *)&texture.levels[level][0], texture.levels[level].size()))
+            {
+                std::cout << "ERROR::TEXTURE::DDS_TRUNCATED: " << path << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // the format, size and level count of a DDS file, leaving the levels empty and the file at the first of them
+    static bool LoadDdsHeader(std::istream &file, const std::string &path, CompressedTexture &texture)
+    {
+        unsigned char header[DDS_HEADER_SIZE];
+        if (!file || !file.read((char *)header, sizeof(header)))
+        {
+            std::cout << "ERROR::TEXTURE::DDS_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        return ParseDdsHeader(header, DDS_HEADER_SIZE, path, texture);
+    }
+
+    // the same from DDS data in memory, of which at least the header has to be given
+    static bool ParseDdsHeader(const unsigned char *data, size_t size, const std::string &path, CompressedTexture &texture)
+    {
+        unsigned int header[DDS_HEADER_SIZE / 4];
+        if (size < DDS_HEADER_SIZE || (memcpy(header, data, DDS_HEADER_SIZE), header[0] != 0x20534444) || header[21] != 0x30315844)
+        {
+            std::cout << "ERROR::TEXTURE::DDS_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        int format = 0;
+        while (format < BLOCK_FORMAT_COUNT && BLOCK_FORMATS[format].dxgiFormat != header[32])
+            format++;
+        if (format == BLOCK_FORMAT_COUNT)
+        {
+            std::cout << "ERROR::TEXTURE::DDS_UNSUPPORTED_FORMAT " << header[32] << ": " << path << std::endl;
+            return false;
+        }
+        texture.format = (BlockFormat)format;
+        texture.height = (int)header[3];
+        texture.width = (int)header[4];
+        texture.levels.assign(std::max(1u, header[7]), std::vector<unsigned char>());
+        return true;
+    }
+
+    static size_t LevelSize(BlockFormat format, int width, int height)
+    {
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BLOCK_FORMATS[format].blockBytes;
+    }
+
+private:
+    std::vector<unsigned char> compress(BlockFormat format, const std::vector<unsigned char> &rgba, int width, int height) const
+    {
+        int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        unsigned int blockBytes = BLOCK_FORMATS[format].blockBytes;
+        std::vector<unsigned char> blocks((size_t)blocksX * blocksY * blockBytes);
+        std::atomic<int> nextRow(0);
+        auto worker = [&]() {
+            unsigned char block[16 * 4];
+            for (int by = nextRow++; by < blocksY; by = nextRow++)
+                for (int bx = 0; bx < blocksX; bx++)
+                {
+                    // blocks over the edge of small mips repeat the last texel
+                    for (int i = 0; i < 16; i++)
+                    {
+                        int x = std::min(bx * 4 + (i & 3), width - 1), y = std::min(by * 4 + (i >> 2), height - 1);
+                        memcpy(&block[i * 4], &rgba[((size_t)y * width + x) * 4], 4);
+                    }
+                    BlockEncoder::Encode(format, block, &blocks[((size_t)by * blocksX + bx) * blockBytes]);
+                }
+        };
+        JobSystem::Get().RunParallel(std::min(threadCount, (unsigned int)blocksY), worker);
+        return blocks;
+    }
+};
+
+// which block formats the context can sample, looked up once
+struct CompressedFormatSupport {
+    bool checked = false;
+    bool s3tc = false;
+    bool s3tcSrgb = false;
+    bool bptc = false;
+
+    static CompressedFormatSupport &Get()
+    {
+        static CompressedFormatSupport support;
+        if (!support.checked)
+        {
+            // RGTC (BC4, BC5) is core since OpenGL 3.0, BPTC (BC7) since 4.2
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; i++)
+            {
+                const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+                if (!extension)
+                    continue;
+                if (strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+                    support.s3tc = true;
+                else if (strcmp(extension, "GL_EXT_texture_sRGB") == 0 || strcmp(extension, "GL_EXT_texture_compression_s3tc_srgb") == 0)
+                    support.s3tcSrgb = true;
+                else if (strcmp(extension, "GL_ARB_texture_compression_bptc") == 0)
+                    support.bptc = true;
+            }
+            support.bptc = support.bptc || GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 2);
+            support.checked = true;
+        }
+        return support;
+    }
+
+    // BPTC always has its sRGB variant, S3TC needs one of the sRGB extensions for it
+    bool Supports(BlockFormat format, bool srgb = false) const
+    {
+        if (format == BLOCK_BC1 || format == BLOCK_BC3)
+            return s3tc && (!srgb || s3tcSrgb);
+        if (format == BLOCK_BC7)
+            return bptc;
+        return true;
+    }
+};
+
+// the block formats of the up to date cooked files of a texture that the GPU can sample, best first
+int findCookedFormats(const std::string &source, TextureKind kind, BlockFormat formats[2])
+{
+    BlockFormat candidates[2];
+    int count = 0;
+    if (kind == TEXTURE_NORMAL)
+        candidates[count++] = BLOCK_BC5;
+    else if (kind == TEXTURE_GRAY)
+        candidates[count++] = BLOCK_BC4;
+    else
+    {
+        candidates[count++] = BLOCK_BC7;
+        candidates[count++] = TextureCooker::IsCooked(source, BLOCK_BC3) ? BLOCK_BC3 : BLOCK_BC1;
+    }
+
+    CompressedFormatSupport &support = CompressedFormatSupport::Get();
+    int found = 0;
+    for (int i = 0; i < count; i++)
+        if (support.Supports(candidates[i], kind == TEXTURE_COLOR) && TextureCooker::IsCooked(source, candidates[i]))
+            formats[found++] = candidates[i];
+    return found;
+}
+
+// uploads the cooked version of a texture if there is an up to date one the GPU can sample, returning 0 otherwise;
+// TEXTURE_COLOR maps are uploaded in the sRGB variant of their format
+unsigned int loadCookedTexture(const std::string &source, TextureKind kind)
+{
+    bool srgb = kind == TEXTURE_COLOR;
+    BlockFormat formats[2];
+    int count = findCookedFormats(source, kind, formats);
+    for (int i = 0; i < count; i++)
+    {
+        std::string path = TextureCooker::CookedPath(source, formats[i]);
+        CompressedTexture texture;
+        // the levels are uploaded straight from the asset pack's mapping when it holds the file
+        std::vector<const unsigned char *> levels;
+        if (const AssetPack::Entry *packed = AssetPack::Get().Find(path))
+        {
+            if (!TextureCooker::ParseDdsHeader(packed->data, packed->size, path, texture))
+                continue;
+            size_t offset = TextureCooker::DDS_HEADER_SIZE;
+            for (size_t level = 0; level < texture.levels.size(); level++)
+            {
+                levels.push_back(packed->data + offset);
+                offset += TextureCooker::LevelSize(texture.format, std::max(1, texture.width >> level), std::max(1, texture.height >> level));
+            }
+            if (offset > packed->size)
+            {
+                std::cout << "ERROR::TEXTURE::DDS_TRUNCATED: " << path << std::endl;
+                continue;
+            }
+        }
+        else
+        {
+            if (!TextureCooker::LoadDds(path, texture))
+                continue;
+            for (size_t level = 0; level < texture.levels.size(); level++)
+                levels.push_back(&texture.levels[level][0]);
+        }
+
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLenum glFormat = srgb ? BLOCK_FORMATS[texture.format].srgbGlFormat : BLOCK_FORMATS[texture.format].glFormat;
+        size_t bytes = 0;
+        for (size_t level = 0; level < levels.size(); level++)
+        {
+            int width = std::max(1, texture.width >> level), height = std::max(1, texture.height >> level);
+            size_t levelSize = TextureCooker::LevelSize(texture.format, width, height);
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, glFormat, width, height, 0, (GLsizei)levelSize, levels[level]);
+            bytes += levelSize;
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)texture.levels.size() - 1);
+        GpuResources::Get().Add(GPU_TEXTURE, textureID, bytes, path);
+        return textureID;
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,406 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+
+#include "profiler.h"
+#include "gpuResources.h"
+#include "textureCompression.h"
+#include "assetPack.h"
+#include "jobSystem.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <mutex>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// cooked textures are streamed in by the mip levels the frame needs instead of loaded whole, when turned on
+bool useTextureStreaming = false;
+// the most texture memory the streamer keeps resident, in MB, or 0 for no limit
+size_t textureBudgetMB = 0;
+
+// Keeps the cooked textures of a scene resident at the mip levels the frame needs. Registering a texture uploads
+// only its tail, the levels of TAIL_SIZE texels and below, so a scene loads with a few KB per texture. Every frame
+// the scene requests the level each drawn texture is minified to, and the next finer level of every texture below
+// its request is read from the DDS file by a job and uploaded on the GL thread, UPLOAD_BYTES a frame at
+// most. GL_TEXTURE_BASE_LEVEL is kept at the finest resident level, so a texture always samples what is loaded.
+//
+// With a budget, loads that don't fit release the finest levels of the least recently used textures first. When
+// the textures of the current frame alone don't fit, every request is biased a level coarser until they do, and
+// the bias is lowered again after a while under budget.
+class TextureStreamer
+{
+public:
+    static const int TAIL_SIZE = 64;
+    static const size_t UPLOAD_BYTES = 8 << 20;
+    // frames under budget before the bias is lowered again
+    static const unsigned int BIAS_FRAMES = 120;
+
+    size_t budgetBytes;
+    // levels every request is made coarser by to fit the budget
+    int bias = 0;
+    size_t residentBytes = 0;
+    // levels uploaded and released since the start
+    unsigned int uploads = 0;
+    unsigned int evictions = 0;
+
+    TextureStreamer(size_t budgetBytes = 0) : budgetBytes(budgetBytes)
+    {
+    }
+
+    ~TextureStreamer()
+    {
+        // the reads still running write into this streamer
+        JobSystem::Get().Wait(reads);
+    }
+
+    // creates a texture from the tail of the cooked file of a source image, returning 0 if it isn't cooked
+    unsigned int Register(const std::string &source, TextureKind kind)
+    {
+        PROFILE_SCOPE("load.textureTail");
+        BlockFormat formats[2];
+        if (findCookedFormats(source, kind, formats) == 0)
+            return 0;
+        Stream stream;
+        stream.path = TextureCooker::CookedPath(source, formats[0]);
+        CompressedTexture texture;
+        std::ifstream file;
+        const AssetPack::Entry *packed = AssetPack::Get().Find(stream.path);
+        if (packed)
+        {
+            if (!TextureCooker::ParseDdsHeader(packed->data, packed->size, stream.path, texture))
+                return 0;
+            stream.packed = packed->data;
+        }
+        else
+        {
+            file.open(stream.path.c_str(), std::ios::binary);
+            if (!TextureCooker::LoadDdsHeader(file, stream.path, texture))
+                return 0;
+        }
+        stream.format = texture.format;
+        stream.glFormat = kind == TEXTURE_COLOR ? BLOCK_FORMATS[texture.format].srgbGlFormat : BLOCK_FORMATS[texture.format].glFormat;
+        stream.width = texture.width;
+        stream.height = texture.height;
+        stream.levelCount = (int)texture.levels.size();
+        size_t offset = TextureCooker::DDS_HEADER_SIZE;
+        for (int level = 0; level < stream.levelCount; level++)
+        {
+            stream.offsets.push_back(offset);
+            offset += levelBytes(stream, level);
+        }
+        if (packed && offset > packed->size)
+        {
+            std::cout << "ERROR::TEXTURE::DDS_TRUNCATED: " << stream.path << std::endl;
+            return 0;
+        }
+        stream.tailLevel = 0;
+        while (stream.tailLevel < stream.levelCount - 1 && std::max(stream.width >> stream.tailLevel, stream.height >> stream.tailLevel) > TAIL_SIZE)
+            stream.tailLevel++;
+
+        std::vector<std::vector<unsigned char> > tail(stream.levelCount - stream.tailLevel);
+        if (!packed)
+            file.seekg(stream.offsets[stream.tailLevel]);
+        for (int level = stream.tailLevel; level < stream.levelCount; level++)
+        {
+            std::vector<unsigned char> &data = tail[level - stream.tailLevel];
+            data.resize(levelBytes(stream, level));
+            if (packed)
+                memcpy(&data[0], stream.packed + stream.offsets[level], data.size());
+            else if (!file.read((char *)&data[0], data.size()))
+            {
+                std::cout << "ERROR::TEXTURE::DDS_TRUNCATED: " << stream.path << std::endl;
+                return 0;
+            }
+        }
+
+        glGenTextures(1, &stream.id);
+        glBindTexture(GL_TEXTURE_2D, stream.id);
+        for (int level = stream.tailLevel; level < stream.levelCount; level++)
+        {
+            const std::vector<unsigned char> &data = tail[level - stream.tailLevel];
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, stream.glFormat, levelWidth(stream, level), levelHeight(stream, level), 0, (GLsizei)data.size(), &data[0]);
+            residentBytes += data.size();
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, stream.tailLevel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, stream.levelCount - 1);
+        stream.residentLevel = stream.wantedLevel = stream.tailLevel;
+        stream.texture = GpuTexture::Track(stream.id, residentSize(stream), stream.path);
+
+        streamIndices[stream.id] = (unsigned int)streams.size();
+        {
+            // the reads look up the file details of other streams
+            std::unique_lock<std::mutex> lock(mutex);
+            streams.push_back(stream);
+        }
+        return stream.id;
+    }
+
+    // starts the requests of a frame; textures that aren't requested only need their tail
+    void BeginFrame()
+    {
+        frame++;
+        for (size_t i = 0; i < streams.size(); i++)
+            streams[i].wantedLevel = streams[i].tailLevel;
+    }
+
+    // asks for the level a texture is sampled at when one pixel spans uvPerPixel texture coordinates
+    void Request(unsigned int id, float uvPerPixel)
+    {
+        std::map<unsigned int, unsigned int>::iterator found = streamIndices.find(id);
+        if (found == streamIndices.end())
+            return;
+        Stream &stream = streams[found->second];
+        // the GPU samples level log2(texels per pixel) and the next coarser one
+        float texelsPerPixel = uvPerPixel * std::max(stream.width, stream.height);
+        int level = texelsPerPixel > 1.0f ? (int)std::floor(std::log2(texelsPerPixel)) : 0;
+        level = std::min(std::max(level + bias, 0), stream.tailLevel);
+        stream.wantedLevel = std::min(stream.wantedLevel, level);
+        stream.lastUsed = frame;
+    }
+
+    // uploads what the loaders have read, and queues the next level of every texture below its request
+    void Update()
+    {
+        PROFILE_SCOPE("streaming.update");
+        std::vector<Load> ready;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.swap(finished);
+        }
+        size_t uploaded = 0;
+        for (size_t i = 0; i < ready.size(); i++)
+        {
+            Stream &stream = streams[ready[i].stream];
+            size_t bytes = levelBytes(stream, ready[i].level);
+            // the rest waits for the next frame, so a burst of loads doesn't stall this one
+            if (uploaded >= UPLOAD_BYTES)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                finished.push_back(ready[i]);
+                continue;
+            }
+            stream.loading = false;
+            loadingBytes -= bytes;
+            // a texture whose file failed to read keeps the levels it has instead of reading it again every frame
+            if (ready[i].data.empty())
+            {
+                stream.failed = true;
+                continue;
+            }
+            // a level that no longer joins the resident levels after an eviction
+            if (ready[i].level != stream.residentLevel - 1)
+                continue;
+            glBindTexture(GL_TEXTURE_2D, stream.id);
+            glCompressedTexImage2D(GL_TEXTURE_2D, ready[i].level, stream.glFormat, levelWidth(stream, ready[i].level), levelHeight(stream, ready[i].level), 0,
+                                   (GLsizei)bytes, &ready[i].data[0]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, ready[i].level);
+            stream.residentLevel = ready[i].level;
+            stream.texture.SetBytes(residentSize(stream));
+            residentBytes += bytes;
+            uploaded += bytes;
+            uploads++;
+        }
+
+        // the textures furthest from their request go first
+        std::vector<unsigned int> order;
+        for (unsigned int i = 0; i < streams.size(); i++)
+            if (!streams[i].loading && !streams[i].failed && streams[i].wantedLevel < streams[i].residentLevel)
+                order.push_back(i);
+        std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+            return streams[a].residentLevel - streams[a].wantedLevel > streams[b].residentLevel - streams[b].wantedLevel;
+        });
+        bool overBudget = false;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            Stream &stream = streams[order[i]];
+            int level = stream.residentLevel - 1;
+            size_t bytes = levelBytes(stream, level);
+            if (budgetBytes && !makeRoom(bytes))
+            {
+                overBudget = true;
+                continue;
+            }
+            stream.loading = true;
+            loadingBytes += bytes;
+            Load load;
+            load.stream = order[i];
+            load.level = level;
+            JobSystem::Get().Run([this, load]() { readLevel(load); }, &reads);
+        }
+
+        if (overBudget)
+        {
+            bias = std::min(bias + 1, 16);
+            framesUnderBudget = 0;
+        }
+        else if (bias > 0 && ++framesUnderBudget >= BIAS_FRAMES)
+        {
+            bias--;
+            framesUnderBudget = 0;
+        }
+    }
+
+    std::string StatsJson() const
+    {
+        std::ostringstream json;
+        json << "{\"textures\": " << streams.size() << ", \"resident_mb\": " << residentBytes / (1024.0 * 1024.0)
+             << ", \"budget_mb\": " << budgetBytes / (1024.0 * 1024.0) << ", \"uploads\": " << uploads
+             << ", \"evictions\": " << evictions << ", \"bias\": " << bias << "}";
+        return json.str();
+    }
+
+    void PrintStats() const
+    {
+        std::cout << "Texture streaming: " << streams.size() << " textures, " << residentBytes / (1024.0 * 1024.0) << " MB resident";
+        if (budgetBytes)
+            std::cout << " of " << budgetBytes / (1024.0 * 1024.0) << " MB";
+        std::cout << ", " << uploads << " levels uploaded, " << evictions << " released, bias " << bias << std::endl;
+    }
+
+private:
+    struct Stream {
+        std::string path;
+        // the file in the asset pack's mapping, or null when the levels are read from the file
+        const unsigned char *packed = NULL;
+        unsigned int id = 0;
+        // holds the texture for the streamer; its size follows the resident levels
+        GpuTexture texture;
+        BlockFormat format;
+        GLenum glFormat;
+        int width = 0;
+        int height = 0;
+        int levelCount = 0;
+        // where each level starts in the DDS file
+        std::vector<size_t> offsets;
+        // the levels from tailLevel down to 1x1 stay resident
+        int tailLevel = 0;
+        // the finest level uploaded, and the finest one requested this frame
+        int residentLevel = 0;
+        int wantedLevel = 0;
+        bool loading = false;
+        // a level failed to read, so no more are requested
+        bool failed = false;
+        unsigned int lastUsed = 0;
+    };
+
+    // a level read by a job, empty if the read failed
+    struct Load {
+        unsigned int stream;
+        int level;
+        std::vector<unsigned char> data;
+    };
+
+    std::vector<Stream> streams;
+    std::map<unsigned int, unsigned int> streamIndices;
+    unsigned int frame = 0;
+    unsigned int framesUnderBudget = 0;
+    // levels queued or being read, counted against the budget before they arrive
+    size_t loadingBytes = 0;
+
+    // counts the reads in flight
+    JobCounter reads;
+    std::mutex mutex;
+    std::vector<Load> finished;
+
+    static int levelWidth(const Stream &stream, int level)
+    {
+        return std::max(1, stream.width >> level);
+    }
+
+    static int levelHeight(const Stream &stream, int level)
+    {
+        return std::max(1, stream.height >> level);
+    }
+
+    static size_t levelBytes(const Stream &stream, int level)
+    {
+        return TextureCooker::LevelSize(stream.format, levelWidth(stream, level), levelHeight(stream, level));
+    }
+
+    // releases levels until bytes more fit the budget: first the ones finer than requested this frame, from the
+    // least recently used textures, then nothing, since the rest is needed by the frame
+    bool makeRoom(size_t bytes)
+    {
+        while (residentBytes + loadingBytes + bytes > budgetBytes)
+        {
+            int victim = -1;
+            for (unsigned int i = 0; i < streams.size(); i++)
+            {
+                const Stream &stream = streams[i];
+                int keep = stream.lastUsed == frame ? stream.wantedLevel : stream.tailLevel;
+                if (stream.residentLevel < keep && (victim < 0 || stream.lastUsed < streams[victim].lastUsed))
+                    victim = (int)i;
+            }
+            if (victim < 0)
+                return false;
+            release(streams[victim]);
+        }
+        return true;
+    }
+
+    // drops the finest resident level; a zero sized image frees its memory
+    void release(Stream &stream)
+    {
+        int level = stream.residentLevel;
+        glBindTexture(GL_TEXTURE_2D, stream.id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, stream.glFormat, 0, 0, 0, 0, NULL);
+        stream.residentLevel = level + 1;
+        stream.texture.SetBytes(residentSize(stream));
+        residentBytes -= levelBytes(stream, level);
+        evictions++;
+    }
+
+    // the bytes of the resident levels of a texture
+    static size_t residentSize(const Stream &stream)
+    {
+        size_t bytes = 0;
+        for (int level = stream.residentLevel; level < stream.levelCount; level++)
+            bytes += levelBytes(stream, level);
+        return bytes;
+    }
+
+    void readLevel(Load load)
+    {
+        std::string path;
+        const unsigned char *packed;
+        size_t offset, bytes;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            // the GL thread only changes the residency of a stream, never where its levels are
+            const Stream &stream = streams[load.stream];
+            path = stream.path;
+            packed = stream.packed;
+            offset = stream.offsets[load.level];
+            bytes = levelBytes(stream, load.level);
+        }
+
+        {
+            PROFILE_SCOPE("streaming.read");
+            load.data.resize(bytes);
+            // a packed level is only copied, which takes its page faults on the worker
+            if (packed)
+                memcpy(&load.data[0], packed + offset, bytes);
+            else
+            {
+                std::ifstream file(path.c_str(), std::ios::binary);
+                if (!file.seekg(offset) || !file.read((char *)&load.data[0], bytes))
+                {
+                    std::cout << "ERROR::TEXTURE::DDS_TRUNCATED: " << path << std::endl;
+                    load.data.clear();
+                }
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.push_back(load);
+    }
+};
+#endif
@@ -0,0 +1,102 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include <glm/glm.hpp>
+
+#include "profiler.h"
+
+#include <vector>
+#include <cstddef>
+
+// Nodes with a transform relative to their parent, in arrays ordered so every parent comes before its children.
+// Setting a local transform marks the node dirty; Update then makes one pass from the first dirty node onwards,
+// recomputing the world transform of every dirty node and of everything below one, and leaves the rest alone.
+// A root's world transform is its local transform as it is.
+class TransformHierarchy
+{
+public:
+    // the parent of each node, -1 for roots
+    std::vector<int> parents;
+    std::vector<glm::mat4> localTransforms;
+    std::vector<glm::mat4> worldTransforms;
+
+    TransformHierarchy() : firstDirty(NONE)
+    {
+    }
+
+    size_t Count() const
+    {
+        return parents.size();
+    }
+
+    // appends a node under a parent added before, or a root with parent -1, returning its index
+    int Add(int parent, const glm::mat4 &local)
+    {
+        int node = (int)parents.size();
+        parents.push_back(parent);
+        localTransforms.push_back(local);
+        worldTransforms.push_back(local);
+        dirty.push_back(1);
+        markDirty(node);
+        return node;
+    }
+
+    void SetLocal(int node, const glm::mat4 &local)
+    {
+        localTransforms[node] = local;
+        dirty[node] = 1;
+        markDirty(node);
+    }
+
+    // recomputes the world transforms of the dirty subtrees
+    void Update()
+    {
+        changed.clear();
+        if (firstDirty == NONE)
+            return;
+        PROFILE_SCOPE("transforms.update");
+        for (size_t node = firstDirty; node < parents.size(); node++)
+        {
+            int parent = parents[node];
+            if (parent >= 0 && dirty[parent])
+                dirty[node] = 1;
+            if (!dirty[node])
+                continue;
+            worldTransforms[node] = parent < 0 ? localTransforms[node] : worldTransforms[parent] * localTransforms[node];
+            changed.push_back((int)node);
+        }
+        // cleared afterwards, as the children of a node look at its flag during the pass
+        for (size_t i = 0; i < changed.size(); i++)
+            dirty[changed[i]] = 0;
+        firstDirty = NONE;
+    }
+
+    // the nodes whose world transform the last Update recomputed, in order
+    const std::vector<int> &Changed() const
+    {
+        return changed;
+    }
+
+    // whether every world transform is the identity, so the nodes can be ignored
+    bool IsIdentity() const
+    {
+        for (size_t node = 0; node < worldTransforms.size(); node++)
+            if (worldTransforms[node] != glm::mat4(1.0f))
+                return false;
+        return true;
+    }
+
+private:
+    static const size_t NONE = (size_t)-1;
+
+    std::vector<unsigned char> dirty;
+    std::vector<int> changed;
+    size_t firstDirty;
+
+    void markDirty(int node)
+    {
+        if (firstDirty == NONE || (size_t)node < firstDirty)
+            firstDirty = (size_t)node;
+    }
+};
+#endif